@@ -0,0 +1,113 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "mavix/v1/core/memory/memory_governor.h"
+#include "mavix/v1/core/memory_buffer.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief Read-only, reference counted view over bytes owned elsewhere.
+ *
+ * A slice keeps its owner alive, copying one or cutting a sub-slice only
+ * bumps the reference count, and the owner is released when the last slice
+ * referencing it is gone. Owners can be a MemoryBuffer, an adopted string
+ * (a protobuf bytes field moved out of its message) or anything that keeps
+ * memory valid while it lives, such as a page pin.
+ */
+class BufferSlice {
+ private:
+  std::shared_ptr<const void> owner_;
+  const uint8_t* data_;
+  size_t size_;
+
+ public:
+  BufferSlice() : owner_(), data_(nullptr), size_(0) {}
+
+  /**
+   * @brief View `size` bytes at `data`, valid as long as `owner` lives.
+   */
+  BufferSlice(const uint8_t* data, size_t size,
+              std::shared_ptr<const void> owner)
+      : owner_(std::move(owner)), data_(data), size_(data ? size : 0) {}
+
+  /**
+   * @brief Take over `buffer`, it is destroyed with the last slice. Callers
+   * must not Destroy() it themselves afterwards.
+   */
+  static BufferSlice FromMemoryBuffer(std::shared_ptr<MemoryBuffer> buffer) {
+    if (!buffer || !buffer->Data()) return BufferSlice();
+
+    auto data = buffer->Data();
+    auto size = buffer->Size();
+    auto owner = std::shared_ptr<const void>(
+        data, [buffer](const void*) { buffer->Destroy(); });
+
+    return BufferSlice(data, size, std::move(owner));
+  }
+
+  /**
+   * @brief Take over the bytes of `bytes` without copying them, charged to
+   * `category` of the global MemoryGovernor while referenced.
+   */
+  static BufferSlice Adopt(
+      std::string&& bytes,
+      memory::MemoryCategory category = memory::MemoryCategory::General) {
+    auto size = bytes.size();
+    auto owner = std::shared_ptr<std::string>(
+        new std::string(std::move(bytes)), [category](std::string* s) {
+          memory::MemoryGovernor::Global().Release(category, s->size());
+          delete s;
+        });
+
+    memory::MemoryGovernor::Global().Charge(category, size);
+    auto data = reinterpret_cast<const uint8_t*>(owner->data());
+
+    return BufferSlice(data, size, std::move(owner));
+  }
+
+  const uint8_t* Data() const { return data_; }
+
+  size_t Size() const { return size_; }
+
+  bool Empty() const { return size_ == 0; }
+
+  explicit operator bool() const { return data_ != nullptr; }
+
+  std::string_view View() const {
+    return std::string_view(reinterpret_cast<const char*>(data_), size_);
+  }
+
+  /**
+   * @brief Sub-range sharing the same owner, clamped to this slice. Empty
+   * when `offset` is past the end.
+   */
+  BufferSlice Slice(size_t offset, size_t length = std::string::npos) const {
+    if (offset > size_) return BufferSlice();
+
+    auto available = size_ - offset;
+    return BufferSlice(data_ + offset, length < available ? length : available,
+                       owner_);
+  }
+
+  // slices sharing the owner, this one included
+  long UseCount() const { return owner_.use_count(); }
+
+  void Reset() {
+    owner_.reset();
+    data_ = nullptr;
+    size_ = 0;
+  }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
@@ -31,7 +31,12 @@ struct BufferData {
   bool overlap;
 };
 
-enum class BufferPageState { Unallocated = 0, Allocated = 1, Deleted = 2 };
+enum class BufferPageState {
+  Unallocated = 0,
+  Allocated = 1,
+  Deleted = 2,
+  Loading = 3
+};
 
 NVM_ENUM_CLASS_DISPLAY_TRAIT(BufferPageState)
 
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+#include "absl/synchronization/mutex.h"
+#include "mavix/v1/core/byte_source.h"
+#include "mavix/v1/core/stream_state.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief Bounded single-producer single-consumer byte ring fed from an
+ * IByteSource on its own thread.
+ *
+ * The filler keeps reading ahead while the consumer decodes, and blocks
+ * when the ring is full, so memory stays at `capacity` no matter how fast
+ * the source is. The filler owns the free region and the consumer the
+ * filled region, bytes are moved outside of the lock.
+ */
+class ByteRingBuffer {
+ private:
+  std::shared_ptr<IByteSource> source_;
+  std::unique_ptr<uint8_t[]> data_;
+  size_t capacity_;
+  size_t head_;
+  size_t filled_;
+  uint64_t consumed_;
+  bool is_run_;
+  bool is_source_end_;
+  bool is_error_;
+  std::thread filler_;
+  absl::Mutex mu_;
+  absl::CondVar cv_filled_;
+  absl::CondVar cv_free_;
+
+  void ProcessFill() {
+    while (true) {
+      uint8_t* dest = nullptr;
+      size_t free_size = 0;
+      {
+        absl::MutexLock lock(&mu_);
+        while (filled_ == capacity_ && is_run_) {
+          cv_free_.Wait(&mu_);
+        }
+
+        if (!is_run_) break;
+
+        // contiguous free span after the tail, wrapping at the end
+        auto tail = (head_ + filled_) % capacity_;
+        free_size = tail >= head_ && filled_ != capacity_
+                        ? capacity_ - tail
+                        : head_ - tail;
+        dest = data_.get() + tail;
+      }
+
+      auto n = source_->Read(dest, free_size);
+
+      absl::MutexLock lock(&mu_);
+      if (n <= 0) {
+        is_source_end_ = true;
+        is_error_ = n < 0;
+        cv_filled_.SignalAll();
+        break;
+      }
+
+      filled_ += static_cast<size_t>(n);
+      cv_filled_.SignalAll();
+    }
+  }
+
+ public:
+  explicit ByteRingBuffer(std::shared_ptr<IByteSource> source,
+                          size_t capacity = 1024 * 1024 * 64)
+      : source_(source),
+        data_(nullptr),
+        capacity_(capacity == 0 ? 1 : capacity),
+        head_(0),
+        filled_(0),
+        consumed_(0),
+        is_run_(false),
+        is_source_end_(false),
+        is_error_(false),
+        filler_(),
+        mu_(),
+        cv_filled_(),
+        cv_free_() {}
+
+  ~ByteRingBuffer() { Stop(); }
+
+  size_t Capacity() const { return capacity_; }
+
+  StreamState Start() {
+    absl::MutexLock lock(&mu_);
+    if (is_run_) return StreamState::AlreadyOpen;
+    if (!source_ || !source_->IsOpen()) return StreamState::Error;
+
+    if (!data_) data_ = std::make_unique<uint8_t[]>(capacity_);
+    head_ = 0;
+    filled_ = 0;
+    consumed_ = 0;
+    is_source_end_ = false;
+    is_error_ = false;
+    is_run_ = true;
+
+    filler_ = std::thread(&ByteRingBuffer::ProcessFill, this);
+    return StreamState::Ok;
+  }
+
+  /**
+   * @brief Stop the filler, a filler blocked in a source read is cancelled.
+   */
+  void Stop() {
+    {
+      absl::MutexLock lock(&mu_);
+      if (!is_run_) return;
+
+      is_run_ = false;
+      cv_free_.SignalAll();
+      cv_filled_.SignalAll();
+    }
+
+    if (source_) source_->Cancel();
+
+    if (filler_.joinable()) filler_.join();
+  }
+
+  /**
+   * @brief Copy exactly `size` bytes out, blocking until they arrive.
+   * Returns fewer bytes only at the end of the source.
+   */
+  size_t Read(uint8_t* dest, size_t size) {
+    size_t total = 0;
+
+    while (total < size) {
+      size_t chunk = 0;
+      size_t head = 0;
+      {
+        absl::MutexLock lock(&mu_);
+        while (filled_ == 0 && !is_source_end_ && is_run_) {
+          cv_filled_.Wait(&mu_);
+        }
+
+        if (filled_ == 0) break;
+
+        head = head_;
+        chunk = std::min({size - total, filled_, capacity_ - head_});
+      }
+
+      std::memcpy(dest + total, data_.get() + head, chunk);
+      total += chunk;
+
+      absl::MutexLock lock(&mu_);
+      head_ = (head_ + chunk) % capacity_;
+      filled_ -= chunk;
+      consumed_ += chunk;
+      cv_free_.SignalAll();
+    }
+
+    return total;
+  }
+
+  // bytes handed to the consumer so far, the stream position
+  uint64_t Consumed() {
+    absl::MutexLock lock(&mu_);
+    return consumed_;
+  }
+
+  bool IsEof() {
+    absl::MutexLock lock(&mu_);
+    return is_source_end_ && filled_ == 0;
+  }
+
+  bool IsError() {
+    absl::MutexLock lock(&mu_);
+    return is_error_;
+  }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
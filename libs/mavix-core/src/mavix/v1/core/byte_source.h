@@ -0,0 +1,133 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "mavix/v1/core/stream_state.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief Forward-only producer of bytes: a pipe, stdin, a socket or a
+ * decompressing stream. No size, no seek.
+ */
+class IByteSource {
+ public:
+  virtual ~IByteSource() {}
+
+  virtual StreamState Open() = 0;
+
+  virtual StreamState Close() = 0;
+
+  virtual bool IsOpen() const = 0;
+
+  /**
+   * @brief Read up to `size` bytes. Returns the bytes read, 0 at the end of
+   * the source and -1 on error.
+   */
+  virtual int64_t Read(uint8_t* dest, size_t size) = 0;
+
+  // Make a blocked Read() give up, called from another thread.
+  virtual void Cancel() {}
+};
+
+/**
+ * @brief IByteSource over a file descriptor. The path "-" reads stdin.
+ */
+class DescriptorByteSource : public IByteSource {
+ private:
+  // how often a Read() waiting on an idle pipe checks for Cancel()
+  static constexpr int kCancelPollMs = 100;
+
+  std::string file_;
+  int fd_;
+  bool owns_fd_;
+  std::atomic<bool> is_cancelled_;
+
+ public:
+  explicit DescriptorByteSource(const std::string& file)
+      : file_(std::string(file)),
+        fd_(-1),
+        owns_fd_(file != "-"),
+        is_cancelled_(false) {}
+
+  /**
+   * @brief Adopt an already open descriptor, closed on Close() only when
+   * `owns_fd` is set.
+   */
+  DescriptorByteSource(int fd, bool owns_fd)
+      : file_(std::string()),
+        fd_(fd),
+        owns_fd_(owns_fd),
+        is_cancelled_(false) {}
+
+  ~DescriptorByteSource() {
+    if (IsOpen()) Close();
+  }
+
+  StreamState Open() override {
+    if (fd_ >= 0) return StreamState::AlreadyOpen;
+    is_cancelled_.store(false);
+
+    if (file_ == "-") {
+      fd_ = STDIN_FILENO;
+      return StreamState::Ok;
+    }
+
+    fd_ = ::open(file_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+      auto err = errno;
+      std::cerr << "Failed to open file: " << file_ << std::endl;
+      if (err == ENOENT) return StreamState::FileNotExist;
+      if (err == EACCES) return StreamState::PermissionFailed;
+      return StreamState::Error;
+    }
+
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return StreamState::Ok;
+  }
+
+  StreamState Close() override {
+    if (fd_ < 0) return StreamState::Error;
+
+    auto closed = owns_fd_ ? ::close(fd_) : 0;
+    fd_ = -1;
+    return closed == 0 ? StreamState::Ok : StreamState::Error;
+  }
+
+  bool IsOpen() const override { return fd_ >= 0; }
+
+  int64_t Read(uint8_t* dest, size_t size) override {
+    if (fd_ < 0) return -1;
+
+    while (!is_cancelled_.load()) {
+      struct pollfd pfd = {fd_, POLLIN, 0};
+      auto ready = ::poll(&pfd, 1, kCancelPollMs);
+      if (ready == 0 || (ready < 0 && errno == EINTR)) continue;
+      if (ready < 0) return -1;
+
+      auto n = ::read(fd_, dest, size);
+      if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+
+      return static_cast<int64_t>(n);
+    }
+
+    return -1;
+  }
+
+  void Cancel() override { is_cancelled_.store(true); }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
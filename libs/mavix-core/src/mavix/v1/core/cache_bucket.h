@@ -4,9 +4,15 @@
 
 #include <algorithm>
 #include <fstream>
+#include <vector>
 
 #include "absl/container/node_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "mavix/v1/core/aflag_once.h"
 #include "mavix/v1/core/buffer_struct.h"
+#include "mavix/v1/core/cache_page_table.h"
+#include "mavix/v1/core/memory/memory_governor.h"
+#include "mavix/v1/core/memory/page_buffer_pool.h"
 #include "mavix/v1/core/memory_buffer.h"
 #include "mavix/v1/core/page_locator.h"
 #include "mavix/v1/core/stream.h"
@@ -15,7 +21,11 @@ namespace mavix {
 namespace v1 {
 namespace core {
 
-enum class CacheGenerationOptions { None = 0, LimitMaxCacheSize = 1 };
+enum class CacheGenerationOptions {
+  None = 0,
+  LimitMaxCacheSize = 1,
+  HugePages = 2
+};
 
 
 NVM_ENUMCLASS_ENABLE_BITMASK_OPERATORS(CacheGenerationOptions)
@@ -26,6 +36,27 @@ NVM_ENUM_CLASS_DISPLAY_TRAIT(CacheGenerationOptions)
 
 /**
  * @brief Class that handle operations of multi-page/multi chunk stream buffered
+ *
+ * Pages live in a flat CachePageTable indexed by page id. Resident pages are
+ * resolved and pinned lock-free through the slot atomics; loading, eviction
+ * and release are serialized by an internal mutex, while the file read itself
+ * happens outside of it. When the underlying stream supports concurrent reads
+ * (pread backend) several threads can materialize different pages in
+ * parallel, otherwise the reads are serialized on the stream.
+ *
+ * With CacheGenerationOptions::LimitMaxCacheSize the number of resident pages
+ * is bounded by max_cache_size. Loading a page into a full bucket evicts
+ * another one with a CLOCK sweep, pinned pages are never evicted. When every
+ * resident page is pinned the bucket overcommits instead of blocking.
+ *
+ * Page buffers come from a PageBufferPool owned by the bucket and go back to
+ * it on release, so they are reused across pages and across Reset() instead
+ * of being reallocated. CacheGenerationOptions::HugePages backs them with
+ * transparent huge pages.
+ *
+ * Mapped page buffers are charged to MemoryCategory::CachePage. Under
+ * memory pressure the bucket gives unpinned pages back through a pressure
+ * handler registered with the global MemoryGovernor.
  */
 class CacheBucket {
  private:
@@ -34,14 +65,120 @@ class CacheBucket {
   std::streamsize stream_size_;
   std::shared_ptr<ICacheBucketBuffer> stream_;
   size_t number_of_max_cache_page_;
+  size_t resident_pages_;
+  size_t in_flight_pages_;
   uint64_t last_prepend_cache_page_;
   AFlagOnce isInitialized_;
-  absl::node_hash_map<uint64_t, MemoryBuffer> caches_;
-  absl::node_hash_map<uint64_t, BufferPage> pages_;
-  absl::node_hash_map<uint64_t, BufferPage> active_pages_;
-  absl::node_hash_map<uint64_t, BufferPage> deleted_pages_;
+  CachePageTable pages_;
+  memory::PageBufferPool buffer_pool_;
+  std::vector<uint64_t> clock_ring_;
+  size_t clock_hand_;
   PageLocator buffer_locator_;
   CacheGenerationOptions options_;
+  absl::Mutex mu_;
+  absl::Mutex io_mu_;
+  absl::CondVar cv_page_state_;
+  uint64_t pressure_handler_id_;
+
+  bool ReadPage(uint8_t* dest, const BufferPage& page) {
+    if (stream_->IsConcurrentReadSupported()) {
+      return stream_->CopyToPointer(dest, page.start, page.size);
+    }
+
+    absl::MutexLock lock(&io_mu_);
+    return stream_->CopyToPointer(dest, page.start, page.size);
+  }
+
+  void DestroySlotBuffer(CachePageSlot* slot)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    slot->data.store(nullptr);
+    if (slot->buffer) {
+      buffer_pool_.Release(slot->buffer);
+      slot->buffer = nullptr;
+      resident_pages_--;
+    }
+  }
+
+  /**
+   * @brief Release a resident page unless somebody pins it. The state flips
+   * before the pin check, a concurrent TryPinResident() either sees the flip
+   * and backs off, or its pin is seen here and the page stays.
+   */
+  bool ReleasePage(uint64_t cache_page_id) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    auto slot = pages_.At(cache_page_id);
+    if (!slot || slot->state.load() != BufferPageState::Allocated) return false;
+
+    slot->state.store(BufferPageState::Deleted);
+    if (slot->pin_count.load() > 0) {
+      slot->state.store(BufferPageState::Allocated);
+      return false;
+    }
+
+    DestroySlotBuffer(slot);
+    slot->referenced.store(false);
+
+    auto r = std::find(clock_ring_.begin(), clock_ring_.end(), cache_page_id);
+    if (r != clock_ring_.end()) {
+      auto index = size_t(r - clock_ring_.begin());
+      clock_ring_.erase(r);
+      if (index < clock_hand_) clock_hand_--;
+    }
+
+    return true;
+  }
+
+  bool IsCacheFull() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    // loading pages already own their buffer, they count as resident
+    return number_of_max_cache_page_ > 0 &&
+           resident_pages_ >= number_of_max_cache_page_;
+  }
+
+  /**
+   * @brief CLOCK sweep over the resident pages, evicts the first unpinned
+   * page whose reference bit is clear. False when everything is pinned.
+   */
+  bool EvictOnePage() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    auto sweep = clock_ring_.size() * 2;
+
+    while (sweep-- > 0 && !clock_ring_.empty()) {
+      if (clock_hand_ >= clock_ring_.size()) clock_hand_ = 0;
+
+      auto cache_page_id = clock_ring_[clock_hand_];
+      auto slot = pages_.At(cache_page_id);
+
+      if (slot->pin_count.load() > 0) {
+        clock_hand_++;
+        continue;
+      }
+
+      if (slot->referenced.exchange(false)) {
+        clock_hand_++;
+        continue;
+      }
+
+      if (!ReleasePage(cache_page_id)) {
+        clock_hand_++;
+        continue;
+      }
+
+#if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_STREAM_BUFFER)
+      std::cout << "Evicted cache page from bucket [" << cache_page_id << "]"
+                << std::endl;
+#endif
+
+      return true;
+    }
+
+    return false;
+  }
+
+  static bool TryPinResident(CachePageSlot* slot) {
+    slot->pin_count.fetch_add(1);
+    if (slot->state.load() == BufferPageState::Allocated) return true;
+
+    slot->pin_count.fetch_sub(1);
+    return false;
+  }
 
  public:
   explicit CacheBucket(std::shared_ptr<ICacheBucketBuffer> stream,
@@ -54,30 +191,46 @@ class CacheBucket {
         cache_size_page_(size_t(cache_size_page)),
         max_cache_size_(std::streamsize(max_cache_size)),
         number_of_max_cache_page_(0),
-        caches_(absl::node_hash_map<uint64_t, MemoryBuffer>()),
-        pages_(absl::node_hash_map<uint64_t, BufferPage>()),
-        active_pages_(absl::node_hash_map<uint64_t, BufferPage>()),
-        deleted_pages_(absl::node_hash_map<uint64_t, BufferPage>()),
+        resident_pages_(0),
+        in_flight_pages_(0),
+        pages_(),
+        buffer_pool_(cache_size_page,
+                     (options & CacheGenerationOptions::HugePages) ==
+                         CacheGenerationOptions::HugePages),
+        clock_ring_(std::vector<uint64_t>()),
+        clock_hand_(0),
         last_prepend_cache_page_(0),
         buffer_locator_(PageLocator()),
-        isInitialized_(AFlagOnce()) {
+        isInitialized_(AFlagOnce()),
+        pressure_handler_id_(0) {
     Initialize();
+
+    pressure_handler_id_ = memory::MemoryGovernor::Global().AddPressureHandler(
+        memory::MemoryCategory::CachePage,
+        [this](size_t bytes) { return ReclaimPages(bytes); });
   }
 
   ~CacheBucket() {
-    // if (isInitialized_.State()) {
-    //   Destroy();
-    // }
+    // waits for a running reclaim, the handler must not outlive the bucket
+    memory::MemoryGovernor::Global().RemovePressureHandler(
+        pressure_handler_id_);
+
+    // page buffers go back to the pool before the pool unmaps them
+    Destroy();
   }
 
   void Initialize() {
+    absl::MutexLock lock(&mu_);
     stream_size_ = stream_->Size();
 
     if (IsOptionLimitMaxCacheSize()) {
       number_of_max_cache_page_ = GetMaxCachePageNumbers();
     }
 
-    pages_ = GetRequiredBufferPages();
+    // a bounded bucket never needs more idle buffers than its page budget
+    buffer_pool_.SetMaxPooled(number_of_max_cache_page_);
+
+    pages_.Build(GetRequiredBufferPages());
 
     isInitialized_.Signal();
   }
@@ -89,9 +242,150 @@ class CacheBucket {
 
   size_t GetMaxCachePageNumbers() {
     if (stream_size_ == 0) return 0;
-    if (stream_size_ < max_cache_size_) return 1;
+    if (stream_size_ < max_cache_size_) {
+      return buffer_locator_.GetTotalPages(stream_size_, cache_size_page_);
+    }
+
+    // a range crossing a page boundary needs both pages resident
+    return std::max(
+        buffer_locator_.GetTotalPages(max_cache_size_, cache_size_page_),
+        size_t(2));
+  }
+
+  size_t MaxCachePages() {
+    absl::MutexLock lock(&mu_);
+    return number_of_max_cache_page_;
+  }
 
-    return buffer_locator_.GetTotalPages(max_cache_size_, cache_size_page_);
+  size_t ResidentCachePages() {
+    absl::MutexLock lock(&mu_);
+    return resident_pages_;
+  }
+
+  size_t TotalPages() const { return pages_.Size(); }
+
+  /**
+   * @brief Evict unpinned pages until about `bytes` are freed and unmap the
+   * idle buffers. Returns the bytes actually unmapped.
+   */
+  size_t ReclaimPages(size_t bytes) {
+    auto page_size = buffer_pool_.MappedSize();
+    auto before = buffer_pool_.Allocated();
+
+    {
+      absl::MutexLock lock(&mu_);
+      size_t evicted = 0;
+      while (evicted * page_size < bytes && EvictOnePage()) evicted++;
+    }
+
+    buffer_pool_.Clear();
+
+    auto after = buffer_pool_.Allocated();
+    return before > after ? (before - after) * page_size : 0;
+  }
+
+  /**
+   * @brief Load one page into the cache. Concurrent callers asking for the
+   * same page wait for the thread that is already loading it.
+   */
+  bool MaterializeCachePage(uint64_t cache_page_id) {
+    auto slot = pages_.At(cache_page_id);
+    if (!slot) return false;
+
+    if (slot->state.load() == BufferPageState::Allocated) {
+      slot->referenced.store(true);
+      return true;
+    }
+
+    uint8_t* dest = nullptr;
+
+    {
+      absl::MutexLock lock(&mu_);
+      while (slot->state.load() == BufferPageState::Loading) {
+        cv_page_state_.Wait(&mu_);
+      }
+
+      if (slot->state.load() == BufferPageState::Allocated) {
+        slot->referenced.store(true);
+        return true;
+      }
+
+      while (IsCacheFull() && EvictOnePage()) {
+      }
+
+      dest = buffer_pool_.Acquire();
+      if (!dest) return false;
+
+      slot->state.store(BufferPageState::Loading);
+      slot->buffer = dest;
+      resident_pages_++;
+      in_flight_pages_++;
+    }
+
+    auto copy_state = ReadPage(dest, slot->page);
+
+    absl::MutexLock lock(&mu_);
+    in_flight_pages_--;
+
+    if (copy_state) {
+      slot->data.store(dest);
+      slot->referenced.store(true);
+      slot->state.store(BufferPageState::Allocated);
+      clock_ring_.push_back(cache_page_id);
+    } else {
+      DestroySlotBuffer(slot);
+      slot->state.store(BufferPageState::Unallocated);
+    }
+
+    cv_page_state_.SignalAll();
+    return copy_state;
+  }
+
+  /**
+   * @brief Speculative load, never evicts. False when the bucket is full.
+   */
+  bool PrefetchCachePage(uint64_t cache_page_id) {
+    auto slot = pages_.At(cache_page_id);
+    if (!slot) return false;
+
+    auto state = slot->state.load();
+    if (state == BufferPageState::Allocated ||
+        state == BufferPageState::Loading) {
+      return true;
+    }
+
+    {
+      absl::MutexLock lock(&mu_);
+      if (IsCacheFull()) return false;
+    }
+
+    return MaterializeCachePage(cache_page_id);
+  }
+
+  /**
+   * @brief Load the page if needed and keep it resident until UnpinCachePage.
+   * Pins nest, every successful pin needs its own unpin.
+   */
+  bool PinCachePage(uint64_t cache_page_id) {
+    auto slot = pages_.At(cache_page_id);
+    if (!slot) return false;
+
+    // evicted again between the load and the pin, load it again
+    while (!TryPinResident(slot)) {
+      if (!MaterializeCachePage(cache_page_id)) return false;
+    }
+
+    slot->referenced.store(true);
+    return true;
+  }
+
+  void UnpinCachePage(uint64_t cache_page_id) {
+    auto slot = pages_.At(cache_page_id);
+    if (!slot) return;
+
+    auto pins = slot->pin_count.load();
+    while (pins > 0 && !slot->pin_count.compare_exchange_weak(pins, pins - 1)) {
+    }
   }
 
   size_t MaterializeCachePages(std::streampos position, size_t size) {
@@ -106,25 +400,9 @@ class CacheBucket {
       return 0;
     }
 
-    auto page_nums = locators->end_page_id - locators->start_page_id;
-    auto materialized_count = 0;
+    size_t materialized_count = 0;
     for (auto i = locators->start_page_id; i <= locators->end_page_id; i++) {
-      if (active_pages_.contains(i)) {
-        materialized_count++;
-        continue;
-      }
-
-      auto buff = caches_.emplace(i, MemoryBuffer(size));
-      auto page = &pages_.at(i);
-      auto copy_state = stream_->CopyToPointer(buff.first->second.Data(),
-                                               page->start, page->size);
-      page->cache_page_state = BufferPageState::Allocated;
-      page->marked_pos = std::streampos(0);
-      page->marked_size = std::streamsize(0);
-
-      active_pages_.emplace(i, BufferPage(*page));
-
-      materialized_count++;
+      if (MaterializeCachePage(i)) materialized_count++;
     }
 
     return materialized_count;
@@ -137,32 +415,28 @@ class CacheBucket {
 
     if (locators->type == PageLocatorResolvement::StartPageResolve) return 0;
 
+    absl::MutexLock lock(&mu_);
     size_t removed = 0;
     for (uint64_t i = locators->start_page_id; i <= locators->end_page_id;
          i++) {
-      if (!active_pages_.contains(i)) {
+      auto slot = pages_.At(i);
+      if (!slot) continue;
+
+      if (slot->state.load() != BufferPageState::Allocated) {
         removed++;
         continue;
       }
 
-      caches_.erase(i);
-      active_pages_.erase(i);
-      removed++;
+      // still in use by another reader, CLOCK will take it later
+      if (ReleasePage(i)) removed++;
     }
 
     return removed;
   }
 
   size_t RemoveCaches(uint64_t buffer_page_id) {
-    if (!active_pages_.contains(buffer_page_id)) {
-      return 0;
-    }
-
-    auto c = &caches_.at(buffer_page_id);
-    c->Destroy();
-
-    caches_.erase(buffer_page_id);
-    active_pages_.erase(buffer_page_id);
+    absl::MutexLock lock(&mu_);
+    if (!ReleasePage(buffer_page_id)) return 0;
 
 #if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_STREAM_BUFFER)
     std::cout << "Removed cache page from bucket [" << buffer_page_id << "]"
@@ -179,52 +453,123 @@ class CacheBucket {
   }
 
   bool Destroy() {
-    for (auto& c : caches_) {
-      c.second.Destroy();
+    absl::MutexLock lock(&mu_);
+
+    // in-flight reads still write into their slot buffer
+    while (in_flight_pages_ > 0) {
+      cv_page_state_.Wait(&mu_);
+    }
+
+    for (size_t i = 1; i <= pages_.Size(); i++) {
+      DestroySlotBuffer(pages_.At(i));
     }
 
-    pages_.clear();
-    active_pages_.clear();
-    deleted_pages_.clear();
-    caches_.clear();
+    pages_.Clear();
+    clock_ring_.clear();
+    clock_hand_ = 0;
+    resident_pages_ = 0;
     last_prepend_cache_page_ = 0;
     number_of_max_cache_page_ = 0;
 
     isInitialized_.Reset();
+    cv_page_state_.SignalAll();
     return true;
   }
 
   uint8_t* DataInline(uint64_t cache_page_id, std::streampos global_pos,
                       size_t size, bool prepend = false) {
-    if (pages_.size() == 0) return nullptr;
-
-    if (!pages_.contains(cache_page_id)) return nullptr;
-    auto p = pages_.at(cache_page_id);
+    auto slot = pages_.At(cache_page_id);
+    if (!slot) return nullptr;
 
-    if (!active_pages_.contains(cache_page_id)) {
-      if (prepend) {
-        auto materialized = MaterializeCachePages(p.start, p.size);
-      } else {
-        return nullptr;
-      }
+    if (slot->state.load() != BufferPageState::Allocated) {
+      if (!prepend) return nullptr;
+      if (!MaterializeCachePage(cache_page_id)) return nullptr;
     }
 
     auto local_pos = buffer_locator_.TranslateGlobalPosToLocalPos(
         global_pos, stream_size_, cache_size_page_);
     if (local_pos.first == 0) return nullptr;
+    if (local_pos.second + size > size_t(slot->page.size)) return nullptr;
+
+    auto data = slot->data.load();
+    if (!data) return nullptr;
 
-    auto c = &caches_.at(cache_page_id);
-    return c->Data(local_pos.second, size);
+    slot->referenced.store(true);
+    return data + local_pos.second;
   }
 
+  /**
+   * @brief Resolve the range as one span per cache page, no copy is made.
+   * Spans stay valid until their page is removed, evicted or the bucket
+   * destroyed; pin the pages first when the bucket has a size limit.
+   * Returns an empty vector when any page of the range can not be loaded.
+   */
   std::vector<BufferPointer> GetAsPointer(std::streampos position, size_t size,
                                           PageLocatorInfo& resolve_result) {
-    return std::vector<BufferPointer>();
+    auto pointers = std::vector<BufferPointer>();
+
+    if (stream_size_ == 0 || size == 0) {
+      resolve_result = PageLocatorInfo();
+      return pointers;
+    }
+
+    auto locator = GetBufferLocator(position, size);
+
+    if (!locator || (locator->type != PageLocatorResolvement::SinglePage &&
+                     locator->type != PageLocatorResolvement::CrossPage)) {
+      resolve_result = PageLocatorInfo();
+      return pointers;
+    }
+
+    auto global_cursor = std::streampos(position);
+    auto global_end = position + std::streamsize(size);
+    bool overlap = locator->type == PageLocatorResolvement::CrossPage;
+
+    pointers.reserve(locator->end_page_id - locator->start_page_id + 1);
+
+    // loading a later page must not evict the ones already resolved
+    uint64_t pinned_end = locator->start_page_id;
+    bool state = true;
+
+    for (uint64_t i = locator->start_page_id; i <= locator->end_page_id; i++) {
+      if (!PinCachePage(i)) {
+        state = false;
+        break;
+      }
+
+      pinned_end = i + 1;
+
+      auto slot = pages_.At(i);
+      auto& p = slot->page;
+
+      auto local_start = std::max(p.start, global_cursor);
+      auto span_end = std::min(global_end, p.end + std::streamsize(1));
+      auto local_size = span_end - local_start;
+
+      if (local_size <= 0) break;
+
+      pointers.push_back(BufferPointer{
+          slot->data.load() + std::streamsize(local_start - p.start),
+          static_cast<size_t>(local_size), true, overlap});
+      global_cursor = span_end;
+    }
+
+    for (uint64_t i = locator->start_page_id; i < pinned_end; i++) {
+      UnpinCachePage(i);
+    }
+
+    if (!state) {
+      resolve_result = PageLocatorInfo();
+      return std::vector<BufferPointer>();
+    }
+
+    resolve_result.Clone(*locator);
+    return pointers;
   }
 
   std::shared_ptr<MemoryBuffer> GetAsCopy(std::streampos position, size_t size,
                                           PageLocatorInfo& resolve_result) {
-    if (pages_.size() == 0) {
+    if (stream_size_ == 0) {
       resolve_result = PageLocatorInfo();
       return nullptr;
     }
@@ -236,11 +581,8 @@ class CacheBucket {
       return nullptr;
     }
 
-    if (locator->type == PageLocatorResolvement::SinglePage) {
-      auto buffer = std::make_shared<MemoryBuffer>(size);
-      resolve_result.Clone(*locator);
-      return std::move(buffer);
-    } else if (locator->type == PageLocatorResolvement::CrossPage) {
+    if (locator->type == PageLocatorResolvement::SinglePage ||
+        locator->type == PageLocatorResolvement::CrossPage) {
       auto global_cursor = std::streampos(position);
       auto global_end = position + std::streamsize(size);
       size_t buffer_cursor = 0;
@@ -249,18 +591,16 @@ class CacheBucket {
 
       for (uint64_t i = locator->start_page_id; i <= locator->end_page_id;
            i++) {
-        auto isPageDefined = pages_.contains(i);
-        if (!isPageDefined) {
+        // Ensure cache pages are materialized, pinned so a concurrent load
+        // can not evict it between the load and the copy
+        if (!PinCachePage(i)) {
+          buffer->Destroy();
           resolve_result = PageLocatorInfo();
           return nullptr;
         }
 
-        BufferPage& p = pages_.at(i);
-
-        // Ensure cache pages are materialized if necessary
-        if (!active_pages_.contains(i)) {
-          MaterializeCachePages(p.start, p.size);
-        }
+        auto slot = pages_.At(i);
+        auto& p = slot->page;
 
         // Calculate the start of the copy range within the current page
         auto local_start = std::max(p.start, global_cursor);
@@ -270,24 +610,20 @@ class CacheBucket {
 
         auto local_size = copy_end - local_start;
 
-        if (local_size <= 0) {
-          break;
-        }
-
-        auto& c = caches_.at(i);
-        // Adjusted for page-relative position
-        auto src_ptr = c.Data(local_start - p.start, local_size);
+        if (local_size > 0) {
+          // Adjusted for page-relative position
+          auto src_ptr =
+              slot->data.load() + std::streamsize(local_start - p.start);
+          auto dest_ptr = buffer->Data(buffer_cursor, local_size);
+          std::memcpy(dest_ptr, src_ptr, local_size);
 
-        if (!src_ptr) {
-          resolve_result = PageLocatorInfo();
-          return nullptr;
+          buffer_cursor += local_size;
+          global_cursor = copy_end;
         }
 
-        auto dest_ptr = buffer->Data(buffer_cursor, local_size);
-        std::memcpy(dest_ptr, src_ptr, local_size);
+        UnpinCachePage(i);
 
-        buffer_cursor += local_size;
-        global_cursor = copy_end;
+        if (local_size <= 0) break;
       }
 
       resolve_result.Clone(*locator);
@@ -302,8 +638,6 @@ class CacheBucket {
     return false;
   }
 
-  absl::node_hash_map<uint64_t, BufferPage>& BuferPages() { return pages_; }
-
   std::shared_ptr<PageLocatorInfo> GetBufferLocator(std::streampos position,
                                                     std::streamsize size) {
     return buffer_locator_.GetPageRange(position, size, cache_size_page_,
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+
+#include <atomic>
+#include <memory>
+
+#include "absl/container/node_hash_map.h"
+#include "mavix/v1/core/buffer_struct.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief One cache page entry. Geometry is written once when the table is
+ * built; state, data, pins and the reference bit are atomics so resident
+ * pages can be looked up without taking the bucket mutex. The buffer is
+ * borrowed from the bucket PageBufferPool and only touched under the bucket
+ * mutex.
+ */
+struct CachePageSlot {
+  BufferPage page;
+  std::atomic<BufferPageState> state;
+  std::atomic<uint8_t*> data;
+  std::atomic<uint32_t> pin_count;
+  std::atomic<bool> referenced;
+  uint8_t* buffer;
+
+  CachePageSlot()
+      : page(),
+        state(BufferPageState::Unallocated),
+        data(nullptr),
+        pin_count(0),
+        referenced(false),
+        buffer(nullptr) {}
+};
+
+/**
+ * @brief Flat page table indexed by page id. Page ids from PageLocator are
+ * always 1..N contiguous, so a lookup is a bound check and an offset.
+ */
+class CachePageTable {
+ private:
+  std::unique_ptr<CachePageSlot[]> slots_;
+  size_t size_;
+
+ public:
+  CachePageTable() : slots_(nullptr), size_(0) {}
+
+  NVM_CONST_DELETE_COPY_AND_DEFAULT_MOVE(CachePageTable)
+
+  void Build(const absl::node_hash_map<uint64_t, BufferPage>& pages) {
+    size_ = pages.size();
+    slots_ = size_ > 0 ? std::make_unique<CachePageSlot[]>(size_) : nullptr;
+
+    for (auto& p : pages) {
+      if (p.first == 0 || p.first > size_) continue;
+
+      auto& slot = slots_[p.first - 1];
+      slot.page = p.second;
+      slot.state.store(p.second.cache_page_state);
+    }
+  }
+
+  void Clear() {
+    slots_.reset();
+    size_ = 0;
+  }
+
+  CachePageSlot* At(uint64_t cache_page_id) const {
+    if (cache_page_id == 0 || cache_page_id > size_) return nullptr;
+    return &slots_[cache_page_id - 1];
+  }
+
+  size_t Size() const { return size_; }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
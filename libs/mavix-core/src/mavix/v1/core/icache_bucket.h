@@ -8,6 +8,9 @@ namespace core {
   public:
     virtual std::streamsize Size() const = 0;
     virtual bool CopyToPointer(uint8_t* data, std::streampos start, size_t size)  = 0;
+
+    // True when CopyToPointer can be called from several threads at once.
+    virtual bool IsConcurrentReadSupported() const { return false; }
 };
 }  // namespace core
 
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "nvm/macro.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+namespace memory {
+
+/**
+ * @brief Bump allocator for data that lives exactly as long as one decoded
+ * block.
+ *
+ * Allocation is a pointer bump inside the current chunk, nothing is freed
+ * on its own. Reset() rewinds to the first chunk in O(1) and keeps the
+ * chunks for the next block, so a worker reaches a steady state with no
+ * allocator calls at all. Only trivially destructible types may be placed
+ * here since no destructor ever runs. Not thread-safe, one per worker.
+ */
+class BlockArena {
+ private:
+  struct Chunk {
+    std::unique_ptr<uint8_t[]> data;
+    size_t size;
+  };
+
+  size_t chunk_size_;
+  size_t max_retained_;
+  std::vector<Chunk> chunks_;
+  size_t current_;
+  size_t cursor_;
+  size_t used_;
+
+  // offset of the first `alignment` boundary at or after base + cursor
+  static size_t AlignedOffset(const uint8_t* base, size_t cursor,
+                              size_t alignment) {
+    auto address = reinterpret_cast<uintptr_t>(base) + cursor;
+    auto aligned = (address + alignment - 1) & ~(uintptr_t(alignment) - 1);
+    return cursor + (aligned - address);
+  }
+
+  uint8_t* AllocateSlow(size_t size, size_t alignment) {
+    // move on to the next retained chunk that fits, oversized requests get
+    // a chunk of their own
+    while (current_ + 1 < chunks_.size()) {
+      current_++;
+      cursor_ = 0;
+
+      auto start = AlignedOffset(chunks_[current_].data.get(), 0, alignment);
+      if (start + size <= chunks_[current_].size) {
+        cursor_ = start + size;
+        return chunks_[current_].data.get() + start;
+      }
+    }
+
+    auto chunk_size = std::max(chunk_size_, size + alignment);
+    // not value-initialized, zeroing a chunk would cost more than using it
+    auto data = std::unique_ptr<uint8_t[]>(new uint8_t[chunk_size]);
+    chunks_.push_back(Chunk{std::move(data), chunk_size});
+    current_ = chunks_.size() - 1;
+
+    auto base = chunks_[current_].data.get();
+    auto start = AlignedOffset(base, 0, alignment);
+    cursor_ = start + size;
+    return base + start;
+  }
+
+ public:
+  /**
+   * @brief `max_retained` caps the chunks kept over a Reset(), 0 keeps all.
+   */
+  explicit BlockArena(size_t chunk_size = 1024 * 1024, size_t max_retained = 0)
+      : chunk_size_(chunk_size == 0 ? 1024 * 1024 : chunk_size),
+        max_retained_(max_retained),
+        chunks_(),
+        current_(0),
+        cursor_(0),
+        used_(0) {}
+
+  ~BlockArena() {}
+
+  NVM_CONST_DELETE_COPY_AND_DEFAULT_MOVE(BlockArena)
+
+  void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+    if (size == 0) size = 1;
+    used_ += size;
+
+    if (!chunks_.empty()) {
+      auto base = chunks_[current_].data.get();
+      auto start = AlignedOffset(base, cursor_, alignment);
+
+      if (start + size <= chunks_[current_].size) {
+        cursor_ = start + size;
+        return base + start;
+      }
+    }
+
+    return AllocateSlow(size, alignment);
+  }
+
+  template <typename T>
+  T* AllocateArray(size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "BlockArena never runs destructors");
+    return static_cast<T*>(Allocate(sizeof(T) * count, alignof(T)));
+  }
+
+  template <typename T, typename... Args>
+  T* Create(Args&&... args) {
+    static_assert(std::is_trivially_destructible<T>::value,
+                  "BlockArena never runs destructors");
+    return new (Allocate(sizeof(T), alignof(T)))
+        T(std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief Forget every allocation, memory handed out before is invalid.
+   */
+  void Reset() {
+    if (max_retained_ > 0 && chunks_.size() > max_retained_) {
+      chunks_.resize(max_retained_);
+    }
+
+    current_ = 0;
+    cursor_ = 0;
+    used_ = 0;
+  }
+
+  // bytes handed out since the last Reset()
+  size_t Used() const { return used_; }
+
+  size_t Reserved() const {
+    size_t total = 0;
+    for (auto& chunk : chunks_) total += chunk.size;
+    return total;
+  }
+};
+
+}  // namespace memory
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
@@ -19,6 +19,8 @@
 
 #include <jemalloc/jemalloc.h>
 
+#elif defined(MAVIX_ALLOCATOR_POOL)
+#include "mavix/v1/core/memory/pool_allocator.h"
 #endif
 
 namespace mavix {
@@ -26,7 +28,12 @@ namespace v1 {
 namespace core {
 namespace memory {
 
-enum class AllocatorType { StdAllocator = 0, GoogleArena = 1, JEMalloc = 2 };
+enum class AllocatorType {
+  StdAllocator = 0,
+  GoogleArena = 1,
+  JEMalloc = 2,
+  Pool = 3
+};
 
 // cppcheck-suppress unknownMacro
 NVM_ENUM_CLASS_DISPLAY_TRAIT(AllocatorType)
@@ -38,7 +45,8 @@ NVM_ENUM_CLASS_DISPLAY_TRAIT(AllocatorType)
  * Allocator selection macros might be defined externally during build only.
  * Define macro MAVIX_ALLOCATOR_GOOGLE_ARENA to use TCMalloc.
  * Define macro MAVIX_ALLOCATOR_JEMALLOC to use JEMalloc.
- * Undefined both will fallback to std::allocator<T>.
+ * Define macro MAVIX_ALLOCATOR_POOL to use the size class PoolAllocator.
+ * Undefined all will fallback to std::allocator<T>.
  */
 template <typename T>
 class MemoryAllocator {
@@ -71,6 +79,8 @@ class MemoryAllocator {
     p = static_cast<pointer>(tc_malloc(bytes_to_allocate));
 #elif defined(MAVIX_ALLOCATOR_JEMALLOC)
     p = static_cast<pointer>(malloc(bytes_to_allocate));
+#elif defined(MAVIX_ALLOCATOR_POOL)
+    p = static_cast<pointer>(PoolAllocator::Allocate(bytes_to_allocate));
 #else
     p = static_cast<pointer>(std::malloc(bytes_to_allocate));
 #endif
@@ -88,6 +98,8 @@ class MemoryAllocator {
     tc_free(p);
 #elif defined(MAVIX_ALLOCATOR_JEMALLOC)
     free(p);
+#elif defined(MAVIX_ALLOCATOR_POOL)
+    PoolAllocator::Deallocate(p, n * sizeof(T));
 #else
     std::free(p);
 #endif
@@ -112,6 +124,8 @@ class MemoryAllocator {
     return AllocatorType::GoogleArena;
 #elif defined(MAVIX_ALLOCATOR_JEMALLOC)
     return AllocatorType::JEMalloc;
+#elif defined(MAVIX_ALLOCATOR_POOL)
+    return AllocatorType::Pool;
 #else
     return AllocatorType::StdAllocator;
 #endif
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "nvm/macro.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+namespace memory {
+
+enum class MemoryCategory {
+  General = 0,
+  CachePage = 1,
+  BlobQueue = 2,
+  Inflate = 3,
+  Decode = 4,
+  Pool = 5
+};
+
+// cppcheck-suppress unknownMacro
+NVM_ENUM_CLASS_DISPLAY_TRAIT(MemoryCategory)
+
+/**
+ * @brief Process wide accounting of the memory the ingest pipeline holds,
+ * split by category, with optional budgets per category and in total.
+ *
+ * Charging never blocks and never fails, the governor only keeps the books.
+ * Producers ask IsOverBudget() at a point where they hold no locks, run
+ * Reclaim() so owners of reclaimable memory (cache buckets) give some back
+ * through their pressure handlers, and otherwise wait in WaitForRelease()
+ * until consumers free what they hold. A budget of 0 means unlimited, which
+ * is the default for everything.
+ */
+class MemoryGovernor {
+ public:
+  using PressureHandler = std::function<size_t(size_t bytes)>;
+
+ private:
+  static constexpr size_t kCategoryCount = 6;
+
+  struct PressureHandlerEntry {
+    uint64_t id;
+    MemoryCategory category;
+    PressureHandler reclaim;
+  };
+
+  std::array<std::atomic<size_t>, kCategoryCount> used_;
+  std::array<std::atomic<size_t>, kCategoryCount> peak_;
+  std::array<std::atomic<size_t>, kCategoryCount> budgets_;
+  std::atomic<size_t> total_;
+  std::atomic<size_t> total_budget_;
+  std::atomic<size_t> waiters_;
+  absl::Mutex mu_;
+  absl::CondVar cv_release_;
+  // held while handlers run, so a handler can not be removed mid-call
+  absl::Mutex handlers_mu_;
+  std::vector<PressureHandlerEntry> handlers_;
+  uint64_t next_handler_id_;
+
+  static size_t Index(MemoryCategory category) {
+    return static_cast<size_t>(category);
+  }
+
+  static size_t Excess(size_t used, size_t budget) {
+    return budget > 0 && used > budget ? used - budget : 0;
+  }
+
+ public:
+  MemoryGovernor()
+      : used_(),
+        peak_(),
+        budgets_(),
+        total_(0),
+        total_budget_(0),
+        waiters_(0),
+        mu_(),
+        cv_release_(),
+        handlers_mu_(),
+        handlers_(),
+        next_handler_id_(1) {
+    for (size_t i = 0; i < kCategoryCount; i++) {
+      used_[i].store(0);
+      peak_[i].store(0);
+      budgets_[i].store(0);
+    }
+  }
+
+  ~MemoryGovernor() {}
+
+  /**
+   * @brief The governor every MemoryBuffer is charged against. Never
+   * destroyed, buffers may still be released during static teardown.
+   */
+  static MemoryGovernor& Global() {
+    static MemoryGovernor* governor = new MemoryGovernor();
+    return *governor;
+  }
+
+  void SetBudget(MemoryCategory category, size_t bytes) {
+    budgets_[Index(category)].store(bytes);
+  }
+
+  size_t Budget(MemoryCategory category) const {
+    return budgets_[Index(category)].load();
+  }
+
+  void SetTotalBudget(size_t bytes) { total_budget_.store(bytes); }
+
+  size_t TotalBudget() const { return total_budget_.load(); }
+
+  void Charge(MemoryCategory category, size_t bytes) {
+    if (bytes == 0) return;
+
+    auto index = Index(category);
+    auto used = used_[index].fetch_add(bytes) + bytes;
+    total_.fetch_add(bytes);
+
+    auto peak = peak_[index].load();
+    while (used > peak && !peak_[index].compare_exchange_weak(peak, used)) {
+    }
+  }
+
+  void Release(MemoryCategory category, size_t bytes) {
+    if (bytes == 0) return;
+
+    used_[Index(category)].fetch_sub(bytes);
+    total_.fetch_sub(bytes);
+
+    if (waiters_.load() > 0) {
+      absl::MutexLock lock(&mu_);
+      cv_release_.SignalAll();
+    }
+  }
+
+  size_t Used(MemoryCategory category) const {
+    return used_[Index(category)].load();
+  }
+
+  size_t Peak(MemoryCategory category) const {
+    return peak_[Index(category)].load();
+  }
+
+  size_t Total() const { return total_.load(); }
+
+  /**
+   * @brief True when the category is over its own budget or the process is
+   * over the total budget.
+   */
+  bool IsOverBudget(MemoryCategory category) const {
+    return Excess(Used(category), Budget(category)) > 0 ||
+           Excess(Total(), TotalBudget()) > 0;
+  }
+
+  /**
+   * @brief Run the pressure handlers until the excess is given back. Only
+   * the handlers of `category` are asked for a category excess, all of them
+   * for a total excess. Returns the bytes the handlers reported.
+   */
+  size_t Reclaim(MemoryCategory category) {
+    absl::MutexLock lock(&handlers_mu_);
+    size_t reclaimed = 0;
+
+    for (auto& handler : handlers_) {
+      auto category_excess = Excess(Used(category), Budget(category));
+      auto total_excess = Excess(Total(), TotalBudget());
+      if (category_excess == 0 && total_excess == 0) break;
+
+      if (handler.category == category && category_excess > 0) {
+        reclaimed += handler.reclaim(category_excess);
+      } else if (total_excess > 0) {
+        reclaimed += handler.reclaim(total_excess);
+      }
+    }
+
+    return reclaimed;
+  }
+
+  /**
+   * @brief Block until some memory is released or the timeout passes.
+   * Returns false on timeout.
+   */
+  bool WaitForRelease(absl::Duration timeout) {
+    absl::MutexLock lock(&mu_);
+    waiters_.fetch_add(1);
+    auto timed_out = cv_release_.WaitWithTimeout(&mu_, timeout);
+    waiters_.fetch_sub(1);
+
+    return !timed_out;
+  }
+
+  /**
+   * @brief Register a handler giving back up to `bytes` of reclaimable
+   * memory of `category`, it returns what it actually released. The
+   * returned id removes it again.
+   */
+  uint64_t AddPressureHandler(MemoryCategory category,
+                              PressureHandler reclaim) {
+    absl::MutexLock lock(&handlers_mu_);
+    auto id = next_handler_id_++;
+    handlers_.push_back(PressureHandlerEntry{id, category, std::move(reclaim)});
+    return id;
+  }
+
+  void RemovePressureHandler(uint64_t id) {
+    absl::MutexLock lock(&handlers_mu_);
+    for (auto it = handlers_.begin(); it != handlers_.end(); ++it) {
+      if (it->id == id) {
+        handlers_.erase(it);
+        return;
+      }
+    }
+  }
+};
+
+}  // namespace memory
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "mavix/v1/core/memory/memory_governor.h"
+#include "nvm/macro.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+namespace memory {
+
+/**
+ * @brief Recycling pool of fixed size, page aligned buffers for cache pages.
+ *
+ * Buffers are mapped straight from the kernel once and handed back to the
+ * pool on release instead of being unmapped, so a long scan reuses the same
+ * few physical pages rather than making the allocator map and unmap large
+ * spans per cache page. With huge pages enabled buffers are aligned to 2 MB
+ * and advised MADV_HUGEPAGE, transparent huge pages back them when the
+ * kernel allows it.
+ */
+class PageBufferPool {
+ private:
+  static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+  size_t buffer_size_;
+  size_t mapped_size_;
+  size_t max_pooled_;
+  bool huge_pages_;
+  size_t allocated_;
+  std::vector<uint8_t*> free_;
+  absl::Mutex mu_;
+
+  static size_t AlignUp(size_t size, size_t alignment) {
+    return ((size + alignment - 1) / alignment) * alignment;
+  }
+
+  uint8_t* Map() {
+    auto buffer = MapRegion();
+    if (buffer) {
+      MemoryGovernor::Global().Charge(MemoryCategory::CachePage, mapped_size_);
+    }
+
+    return buffer;
+  }
+
+  uint8_t* MapRegion() {
+    if (!huge_pages_) {
+      void* addr = ::mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      return addr == MAP_FAILED ? nullptr : static_cast<uint8_t*>(addr);
+    }
+
+    // over-map, then trim head and tail so the buffer starts on a 2 MB
+    // boundary and the kernel can back it with whole huge pages
+    auto reserve = mapped_size_ + kHugePageSize;
+    void* addr = ::mmap(nullptr, reserve, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) return nullptr;
+
+    auto raw = reinterpret_cast<uintptr_t>(addr);
+    auto aligned = AlignUp(raw, kHugePageSize);
+    auto head = aligned - raw;
+    auto tail = reserve - head - mapped_size_;
+
+    if (head > 0) ::munmap(addr, head);
+    if (tail > 0) {
+      ::munmap(reinterpret_cast<void*>(aligned + mapped_size_), tail);
+    }
+
+#if defined(MADV_HUGEPAGE)
+    ::madvise(reinterpret_cast<void*>(aligned), mapped_size_, MADV_HUGEPAGE);
+#endif
+
+    return reinterpret_cast<uint8_t*>(aligned);
+  }
+
+  void Unmap(uint8_t* buffer) {
+    ::munmap(buffer, mapped_size_);
+    MemoryGovernor::Global().Release(MemoryCategory::CachePage, mapped_size_);
+  }
+
+ public:
+  /**
+   * @brief `max_pooled` caps the idle buffers kept for reuse, 0 keeps all.
+   */
+  explicit PageBufferPool(size_t buffer_size, bool huge_pages = false,
+                          size_t max_pooled = 0)
+      : buffer_size_(buffer_size),
+        mapped_size_(AlignUp(buffer_size == 0 ? 1 : buffer_size,
+                             huge_pages ? kHugePageSize
+                                        : size_t(::sysconf(_SC_PAGESIZE)))),
+        max_pooled_(max_pooled),
+        huge_pages_(huge_pages),
+        allocated_(0),
+        free_(),
+        mu_() {}
+
+  NVM_CONST_DELETE_COPY_AND_DEFAULT_MOVE(PageBufferPool)
+
+  ~PageBufferPool() { Clear(); }
+
+  size_t BufferSize() const { return buffer_size_; }
+
+  // bytes mapped per buffer, what the pool charges to MemoryCategory::CachePage
+  size_t MappedSize() const { return mapped_size_; }
+
+  bool IsHugePages() const { return huge_pages_; }
+
+  /**
+   * @brief A buffer of at least BufferSize() bytes, nullptr when mapping
+   * fails. Recycled buffers keep their previous content.
+   */
+  uint8_t* Acquire() {
+    {
+      absl::MutexLock lock(&mu_);
+      if (!free_.empty()) {
+        auto buffer = free_.back();
+        free_.pop_back();
+        return buffer;
+      }
+    }
+
+    auto buffer = Map();
+    if (!buffer) {
+      std::cerr << "PageBufferPool: failed to map " << mapped_size_ << " bytes"
+                << std::endl;
+      return nullptr;
+    }
+
+    absl::MutexLock lock(&mu_);
+    allocated_++;
+    return buffer;
+  }
+
+  void Release(uint8_t* buffer) {
+    if (!buffer) return;
+
+    {
+      absl::MutexLock lock(&mu_);
+      if (max_pooled_ == 0 || free_.size() < max_pooled_) {
+        free_.push_back(buffer);
+        return;
+      }
+
+      allocated_--;
+    }
+
+    Unmap(buffer);
+  }
+
+  void SetMaxPooled(size_t max_pooled) {
+    absl::MutexLock lock(&mu_);
+    max_pooled_ = max_pooled;
+  }
+
+  /**
+   * @brief Unmap idle buffers, buffers still acquired are not affected.
+   */
+  void Clear() {
+    absl::MutexLock lock(&mu_);
+    for (auto buffer : free_) {
+      Unmap(buffer);
+    }
+
+    allocated_ -= free_.size();
+    free_.clear();
+  }
+
+  // buffers mapped by this pool, idle or in use
+  size_t Allocated() {
+    absl::MutexLock lock(&mu_);
+    return allocated_;
+  }
+
+  size_t Pooled() {
+    absl::MutexLock lock(&mu_);
+    return free_.size();
+  }
+};
+
+}  // namespace memory
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
@@ -0,0 +1,276 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "mavix/v1/core/memory/memory_governor.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+namespace memory {
+
+/**
+ * @brief Size class pool behind AllocatorType::Pool.
+ *
+ * Requests are rounded up to a size class, four classes per power of two
+ * from 64 bytes to 32 MB, so the sizes the ingest cycles through (32 KB
+ * inflate chunks, 20 MB cache pages, typical blob sizes) land on a class of
+ * their own with at most 25% slack. Freed blocks go to a small cache of the
+ * freeing thread first and spill over to a shared depot, a block is only
+ * returned to malloc when both are full. Larger requests bypass the pool.
+ *
+ * The caller hands the requested size back on Deallocate(), as
+ * std::allocator does, so blocks carry no header.
+ *
+ * There is one depot per NUMA node. Threads pinned to a node announce it
+ * with SetThreadNode() and then recycle blocks within their node only,
+ * everything else shares the depot of node 0.
+ *
+ * Blocks held for reuse are charged to MemoryCategory::Pool, thread caches
+ * in steps of kChargeStep to keep shared atomics off the fast path. Under
+ * pressure the governor trims the depots through Trim(); thread caches are
+ * only given back when their thread exits.
+ */
+class PoolAllocator {
+ private:
+  static constexpr size_t kMinClassShift = 6;
+  static constexpr size_t kMaxClassShift = 25;
+  static constexpr size_t kClassesPerShift = 4;
+  static constexpr size_t kClassCount =
+      1 + (kMaxClassShift - kMinClassShift) * kClassesPerShift;
+
+  // bytes a thread keeps per class before spilling to the depot
+  static constexpr size_t kThreadCacheBytes = 4 * 1024 * 1024;
+  static constexpr size_t kMaxThreadCacheCount = 64;
+  // bytes the depot keeps per class before blocks go back to malloc
+  static constexpr size_t kDepotBytes = 64 * 1024 * 1024;
+  static constexpr size_t kMaxDepotCount = 1024;
+  static constexpr size_t kMaxNodes = 8;
+  static constexpr size_t kChargeStep = 1024 * 1024;
+
+  struct DepotClass {
+    absl::Mutex mu;
+    std::vector<void*> blocks;
+  };
+
+  struct Depot {
+    std::array<DepotClass, kClassCount> classes;
+  };
+
+  struct ThreadCache {
+    std::array<std::vector<void*>, kClassCount> classes;
+    // bytes in `classes` and the part of them charged to the governor
+    size_t held;
+    size_t charged;
+
+    ThreadCache() : classes(), held(0), charged(0) {}
+
+    ~ThreadCache() {
+      for (size_t index = 0; index < kClassCount; index++) {
+        for (auto block : classes[index]) Release(index, block);
+        classes[index].clear();
+      }
+
+      held = 0;
+      SyncCharge(*this);
+    }
+  };
+
+  static size_t& ThreadNode() {
+    thread_local size_t node = 0;
+    return node;
+  }
+
+  // never destroyed, threads may still free into them during static teardown
+  static std::array<Depot*, kMaxNodes>& GetDepots() {
+    static auto depots = [] {
+      auto all = new std::array<Depot*, kMaxNodes>();
+      for (auto& depot : *all) depot = new Depot();
+      return all;
+    }();
+
+    return *depots;
+  }
+
+  static Depot& GetDepot() { return *GetDepots()[ThreadNode()]; }
+
+  // charges what the cache holds once it drifted a step from the books
+  static void SyncCharge(ThreadCache& cache) {
+    auto& governor = MemoryGovernor::Global();
+    if (cache.held >= cache.charged + kChargeStep) {
+      governor.Charge(MemoryCategory::Pool, cache.held - cache.charged);
+      cache.charged = cache.held;
+    } else if (cache.held + kChargeStep <= cache.charged ||
+               (cache.held == 0 && cache.charged > 0)) {
+      governor.Release(MemoryCategory::Pool, cache.charged - cache.held);
+      cache.charged = cache.held;
+    }
+  }
+
+  // registered on the first block taken from the system, not from inside a
+  // pressure handler that frees pooled memory
+  static bool RegisterPressureHandler() {
+    MemoryGovernor::Global().AddPressureHandler(
+        MemoryCategory::Pool, [](size_t bytes) { return Trim(bytes); });
+    return true;
+  }
+
+  static ThreadCache& GetThreadCache() {
+    thread_local ThreadCache cache;
+    return cache;
+  }
+
+  static size_t ThreadCacheCount(size_t index) {
+    return std::clamp<size_t>(kThreadCacheBytes / ClassSize(index), 1,
+                              kMaxThreadCacheCount);
+  }
+
+  static size_t DepotCount(size_t index) {
+    return std::clamp<size_t>(kDepotBytes / ClassSize(index), 2,
+                              kMaxDepotCount);
+  }
+
+  static size_t HighestBit(size_t value) {
+    size_t shift = 0;
+    while (value >>= 1) shift++;
+    return shift;
+  }
+
+  static void* Acquire(size_t index) {
+    auto& depot_class = GetDepot().classes[index];
+    {
+      absl::MutexLock lock(&depot_class.mu);
+      if (!depot_class.blocks.empty()) {
+        auto block = depot_class.blocks.back();
+        depot_class.blocks.pop_back();
+        MemoryGovernor::Global().Release(MemoryCategory::Pool,
+                                         ClassSize(index));
+        return block;
+      }
+    }
+
+    static const bool registered = RegisterPressureHandler();
+    (void)registered;
+
+    return std::malloc(ClassSize(index));
+  }
+
+  static void Release(size_t index, void* block) {
+    auto& depot_class = GetDepot().classes[index];
+    {
+      absl::MutexLock lock(&depot_class.mu);
+      if (depot_class.blocks.size() < DepotCount(index)) {
+        depot_class.blocks.push_back(block);
+        MemoryGovernor::Global().Charge(MemoryCategory::Pool,
+                                        ClassSize(index));
+        return;
+      }
+    }
+
+    std::free(block);
+  }
+
+ public:
+  static constexpr size_t kMaxPooledSize = size_t(1) << kMaxClassShift;
+
+  /**
+   * @brief Recycle blocks of the calling thread through the depot of
+   * `node`, nodes past the supported count share the last depot.
+   */
+  static void SetThreadNode(size_t node) {
+    ThreadNode() = node < kMaxNodes ? node : kMaxNodes - 1;
+  }
+
+  /**
+   * @brief Class index for `size`, only valid up to kMaxPooledSize.
+   */
+  static size_t ClassIndex(size_t size) {
+    if (size <= (size_t(1) << kMinClassShift)) return 0;
+
+    auto value = size - 1;
+    auto shift = HighestBit(value);
+    auto step = (value >> (shift - 2)) & (kClassesPerShift - 1);
+    return 1 + (shift - kMinClassShift) * kClassesPerShift + step;
+  }
+
+  static size_t ClassSize(size_t index) {
+    if (index == 0) return size_t(1) << kMinClassShift;
+
+    auto shift = kMinClassShift + (index - 1) / kClassesPerShift;
+    auto step = (index - 1) % kClassesPerShift + 1;
+    return (size_t(1) << shift) + step * (size_t(1) << (shift - 2));
+  }
+
+  /**
+   * @brief Give at least `bytes` held in the depots of every node back to
+   * malloc, largest classes first. Returns the bytes freed.
+   */
+  static size_t Trim(size_t bytes) {
+    size_t freed = 0;
+
+    for (size_t index = kClassCount; index-- > 0 && freed < bytes;) {
+      for (auto depot : GetDepots()) {
+        auto& depot_class = depot->classes[index];
+        absl::MutexLock lock(&depot_class.mu);
+        while (!depot_class.blocks.empty() && freed < bytes) {
+          std::free(depot_class.blocks.back());
+          depot_class.blocks.pop_back();
+          freed += ClassSize(index);
+        }
+      }
+    }
+
+    MemoryGovernor::Global().Release(MemoryCategory::Pool, freed);
+    return freed;
+  }
+
+  static void* Allocate(size_t size) {
+    if (size > kMaxPooledSize) return std::malloc(size);
+
+    auto index = ClassIndex(size);
+    auto& cache = GetThreadCache();
+    auto& cached = cache.classes[index];
+    if (!cached.empty()) {
+      auto block = cached.back();
+      cached.pop_back();
+      cache.held -= ClassSize(index);
+      SyncCharge(cache);
+      return block;
+    }
+
+    return Acquire(index);
+  }
+
+  static void Deallocate(void* block, size_t size) {
+    if (!block) return;
+
+    if (size > kMaxPooledSize) {
+      std::free(block);
+      return;
+    }
+
+    auto index = ClassIndex(size);
+    auto& cache = GetThreadCache();
+    auto& cached = cache.classes[index];
+    if (cached.size() < ThreadCacheCount(index)) {
+      if (cached.capacity() == 0) cached.reserve(ThreadCacheCount(index));
+      cached.push_back(block);
+      cache.held += ClassSize(index);
+      SyncCharge(cache);
+      return;
+    }
+
+    Release(index, block);
+  }
+};
+
+}  // namespace memory
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
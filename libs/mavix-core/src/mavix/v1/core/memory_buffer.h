@@ -7,6 +7,7 @@
 
 #include "mavix/v1/core/core.h"
 #include "mavix/v1/core/icache_bucket.h"
+#include "mavix/v1/core/memory/memory_governor.h"
 
 namespace mavix {
 namespace v1 {
@@ -15,6 +16,7 @@ namespace core {
 class MemoryBuffer : public ICacheBucketBuffer {
  private:
   size_t size_;
+  memory::MemoryCategory category_;
   memory::MemoryAllocator<uint8_t> buffer_;
   uint8_t* begin_;
   uint8_t* end_;
@@ -35,6 +37,7 @@ class MemoryBuffer : public ICacheBucketBuffer {
 
     if (!data_) return;
 
+    memory::MemoryGovernor::Global().Charge(category_, size_);
     is_allocated_ = true;
     begin_ = data_;
     end_ = data_ + size_;
@@ -48,6 +51,7 @@ class MemoryBuffer : public ICacheBucketBuffer {
  public:
   explicit MemoryBuffer()
       : size_(0),
+        category_(memory::MemoryCategory::General),
         begin_(nullptr),
         end_(nullptr),
         data_(nullptr),
@@ -57,8 +61,14 @@ class MemoryBuffer : public ICacheBucketBuffer {
     Initialize();
   }
 
-  explicit MemoryBuffer(size_t buffer_size)
+  /**
+   * @brief The allocation is charged to `category` of the global
+   * MemoryGovernor until Destroy().
+   */
+  explicit MemoryBuffer(size_t buffer_size, memory::MemoryCategory category =
+                                                memory::MemoryCategory::General)
       : size_(buffer_size),
+        category_(category),
         begin_(nullptr),
         end_(nullptr),
         data_(nullptr),
@@ -75,10 +85,13 @@ class MemoryBuffer : public ICacheBucketBuffer {
     return buffer_.AllocatorType();
   }
 
+  memory::MemoryCategory Category() const { return category_; }
+
   void Destroy() {
     if (!is_allocated_) return;
 
     buffer_.deallocate(data_, size_);
+    memory::MemoryGovernor::Global().Release(category_, size_);
     is_allocated_ = false;
     data_ = nullptr;
     begin_ = nullptr;
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "mavix/v1/core/icache_bucket.h"
+#include "mavix/v1/core/stream_base.h"
+#include "nvm/macro.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief Read-only stream that maps the whole file into the address space.
+ *
+ * Data(pos, size) hands out pointers straight into the mapping, so callers
+ * can consume file data without any intermediate copy. Consumed ranges can
+ * be given back to the kernel with Release() to keep the resident set small.
+ */
+class MemoryMappedStream : public StreamBase, public ICacheBucketBuffer {
+ private:
+  int fd_;
+  uint8_t* mapped_;
+  std::streamsize size_;
+  std::streampos position_;
+  std::string file_;
+  size_t os_page_size_;
+
+  std::pair<uint8_t*, size_t> AlignToOsPage(const std::streampos& pos,
+                                            const size_t& size) const {
+    auto start = static_cast<size_t>(pos);
+    auto aligned_start = start - (start % os_page_size_);
+    auto end = std::min(start + size, static_cast<size_t>(size_));
+    return {mapped_ + aligned_start, end - aligned_start};
+  }
+
+ public:
+  explicit MemoryMappedStream(const std::string& file)
+      : StreamBase(file),
+        fd_(-1),
+        mapped_(nullptr),
+        size_(std::streamsize()),
+        position_(std::streampos(0)),
+        file_(std::string(file)),
+        os_page_size_(static_cast<size_t>(::sysconf(_SC_PAGESIZE))) {}
+
+  ~MemoryMappedStream() {
+    if (IsOpen()) Close();
+  }
+
+  StreamState Open() override {
+    if (fd_ >= 0) return StreamState::AlreadyOpen;
+
+    fd_ = ::open(file_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+      auto err = errno;
+      std::cerr << "Failed to open file: " << file_ << std::endl;
+      size_ = std::streamsize(-1);
+      if (err == ENOENT) return StreamState::FileNotExist;
+      if (err == EACCES) return StreamState::PermissionFailed;
+      return StreamState::Error;
+    }
+
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+      ::close(fd_);
+      fd_ = -1;
+      size_ = std::streamsize(-1);
+      return StreamState::Error;
+    }
+
+    size_ = std::streamsize(st.st_size);
+    position_ = std::streampos(0);
+
+    // mmap refuses zero length, an empty file is a valid empty stream
+    if (size_ == 0) return StreamState::Ok;
+
+    void* addr = ::mmap(nullptr, static_cast<size_t>(size_), PROT_READ,
+                        MAP_PRIVATE, fd_, 0);
+    if (addr == MAP_FAILED) {
+      std::cerr << "Failed to map file: " << file_ << " ("
+                << std::strerror(errno) << ")" << std::endl;
+      ::close(fd_);
+      fd_ = -1;
+      size_ = std::streamsize(-1);
+      return StreamState::Error;
+    }
+
+    mapped_ = static_cast<uint8_t*>(addr);
+    ::madvise(mapped_, static_cast<size_t>(size_), MADV_SEQUENTIAL);
+
+#if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_STREAM)
+    std::cout << "Mapped stream [" << file_ << "]: " << size_ << std::endl;
+#endif
+
+    return StreamState::Ok;
+  }
+
+  StreamState Close() override {
+    if (fd_ < 0) return StreamState::Error;
+
+    auto state = StreamState::Ok;
+    if (mapped_ && ::munmap(mapped_, static_cast<size_t>(size_)) != 0) {
+      state = StreamState::Error;
+    }
+
+    if (::close(fd_) != 0) state = StreamState::Error;
+
+    fd_ = -1;
+    mapped_ = nullptr;
+    position_ = std::streampos(0);
+
+    return state;
+  }
+
+  const std::string& File() const override { return file_; }
+
+  std::streampos CurrentPosition() override {
+    if (!IsOpen()) return std::streampos(-1);
+    return position_;
+  }
+
+  /**
+   * @brief Pointer into the mapping, nullptr when the range is out of bound.
+   * The pointer stays valid until Close().
+   */
+  uint8_t* Data(const std::streampos& pos, const size_t& size) {
+    if (!mapped_ || pos < 0 || IsOutOfBound(pos, size)) return nullptr;
+    return mapped_ + static_cast<size_t>(pos);
+  }
+
+  bool CopyToPointer(uint8_t* dest, std::streampos pos, size_t size) override {
+    if (!dest || size == 0) return false;
+
+    auto src = Data(pos, size);
+    if (!src) return false;
+
+    std::memcpy(dest, src, size);
+    return true;
+  }
+
+  /**
+   * @brief Hint the kernel that the range will be read soon.
+   */
+  bool Prefetch(const std::streampos& pos, const size_t& size) {
+    if (!Data(pos, size)) return false;
+
+    auto range = AlignToOsPage(pos, size);
+    return ::madvise(range.first, range.second, MADV_WILLNEED) == 0;
+  }
+
+  /**
+   * @brief Drop the resident pages of the range. The mapping stays valid,
+   * the next access faults the data back in from the page cache.
+   */
+  bool Release(const std::streampos& pos, const size_t& size) {
+    if (!Data(pos, size)) return false;
+
+    auto range = AlignToOsPage(pos, size);
+    return ::madvise(range.first, range.second, MADV_DONTNEED) == 0;
+  }
+
+  std::streampos MoveTo(std::streampos pos) override {
+    if (!IsOpen()) return std::streampos(-1);
+    if (pos >= size_ || pos < 0) return std::streampos(-1);
+
+    position_ = pos;
+    return pos;
+  }
+
+  std::streampos Next(std::streamsize size) override {
+    if (!IsOpen()) return std::streampos(-1);
+
+    auto newPos = position_ + size;
+    if (newPos >= size_) return std::streampos(-1);
+
+    position_ = newPos;
+    return newPos;
+  }
+
+  std::streampos Prev(std::streamsize size) override {
+    if (!IsOpen()) return std::streampos(-1);
+
+    auto newPos = position_ - size;
+    if (newPos < 0) return std::streampos(-1);
+
+    position_ = newPos;
+    return newPos;
+  }
+
+  std::streampos Next() override { return Next(1); }
+
+  std::streampos Prev() override { return Prev(1); }
+
+  bool IsOutOfBound(const std::streampos& pos, const size_t& size) const {
+    return (pos + static_cast<std::streampos>(size) > size_) ? true : false;
+  }
+
+  bool IsOpen() const override { return fd_ >= 0; }
+
+  bool IsEof() const override { return IsOpen() && position_ >= size_; }
+
+  bool IsGood() const override { return IsOpen(); }
+
+  std::streamsize Size() const override { return size_; }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
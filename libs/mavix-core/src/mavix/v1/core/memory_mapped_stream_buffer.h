@@ -0,0 +1,206 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "absl/container/node_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "mavix/v1/core/aflag_once.h"
+#include "mavix/v1/core/memory_mapped_stream.h"
+#include "mavix/v1/core/page_locator.h"
+#include "mavix/v1/core/stream_buffer.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief IMemoryBufferAdapter over a memory mapped file.
+ *
+ * Every range resolves to a pointer into the mapping, cross-page ranges
+ * included, so no page is ever materialized or copied. Pages are only used
+ * as release granularity: RemoveBufferPage() drops the resident pages of a
+ * consumed range to keep RSS bounded on large files.
+ */
+class MemoryMappedStreamBuffer : public StreamBufferBase {
+ private:
+  AFlagOnce isRun_;
+  std::shared_ptr<MemoryMappedStream> stream_;
+  size_t cache_size_page_;
+  std::string filename_;
+  PageLocator buffer_locator_;
+  absl::Mutex mu_;
+
+ public:
+  explicit MemoryMappedStreamBuffer(
+      const std::string& filename,
+      const size_t& cache_size_page = 1024 * 1024 * 20)
+      : StreamBufferBase(filename),
+        isRun_(AFlagOnce()),
+        stream_(std::make_shared<MemoryMappedStream>(filename)),
+        cache_size_page_(size_t(cache_size_page)),
+        filename_(std::string(filename)),
+        buffer_locator_(PageLocator()){};
+
+  ~MemoryMappedStreamBuffer(){};
+
+  const std::string& File() const override { return filename_; }
+
+  bool IsOpen() const override { return stream_->IsOpen(); }
+
+  bool IsGood() const override { return stream_->IsGood(); }
+
+  bool IsEof() const override { return stream_->IsEof(); }
+
+  std::streamsize Size() const override { return stream_->Size(); }
+
+  size_t CacheSize() const override { return cache_size_page_; }
+
+  std::shared_ptr<PageLocatorInfo> TryConsume(std::streampos pos,
+                                              std::streamsize size) override {
+    return buffer_locator_.GetPageRange(pos, size, cache_size_page_,
+                                        stream_->Size());
+  }
+
+  uint8_t* GetAsInlinePointer(std::streampos pos, std::streamsize size,
+                              PageLocatorInfo& resolve_result,
+                              bool prepend = true) override {
+    auto locator = TryConsume(pos, size);
+
+    if (!locator || !locator->state) {
+      resolve_result = PageLocatorInfo();
+      return nullptr;
+    }
+
+    resolve_result.Clone(*locator);
+    return stream_->Data(pos, size);
+  }
+
+  std::vector<BufferPointer> GetAsPointer(
+      std::streampos pos, std::streamsize size,
+      PageLocatorInfo& resolve_result) override {
+    auto pointers = std::vector<BufferPointer>();
+    auto ptr = GetAsInlinePointer(pos, size, resolve_result);
+    if (!ptr) return pointers;
+
+    pointers.push_back(BufferPointer{
+        ptr, static_cast<size_t>(size), true,
+        resolve_result.type == PageLocatorResolvement::CrossPage});
+
+    return pointers;
+  }
+
+  std::shared_ptr<MemoryBuffer> GetAsCopy(
+      std::streampos pos, std::streamsize size,
+      PageLocatorInfo& resolve_result) override {
+    auto ptr = GetAsInlinePointer(pos, size, resolve_result);
+    if (!ptr) return nullptr;
+
+    auto buffer = std::make_shared<MemoryBuffer>(size);
+    buffer->CopyFrom(ptr, size);
+
+    return buffer;
+  }
+
+  absl::node_hash_map<uint64_t, BufferPage> GetRequiredBufferPages() override {
+    return buffer_locator_.GetRequiredPages(cache_size_page_, stream_->Size());
+  }
+
+  bool MarkConsume(std::streampos pos, std::streamsize size) override {
+    return true;
+  }
+
+  size_t RemoveBufferPage(std::streampos pos, std::streamsize size) override {
+    auto locator = TryConsume(pos, size);
+    if (!locator || !locator->state) return 0;
+    if (locator->type == PageLocatorResolvement::StartPageResolve) return 0;
+
+    return RemovePageRange(locator->start_page_id, locator->end_page_id);
+  }
+
+  size_t RemoveBufferPage(uint64_t buffer_page_id) override {
+    return RemovePageRange(buffer_page_id, buffer_page_id);
+  }
+
+  bool PrefetchBufferPage(uint64_t buffer_page_id) override {
+    if (buffer_page_id == 0) return false;
+
+    auto start = std::streamsize((buffer_page_id - 1) * cache_size_page_);
+    auto end = std::min(std::streamsize(buffer_page_id * cache_size_page_),
+                        stream_->Size());
+    if (start >= end) return false;
+
+    return stream_->Prefetch(std::streampos(start), size_t(end - start));
+  }
+
+  // the mapping is never evicted, the kernel pages it back in on demand
+  bool PinBufferPage(uint64_t buffer_page_id) override {
+    return buffer_page_id > 0;
+  }
+
+  void UnpinBufferPage(uint64_t buffer_page_id) override {}
+
+  StreamState Open() override {
+    absl::MutexLock lock(&mu_);
+    if (isRun_.State()) return StreamState::AlreadyOpen;
+
+    auto state = stream_->Open();
+    if (state == StreamState::Ok) isRun_.Signal();
+
+    return state;
+  }
+
+  StreamState Close() override {
+    absl::MutexLock lock(&mu_);
+    if (!isRun_.State()) return StreamState::Stoped;
+
+    isRun_.Reset();
+    return stream_->Close();
+  }
+
+  std::streampos MoveTo(std::streampos pos) override {
+    return std::streampos(-1);
+  }
+
+  std::streampos CurrentPosition() override { return std::streampos(-1); };
+
+  std::streampos Next(std::streamsize size) override {
+    return std::streampos(-1);
+  };
+
+  std::streampos Prev(std::streamsize size) override {
+    return std::streampos(-1);
+  };
+
+  std::streampos Next() override { return Next(1); };
+
+  std::streampos Prev() override { return Prev(1); };
+
+ private:
+  size_t RemovePageRange(uint64_t start_page_id, uint64_t end_page_id) {
+    if (start_page_id == 0 || end_page_id < start_page_id) return 0;
+
+    auto stream_size = stream_->Size();
+    auto start = std::streamsize((start_page_id - 1) * cache_size_page_);
+    auto end = std::min(std::streamsize(end_page_id * cache_size_page_),
+                        stream_size);
+    if (start >= end) return 0;
+
+    if (!stream_->Release(std::streampos(start), size_t(end - start))) {
+      return 0;
+    }
+
+#if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_STREAM_BUFFER)
+    std::cout << "Released mapped page [" << start_page_id << "-"
+              << end_page_id << "]" << std::endl;
+#endif
+
+    return (end_page_id - start_page_id) + 1;
+  }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
@@ -0,0 +1,150 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief NUMA nodes of the host and the CPUs that belong to them, read from
+ * /sys/devices/system/node.
+ *
+ * Hosts without NUMA information (or non-Linux sysfs layouts) come out as a
+ * single node holding every CPU, so callers do not need a separate code
+ * path. Nothing is bound here, the owner decides where threads run; memory
+ * follows through first touch once a thread is pinned.
+ */
+class NumaTopology {
+ private:
+  std::vector<std::vector<int>> node_cpus_;
+  std::vector<int> cpu_nodes_;
+
+  // "0-3,8-11" style lists as used by cpulist and online
+  static std::vector<int> ParseList(const std::string& list) {
+    std::vector<int> values;
+    std::stringstream stream(list);
+    std::string range;
+
+    while (std::getline(stream, range, ',')) {
+      if (range.empty()) continue;
+
+      auto dash = range.find('-');
+      try {
+        auto first = std::stoi(range.substr(0, dash));
+        auto last = dash == std::string::npos
+                        ? first
+                        : std::stoi(range.substr(dash + 1));
+        for (auto value = first; value <= last; value++) {
+          values.push_back(value);
+        }
+      } catch (...) {
+        return std::vector<int>();
+      }
+    }
+
+    return values;
+  }
+
+  static std::string ReadLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    if (file.is_open()) std::getline(file, line);
+    return line;
+  }
+
+  void AddCpu(size_t node, int cpu) {
+    node_cpus_[node].push_back(cpu);
+    if (cpu_nodes_.size() <= size_t(cpu)) cpu_nodes_.resize(cpu + 1, -1);
+    cpu_nodes_[cpu] = static_cast<int>(node);
+  }
+
+  void DetectSingleNode() {
+    node_cpus_.assign(1, std::vector<int>());
+    cpu_nodes_.clear();
+
+    auto cpus = std::thread::hardware_concurrency();
+    for (unsigned cpu = 0; cpu < (cpus == 0 ? 1 : cpus); cpu++) {
+      AddCpu(0, static_cast<int>(cpu));
+    }
+  }
+
+ public:
+  NumaTopology() : node_cpus_(), cpu_nodes_() { DetectSingleNode(); }
+
+  ~NumaTopology() {}
+
+  /**
+   * @brief Read the topology of this host, nodes without CPUs (memory only
+   * nodes) are left out.
+   */
+  static NumaTopology Detect() {
+    NumaTopology topology;
+
+    auto online = ParseList(ReadLine("/sys/devices/system/node/online"));
+    if (online.empty()) return topology;
+
+    topology.node_cpus_.clear();
+    topology.cpu_nodes_.clear();
+
+    for (auto node : online) {
+      auto cpus = ParseList(ReadLine("/sys/devices/system/node/node" +
+                                     std::to_string(node) + "/cpulist"));
+      if (cpus.empty()) continue;
+
+      topology.node_cpus_.emplace_back();
+      for (auto cpu : cpus) {
+        topology.AddCpu(topology.node_cpus_.size() - 1, cpu);
+      }
+    }
+
+    if (topology.node_cpus_.empty()) topology.DetectSingleNode();
+    return topology;
+  }
+
+  size_t NodeCount() const { return node_cpus_.size(); }
+
+  bool IsNuma() const { return node_cpus_.size() > 1; }
+
+  const std::vector<int>& Cpus(size_t node) const { return node_cpus_[node]; }
+
+  // node index of `cpu`, 0 when unknown
+  size_t NodeOfCpu(int cpu) const {
+    if (cpu < 0 || size_t(cpu) >= cpu_nodes_.size() || cpu_nodes_[cpu] < 0) {
+      return 0;
+    }
+
+    return static_cast<size_t>(cpu_nodes_[cpu]);
+  }
+
+  // node the calling thread runs on right now
+  size_t CurrentNode() const { return NodeOfCpu(::sched_getcpu()); }
+
+  /**
+   * @brief Restrict the calling thread to `cpus`. False when the kernel
+   * refuses, the thread keeps its previous affinity then.
+   */
+  static bool PinCurrentThread(const std::vector<int>& cpus) {
+    if (cpus.empty()) return false;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+    }
+
+    return ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set) == 0;
+  }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief Asynchronous read-ahead for sequential page consumers.
+ *
+ * Each time the consumer moves into a new page, the next `window` pages are
+ * queued and materialized on dedicated I/O threads through the supplied
+ * prefetch callback, so the consumer and the disk overlap instead of taking
+ * turns. A window of 1 is plain double buffering.
+ *
+ * Consumers walking separate ranges of the file concurrently each get their
+ * own cursor through SetCursors(), a page advances the cursor of the range
+ * it falls in.
+ */
+class PageReadAhead {
+ private:
+  struct Cursor {
+    uint64_t first_page;
+    uint64_t current_page;
+    uint64_t next_page;
+  };
+
+  std::function<bool(uint64_t)> prefetch_;
+  size_t window_;
+  uint16_t io_thread_num_;
+  uint64_t total_pages_;
+  std::vector<Cursor> cursors_;
+  std::atomic<bool> is_run_;
+  std::deque<uint64_t> pending_;
+  std::vector<std::thread> io_workers_;
+  absl::Mutex mu_;
+  absl::CondVar cv_pending_;
+
+  // cursors_ is sorted by first page and always starts with the page 0 one
+  Cursor& CursorOf(uint64_t page_id) {
+    auto it = std::upper_bound(
+        cursors_.begin(), cursors_.end(), page_id,
+        [](uint64_t id, const Cursor& c) { return id < c.first_page; });
+    return *(it - 1);
+  }
+
+  void ResetCursors(std::vector<uint64_t> first_pages) {
+    std::sort(first_pages.begin(), first_pages.end());
+
+    cursors_.clear();
+    cursors_.push_back({0, 0, 1});
+    for (auto page_id : first_pages) {
+      if (page_id <= 1 || page_id == cursors_.back().first_page) continue;
+      cursors_.push_back({page_id, page_id - 1, page_id});
+    }
+  }
+
+  void ProcessReadAhead() {
+    while (true) {
+      uint64_t page_id = 0;
+      {
+        absl::MutexLock lock(&mu_);
+        while (pending_.empty() && is_run_) {
+          cv_pending_.Wait(&mu_);
+        }
+
+        if (!is_run_) break;
+
+        page_id = pending_.front();
+        pending_.pop_front();
+
+        // consumer already passed this page, loading it now is wasted I/O
+        if (page_id < CursorOf(page_id).current_page) continue;
+      }
+
+      prefetch_(page_id);
+    }
+  }
+
+ public:
+  explicit PageReadAhead(std::function<bool(uint64_t)> prefetch,
+                         size_t window = 1,
+                         uint16_t io_thread_num = 1)
+      : prefetch_(prefetch),
+        window_(window),
+        io_thread_num_(io_thread_num == 0 ? 1 : io_thread_num),
+        total_pages_(0),
+        cursors_(),
+        is_run_(false),
+        pending_(),
+        io_workers_(),
+        mu_(),
+        cv_pending_() {}
+
+  ~PageReadAhead() { Stop(); }
+
+  size_t Window() const { return window_; }
+
+  uint16_t IoThreads() const { return io_thread_num_; }
+
+  bool IsEnabled() const { return window_ > 0; }
+
+  /**
+   * @brief Change the window and I/O thread count, only while stopped.
+   * Window 0 disables read-ahead.
+   */
+  bool Configure(size_t window, uint16_t io_thread_num = 1) {
+    absl::MutexLock lock(&mu_);
+    if (is_run_) return false;
+
+    window_ = window;
+    io_thread_num_ = io_thread_num == 0 ? 1 : io_thread_num;
+    return true;
+  }
+
+  void Start(uint64_t total_pages) {
+    absl::MutexLock lock(&mu_);
+    if (is_run_ || window_ == 0) return;
+
+    is_run_ = true;
+    total_pages_ = total_pages;
+    ResetCursors({});
+    pending_.clear();
+
+    for (uint16_t i = 0; i < io_thread_num_; i++) {
+      io_workers_.emplace_back(
+          std::thread(&PageReadAhead::ProcessReadAhead, this));
+    }
+  }
+
+  void Stop() {
+    {
+      absl::MutexLock lock(&mu_);
+      if (!is_run_) return;
+
+      is_run_ = false;
+      pending_.clear();
+      cv_pending_.SignalAll();
+    }
+
+    for (auto& t : io_workers_) {
+      if (t.joinable()) t.join();
+    }
+
+    io_workers_.clear();
+  }
+
+  /**
+   * @brief One cursor per consumer range, given by the first page of each.
+   * An empty list goes back to the single cursor Start() begins with.
+   */
+  void SetCursors(std::vector<uint64_t> first_pages) {
+    absl::MutexLock lock(&mu_);
+    ResetCursors(std::move(first_pages));
+    pending_.clear();
+  }
+
+  /**
+   * @brief Notify the consumer entered `page_id`, queue the pages behind it.
+   * Cheap when the page did not change, safe to call on every access. Takes
+   * no lock at all while read-ahead is stopped or disabled.
+   */
+  void Advance(uint64_t page_id) {
+    if (!is_run_.load(std::memory_order_acquire)) return;
+
+    absl::MutexLock lock(&mu_);
+    if (!is_run_) return;
+
+    auto& cursor = CursorOf(page_id);
+    if (page_id <= cursor.current_page) return;
+
+    cursor.current_page = page_id;
+
+    // stop at the first page of the next range, its own consumer reads on
+    auto limit = total_pages_;
+    if (&cursor != &cursors_.back()) {
+      limit = std::min(limit, (&cursor + 1)->first_page);
+    }
+
+    auto first = std::max(page_id + 1, cursor.next_page);
+    auto last = std::min(page_id + window_, limit);
+    if (first > last) return;
+
+    for (auto i = first; i <= last; i++) {
+      pending_.push_back(i);
+    }
+
+    cursor.next_page = last + 1;
+    cv_pending_.SignalAll();
+  }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
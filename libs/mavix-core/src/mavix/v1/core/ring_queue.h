@@ -0,0 +1,415 @@
+#pragma once
+
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+#include <mavix/v1/core/core.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+// keeps producer and consumer indexes off each other's cache line
+static constexpr size_t kRingCacheLine = 64;
+
+/**
+ * @brief Parking spot for threads waiting on a ring queue.
+ *
+ * Notify() is one atomic load while nobody waits, the mutex is only taken
+ * to wake a thread that is really asleep. A waiter registers itself before
+ * its last check of the queue and a notifier reads the waiter count after
+ * publishing, so one of the two always sees the other.
+ */
+class RingWaiter {
+ private:
+  absl::Mutex mu_;
+  absl::CondVar cv_;
+  std::atomic<uint32_t> waiters_;
+
+ public:
+  RingWaiter() : mu_(), cv_(), waiters_(0) {}
+
+  ~RingWaiter() {}
+
+  RingWaiter(const RingWaiter &) = delete;
+  RingWaiter &operator=(const RingWaiter &) = delete;
+
+  void Notify() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) return;
+
+    absl::MutexLock lock(&mu_);
+    cv_.SignalAll();
+  }
+
+  // wakes a single waiter, for waiters that all wait for the same thing
+  void NotifyOne() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters_.load(std::memory_order_relaxed) == 0) return;
+
+    absl::MutexLock lock(&mu_);
+    cv_.Signal();
+  }
+
+  /**
+   * @brief Block until `ready()` returns true or `timeout` passes. Returns
+   * the last `ready()`.
+   */
+  template <typename TReady>
+  bool Wait(TReady &&ready, absl::Duration timeout = absl::InfiniteDuration()) {
+    if (ready()) return true;
+
+    auto deadline = absl::Now() + timeout;
+    absl::MutexLock lock(&mu_);
+    waiters_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    auto is_ready = ready();
+    while (!is_ready) {
+      auto timed_out = cv_.WaitWithDeadline(&mu_, deadline);
+      is_ready = ready();
+      if (timed_out) break;
+    }
+
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return is_ready;
+  }
+};
+
+/**
+ * @brief Lock-free bounded ring for one producer and one consumer thread.
+ *
+ * Capacity is rounded up to a power of two. The Try* calls never block;
+ * Enqueue()/Dequeue() park the calling thread while the ring is full or
+ * empty, until Close() releases them.
+ */
+template <typename T>
+class SpscRingQueue {
+ private:
+  size_t capacity_;
+  size_t mask_;
+  std::unique_ptr<typename std::aligned_storage<sizeof(T), alignof(T)>::type[]>
+      slots_;
+
+  // each side's line holds its index and its copy of the other side's
+  alignas(kRingCacheLine) std::atomic<size_t> head_;
+  // consumer copy of tail_, refreshed only when the ring looks empty
+  size_t tail_cache_;
+  alignas(kRingCacheLine) std::atomic<size_t> tail_;
+  // producer copy of head_, refreshed only when the ring looks full
+  size_t head_cache_;
+  alignas(kRingCacheLine) std::atomic<bool> closed_;
+
+  RingWaiter not_empty_;
+  RingWaiter not_full_;
+
+  T *Slot(size_t position) {
+    return reinterpret_cast<T *>(&slots_[position & mask_]);
+  }
+
+  static size_t RoundUp(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    return size;
+  }
+
+  bool Push(T &&value) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ >= capacity_) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ >= capacity_) return false;
+    }
+
+    new (Slot(tail)) T(std::move(value));
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool Pop(T &value) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) return false;
+    }
+
+    auto slot = Slot(head);
+    value = std::move(*slot);
+    slot->~T();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+ public:
+  explicit SpscRingQueue(size_t capacity)
+      : capacity_(RoundUp(capacity)),
+        mask_(capacity_ - 1),
+        slots_(new typename std::aligned_storage<sizeof(T), alignof(T)>::type
+                   [capacity_]),
+        head_(0),
+        tail_cache_(0),
+        tail_(0),
+        head_cache_(0),
+        closed_(false),
+        not_empty_(),
+        not_full_() {}
+
+  ~SpscRingQueue() { Clear(); }
+
+  SpscRingQueue(const SpscRingQueue &) = delete;
+  SpscRingQueue &operator=(const SpscRingQueue &) = delete;
+
+  size_t Capacity() const { return capacity_; }
+
+  bool TryEnqueue(T &&value) {
+    if (!Push(std::move(value))) return false;
+
+    not_empty_.Notify();
+    return true;
+  }
+
+  bool TryDequeue(T &value) {
+    if (!Pop(value)) return false;
+
+    not_full_.Notify();
+    return true;
+  }
+
+  // false once closed, `value` is left untouched then
+  bool Enqueue(T &&value) {
+    bool ok = false;
+    // the other side is notified outside the waiter's lock
+    not_full_.Wait([&]() {
+      if (closed_.load(std::memory_order_acquire)) return true;
+      ok = Push(std::move(value));
+      return ok;
+    });
+
+    if (ok) not_empty_.Notify();
+    return ok;
+  }
+
+  // false once closed, even with items left for Clear()
+  bool Dequeue(T &value, absl::Duration timeout = absl::InfiniteDuration()) {
+    bool ok = false;
+    not_empty_.Wait(
+        [&]() {
+          if (closed_.load(std::memory_order_acquire)) return true;
+          ok = Pop(value);
+          return ok;
+        },
+        timeout);
+
+    if (ok) not_full_.Notify();
+    return ok;
+  }
+
+  // wake every blocked thread, Enqueue()/Dequeue() fail from here on
+  void Close() {
+    closed_.store(true, std::memory_order_release);
+    not_empty_.Notify();
+    not_full_.Notify();
+  }
+
+  bool IsClosed() const { return closed_.load(std::memory_order_acquire); }
+
+  // consumer side only
+  void Clear() {
+    T value;
+    while (TryDequeue(value)) {
+    }
+  }
+
+  bool Empty() const { return Size() == 0; }
+
+  // exact only while neither side is running
+  size_t Size() const {
+    auto head = head_.load(std::memory_order_acquire);
+    auto tail = tail_.load(std::memory_order_acquire);
+    return tail - head;
+  }
+};
+
+/**
+ * @brief Lock-free bounded ring for any number of producer and consumer
+ * threads, after Dmitry Vyukov's bounded MPMC queue.
+ *
+ * Every slot carries a sequence number telling whether it is free for the
+ * producer or filled for the consumer of a given lap, so threads only race
+ * on a compare-and-swap of the head or tail and never on a lock. Capacity
+ * is rounded up to a power of two. Blocking works as in SpscRingQueue.
+ */
+template <typename T>
+class MpmcRingQueue {
+ private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+    T *Value() { return reinterpret_cast<T *>(&storage); }
+  };
+
+  size_t capacity_;
+  size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+
+  alignas(kRingCacheLine) std::atomic<size_t> head_;
+  alignas(kRingCacheLine) std::atomic<size_t> tail_;
+  alignas(kRingCacheLine) std::atomic<bool> closed_;
+
+  RingWaiter not_empty_;
+  RingWaiter not_full_;
+
+  static size_t RoundUp(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity) size <<= 1;
+    return size;
+  }
+
+  bool Push(T &&value) {
+    auto tail = tail_.load(std::memory_order_relaxed);
+
+    while (true) {
+      auto &slot = slots_[tail & mask_];
+      auto sequence = slot.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(tail);
+
+      if (diff == 0) {
+        if (tail_.compare_exchange_weak(tail, tail + 1,
+                                        std::memory_order_relaxed)) {
+          new (slot.Value()) T(std::move(value));
+          slot.sequence.store(tail + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        // the consumer of the previous lap has not freed the slot yet
+        return false;
+      } else {
+        tail = tail_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool Pop(T &value) {
+    auto head = head_.load(std::memory_order_relaxed);
+
+    while (true) {
+      auto &slot = slots_[head & mask_];
+      auto sequence = slot.sequence.load(std::memory_order_acquire);
+      auto diff =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(head + 1);
+
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(head, head + 1,
+                                        std::memory_order_relaxed)) {
+          value = std::move(*slot.Value());
+          slot.Value()->~T();
+          slot.sequence.store(head + capacity_, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false;
+      } else {
+        head = head_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+ public:
+  explicit MpmcRingQueue(size_t capacity)
+      : capacity_(RoundUp(capacity)),
+        mask_(capacity_ - 1),
+        slots_(new Slot[capacity_]),
+        head_(0),
+        tail_(0),
+        closed_(false),
+        not_empty_(),
+        not_full_() {
+    for (size_t i = 0; i < capacity_; i++) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~MpmcRingQueue() { Clear(); }
+
+  MpmcRingQueue(const MpmcRingQueue &) = delete;
+  MpmcRingQueue &operator=(const MpmcRingQueue &) = delete;
+
+  size_t Capacity() const { return capacity_; }
+
+  bool TryEnqueue(T &&value) {
+    if (!Push(std::move(value))) return false;
+
+    not_empty_.Notify();
+    return true;
+  }
+
+  bool TryDequeue(T &value) {
+    if (!Pop(value)) return false;
+
+    not_full_.Notify();
+    return true;
+  }
+
+  // false once closed, `value` is left untouched then
+  bool Enqueue(T &&value) {
+    bool ok = false;
+    // the other side is notified outside the waiter's lock
+    not_full_.Wait([&]() {
+      if (closed_.load(std::memory_order_acquire)) return true;
+      ok = Push(std::move(value));
+      return ok;
+    });
+
+    if (ok) not_empty_.Notify();
+    return ok;
+  }
+
+  // false once closed, even with items left for Clear()
+  bool Dequeue(T &value, absl::Duration timeout = absl::InfiniteDuration()) {
+    bool ok = false;
+    not_empty_.Wait(
+        [&]() {
+          if (closed_.load(std::memory_order_acquire)) return true;
+          ok = Pop(value);
+          return ok;
+        },
+        timeout);
+
+    if (ok) not_full_.Notify();
+    return ok;
+  }
+
+  // wake every blocked thread, Enqueue()/Dequeue() fail from here on
+  void Close() {
+    closed_.store(true, std::memory_order_release);
+    not_empty_.Notify();
+    not_full_.Notify();
+  }
+
+  bool IsClosed() const { return closed_.load(std::memory_order_acquire); }
+
+  void Clear() {
+    T value;
+    while (TryDequeue(value)) {
+    }
+  }
+
+  bool Empty() const { return Size() == 0; }
+
+  // a snapshot, producers and consumers may move it any moment
+  size_t Size() const {
+    auto head = head_.load(std::memory_order_acquire);
+    auto tail = tail_.load(std::memory_order_acquire);
+    return tail > head ? tail - head : 0;
+  }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
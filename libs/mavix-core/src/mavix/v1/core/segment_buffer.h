@@ -15,12 +15,16 @@ class SegmentBuffer {
   size_t chunk_size_;
   std::vector<MemoryBuffer> caches_;
   size_t segement_size_;
+  memory::MemoryCategory category_;
 
  public:
-  explicit SegmentBuffer(size_t chunk_size)
+  // chunks and the flattened copy are charged to `category`
+  explicit SegmentBuffer(size_t chunk_size, memory::MemoryCategory category =
+                                                memory::MemoryCategory::General)
       : chunk_size_(chunk_size),
         segement_size_(),
-        caches_(){};
+        caches_(),
+        category_(category){};
 
   ~SegmentBuffer() {}
 
@@ -33,7 +37,7 @@ class SegmentBuffer {
   bool Add(const uint8_t *source, size_t size) {
     if (!source || size == 0 || size > chunk_size_) return false;
 
-    auto buffer = MemoryBuffer(size);
+    auto buffer = MemoryBuffer(size, category_);
     buffer.CopyFrom(source, size);
 
     return Add(std::move(buffer));
@@ -44,7 +48,7 @@ class SegmentBuffer {
   std::shared_ptr<MemoryBuffer> CopyAsMemoryBuffer() {
     if (segement_size_ == 0) return nullptr;
 
-    auto flat_buffer = std::make_shared<MemoryBuffer>(segement_size_);
+    auto flat_buffer = std::make_shared<MemoryBuffer>(segement_size_, category_);
 
     size_t position = 0;
 
@@ -1,11 +1,20 @@
 #pragma once
 
 #include <mavix/v1/core/core.h>
-
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <memory>
 
 #include "mavix/v1/core/stream_base.h"
 #include "mavix/v1/core/memory_buffer.h"
+#include "mavix/v1/core/stream_read_mode.h"
 #include "nvm/macro.h"
 namespace mavix {
 namespace v1 {
@@ -15,19 +24,195 @@ namespace core {
 
 class Stream : public StreamBase, public ICacheBucketBuffer {
  private:
+  // offset, length and buffer alignment accepted by O_DIRECT on common
+  // filesystems and block devices
+  static constexpr size_t kDirectIoAlignment = 4096;
+  static constexpr size_t kDirectIoBounceSize = 1024 * 1024;
+
   std::ifstream stream_;
   std::streamsize size_;
   std::string file_;
+  StreamReadMode read_mode_;
+  int fd_;
+  bool is_direct_;
+  std::streampos position_;
+
+  StreamState OpenDescriptor() {
+    is_direct_ = false;
+
+#if defined(O_DIRECT)
+    if (read_mode_ == StreamReadMode::Direct) {
+      fd_ = ::open(file_.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+      is_direct_ = fd_ >= 0;
+
+      // tmpfs and some network filesystems refuse O_DIRECT, read them
+      // through the page cache and drop what we read instead
+      if (fd_ < 0 && errno == EINVAL) {
+        fd_ = ::open(file_.c_str(), O_RDONLY | O_CLOEXEC);
+      }
+    } else {
+      fd_ = ::open(file_.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+#else
+    fd_ = ::open(file_.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+
+    if (fd_ < 0) {
+      auto err = errno;
+      std::cerr << "Failed to open file: " << file_ << std::endl;
+      size_ = std::streamsize(-1);
+      if (err == ENOENT) return StreamState::FileNotExist;
+      if (err == EACCES) return StreamState::PermissionFailed;
+      return StreamState::Error;
+    }
+
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+      ::close(fd_);
+      fd_ = -1;
+      size_ = std::streamsize(-1);
+      return StreamState::Error;
+    }
+
+    size_ = std::streamsize(st.st_size);
+    position_ = std::streampos(0);
+    if (!is_direct_) ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    return StreamState::Ok;
+  }
+
+  // pread has no shared cursor, several threads may read different ranges
+  // of the same descriptor concurrently.
+  bool ReadAt(uint8_t* dest, std::streampos pos, size_t size) const {
+    size_t total = 0;
+    auto offset = static_cast<off_t>(pos);
+
+    while (total < size) {
+      auto n = ::pread(fd_, dest + total, size - total,
+                       offset + static_cast<off_t>(total));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+
+      total += static_cast<size_t>(n);
+    }
+
+    return true;
+  }
+
+  static bool IsAligned(uintptr_t value) {
+    return value % kDirectIoAlignment == 0;
+  }
+
+  /**
+   * @brief O_DIRECT read of an arbitrary range. The aligned body goes
+   * straight into `dest` when `dest` and `pos` allow it, the unaligned
+   * head/tail (or everything, for an unaligned `dest`) goes through an
+   * aligned bounce buffer.
+   */
+  bool ReadDirectAt(uint8_t* dest, std::streampos pos, size_t size) const {
+    auto offset = static_cast<size_t>(pos);
+
+    if (IsAligned(offset) && IsAligned(reinterpret_cast<uintptr_t>(dest))) {
+      auto body = size - (size % kDirectIoAlignment);
+      if (body > 0 && !ReadAt(dest, pos, body)) return false;
+      if (body == size) return true;
+
+      dest += body;
+      offset += body;
+      size -= body;
+    }
+
+    void* raw = nullptr;
+    if (::posix_memalign(&raw, kDirectIoAlignment, kDirectIoBounceSize) != 0) {
+      return false;
+    }
+    auto bounce = std::unique_ptr<uint8_t, decltype(&std::free)>(
+        static_cast<uint8_t*>(raw), &std::free);
+
+    while (size > 0) {
+      auto aligned_offset = offset - (offset % kDirectIoAlignment);
+      auto skip = offset - aligned_offset;
+      auto chunk = std::min(size, kDirectIoBounceSize - skip);
+      auto length = std::min(kDirectIoBounceSize,
+                             ((skip + chunk + kDirectIoAlignment - 1) /
+                              kDirectIoAlignment) *
+                                 kDirectIoAlignment);
+
+      // the last block may run past EOF, a short read is expected there
+      auto available = ReadAvailableAt(bounce.get(), aligned_offset, length);
+      if (available < skip + chunk) return false;
+
+      std::memcpy(dest, bounce.get() + skip, chunk);
+      dest += chunk;
+      offset += chunk;
+      size -= chunk;
+    }
+
+    return true;
+  }
+
+  size_t ReadAvailableAt(uint8_t* dest, size_t offset, size_t size) const {
+    size_t total = 0;
+
+    while (total < size) {
+      auto n = ::pread(fd_, dest + total, size - total,
+                       static_cast<off_t>(offset + total));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) break;
+
+      total += static_cast<size_t>(n);
+    }
+
+    return total;
+  }
+
+  bool Read(uint8_t* dest, std::streampos pos, size_t size) const {
+    if (is_direct_) return ReadDirectAt(dest, pos, size);
+    if (!ReadAt(dest, pos, size)) return false;
+
+    // page cache fallback of Direct, do not keep what we will not reread
+    if (read_mode_ == StreamReadMode::Direct) {
+      ::posix_fadvise(fd_, static_cast<off_t>(pos), static_cast<off_t>(size),
+                      POSIX_FADV_DONTNEED);
+    }
+
+    return true;
+  }
+
+  // descriptor backed modes share the pread code path
+  bool IsPositional() const {
+    return read_mode_ == StreamReadMode::Positional ||
+           read_mode_ == StreamReadMode::Direct;
+  }
 
  public:
-  explicit Stream(const std::string& file)
+  explicit Stream(const std::string& file,
+                  StreamReadMode read_mode = StreamReadMode::Buffered)
       : StreamBase(file),
         stream_(nullptr),
         size_(std::streamsize()),
-        file_(std::string(file)) {}
-  ~Stream() {}
+        file_(std::string(file)),
+        read_mode_(read_mode),
+        fd_(-1),
+        is_direct_(false),
+        position_(std::streampos(0)) {}
+  ~Stream() {
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  StreamReadMode ReadMode() const { return read_mode_; }
+
+  // false for Direct when the filesystem refused O_DIRECT
+  bool IsDirectIo() const { return is_direct_; }
+
+  bool IsConcurrentReadSupported() const override { return IsPositional(); }
 
   StreamState Open() override {
+    if (IsPositional()) {
+      if (fd_ >= 0) return StreamState::AlreadyOpen;
+      return OpenDescriptor();
+    }
+
     if (stream_.is_open()) return StreamState::AlreadyOpen;
     stream_ = std::ifstream(file_, std::ios::binary | std::ios::ate);
 
@@ -44,6 +229,14 @@ class Stream : public StreamBase, public ICacheBucketBuffer {
   }
 
   StreamState Close() override {
+    if (IsPositional()) {
+      if (fd_ < 0) return StreamState::Error;
+
+      auto closed = ::close(fd_);
+      fd_ = -1;
+      return closed == 0 ? StreamState::Ok : StreamState::Error;
+    }
+
     if (!stream_.is_open()) {
       return StreamState::Error;
     }
@@ -61,6 +254,7 @@ class Stream : public StreamBase, public ICacheBucketBuffer {
   const std::string& File() const override { return file_; }
 
   std::streampos CurrentPosition() override {
+    if (IsPositional()) return fd_ >= 0 ? position_ : std::streampos(-1);
     if (!stream_.good() || !stream_.is_open()) return std::streampos(-1);
 
     return stream_.tellg();
@@ -68,6 +262,13 @@ class Stream : public StreamBase, public ICacheBucketBuffer {
 
  
   bool CopyToPointer(uint8_t* dest, std::streampos pos, size_t size) override {
+    if (IsPositional()) {
+      if (!dest || fd_ < 0 || size == 0) return false;
+      if (pos < 0 || IsOutOfBound(pos, size)) return false;
+
+      return Read(dest, pos, size);
+    }
+
     if (!dest || !stream_.good() || !stream_.is_open() || size == 0)
       return false;
 
@@ -90,6 +291,19 @@ class Stream : public StreamBase, public ICacheBucketBuffer {
   std::shared_ptr<core::MemoryBuffer> CopyToSharedBuffer(
                                                             std::streampos pos,
                                                             size_t size) {
+    if (IsPositional()) {
+      if (fd_ < 0 || size == 0) return nullptr;
+      if (pos < 0 || IsOutOfBound(pos, size)) return nullptr;
+
+      auto buffer = std::make_shared<core::MemoryBuffer>(size);
+      if (!Read(buffer->Data(), pos, size)) {
+        buffer->Destroy();
+        return nullptr;
+      }
+
+      return buffer;
+    }
+
     if (!stream_.good() || !stream_.is_open() || size == 0) return nullptr;
 
     if (IsOutOfBound(pos, size)) return nullptr;
@@ -111,6 +325,12 @@ class Stream : public StreamBase, public ICacheBucketBuffer {
   }
 
   std::streampos MoveTo(std::streampos pos) override{
+    if (IsPositional()) {
+      if (fd_ < 0 || pos >= size_ || pos < 0) return std::streampos(-1);
+      position_ = pos;
+      return pos;
+    }
+
     if (!stream_.good() || !stream_.is_open()) return std::streampos(-1);
     if (pos >= size_ || pos < 0) return std::streampos(-1);
 
@@ -123,6 +343,12 @@ class Stream : public StreamBase, public ICacheBucketBuffer {
   }
 
   std::streampos Next(std::streamsize size) override{
+    if (IsPositional()) {
+      if (fd_ < 0 || position_ + size >= size_) return std::streampos(-1);
+      position_ += size;
+      return position_;
+    }
+
     if (!stream_.good() || !stream_.is_open()) return std::streampos(-1);
 
     auto newPos = CurrentPosition() + size;
@@ -137,6 +363,12 @@ class Stream : public StreamBase, public ICacheBucketBuffer {
   }
 
   std::streampos Prev(std::streamsize size) override {
+    if (IsPositional()) {
+      if (fd_ < 0 || position_ - size <= 0) return std::streampos(-1);
+      position_ -= size;
+      return position_;
+    }
+
     if (!stream_.good() || !stream_.is_open()) return std::streampos(-1);
 
     auto newPos = CurrentPosition() - size;
@@ -158,11 +390,17 @@ class Stream : public StreamBase, public ICacheBucketBuffer {
     return (pos + static_cast<std::streampos>(size) > size_) ? true : false;
   }
 
-  bool IsOpen() const override { return stream_.is_open(); }
+  bool IsOpen() const override {
+    return IsPositional() ? fd_ >= 0 : stream_.is_open();
+  }
 
-  bool IsEof() const override { return stream_.eof(); }
+  bool IsEof() const override {
+    return IsPositional() ? position_ >= size_ : stream_.eof();
+  }
 
-  bool IsGood() const override { return stream_.good(); }
+  bool IsGood() const override {
+    return IsPositional() ? fd_ >= 0 : stream_.good();
+  }
 
   std::streamsize Size() const override { return size_; }
 };
@@ -13,6 +13,9 @@ namespace v1 {
 namespace core {
 
 class IStreamBase {
+ public:
+  virtual ~IStreamBase() {}
+
   virtual std::string GetFilename() const = 0;
 
   virtual std::string GetDirectoryPath() const = 0;
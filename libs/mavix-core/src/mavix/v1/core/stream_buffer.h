@@ -4,12 +4,15 @@
 
 #include <algorithm>
 #include <fstream>
+#include <vector>
 
 #include "absl/container/node_hash_map.h"
 #include "absl/synchronization/mutex.h"
 #include "mavix/v1/core/aflag_once.h"
 #include "mavix/v1/core/cache_bucket.h"
+#include "mavix/v1/core/page_read_ahead.h"
 #include "mavix/v1/core/stream.h"
+#include "mavix/v1/core/stream_read_mode.h"
 
 namespace mavix {
 namespace v1 {
@@ -51,9 +54,89 @@ class IMemoryBufferAdapter {
   virtual size_t RemoveBufferPage(std::streampos pos, std::streamsize size) = 0;
 
   virtual size_t RemoveBufferPage(uint64_t buffer_page_id) = 0;
+
+  // Make the page resident ahead of use, safe to call from any thread.
+  virtual bool PrefetchBufferPage(uint64_t buffer_page_id) = 0;
+
+  // Keep the page resident until unpinned, eviction skips pinned pages.
+  virtual bool PinBufferPage(uint64_t buffer_page_id) = 0;
+
+  virtual void UnpinBufferPage(uint64_t buffer_page_id) = 0;
+};
+
+/**
+ * @brief Pins every page of a range for the guard lifetime, so pointers
+ * resolved inside it can not be evicted while the caller still reads them.
+ */
+class BufferPagePin {
+ private:
+  IMemoryBufferAdapter* buffer_;
+  uint64_t start_page_id_;
+  uint64_t end_page_id_;
+
+ public:
+  BufferPagePin(IMemoryBufferAdapter* buffer, std::streampos pos,
+                std::streamsize size)
+      : buffer_(buffer), start_page_id_(0), end_page_id_(0) {
+    if (!buffer_ || size <= 0) return;
+
+    auto locator = buffer_->TryConsume(pos, size);
+    if (!locator || !locator->state) return;
+    if (locator->type != PageLocatorResolvement::SinglePage &&
+        locator->type != PageLocatorResolvement::CrossPage) {
+      return;
+    }
+
+    start_page_id_ = locator->start_page_id;
+    for (auto i = locator->start_page_id; i <= locator->end_page_id; i++) {
+      if (!buffer_->PinBufferPage(i)) break;
+      end_page_id_ = i;
+    }
+  }
+
+  BufferPagePin(const BufferPagePin&) = delete;
+  BufferPagePin& operator=(const BufferPagePin&) = delete;
+
+  ~BufferPagePin() {
+    if (end_page_id_ == 0) return;
+
+    for (auto i = start_page_id_; i <= end_page_id_; i++) {
+      buffer_->UnpinBufferPage(i);
+    }
+  }
 };
 
-class StreamBuffer : public StreamBase, public IMemoryBufferAdapter {
+/**
+ * @brief Common base for file backed buffer adapters, lets the reader pick
+ * the backend (buffered pages or memory mapped) at runtime.
+ */
+class StreamBufferBase : public StreamBase, public IMemoryBufferAdapter {
+ protected:
+  explicit StreamBufferBase(const std::string& filename)
+      : StreamBase(filename) {}
+
+ public:
+  virtual ~StreamBufferBase() {}
+
+  bool IsOpen() const override = 0;
+
+  bool IsGood() const override = 0;
+
+  bool IsEof() const override = 0;
+
+  std::streamsize Size() const override = 0;
+
+  IMemoryBufferAdapter* GetAdapter() { return this; }
+
+  /**
+   * @brief Tell the backend the consumer walks the ranges starting at
+   * `starts` concurrently, empty for a single sequential walk. Only read-ahead
+   * uses it, backends without one ignore it.
+   */
+  virtual void SetReadAheadRanges(const std::vector<std::streampos>& starts) {}
+};
+
+class StreamBuffer : public StreamBufferBase {
  private:
   AFlagOnce isRun_;
   std::shared_ptr<Stream> stream_;
@@ -61,21 +144,28 @@ class StreamBuffer : public StreamBase, public IMemoryBufferAdapter {
   size_t max_cache_size_;
   std::string filename_;
   CacheBucket caches_;
+  PageReadAhead read_ahead_;
   absl::Mutex mu_;
 
  public:
   explicit StreamBuffer(const std::string& filename,
                         CacheGenerationOptions options,
                         const size_t& cache_size_page = 1024 * 1024 * 20,
-                        const size_t& max_cache_size = 1024 * 1024 * 20 * 10)
-      : StreamBase(filename),
+                        const size_t& max_cache_size = 1024 * 1024 * 20 * 10,
+                        StreamReadMode read_mode = StreamReadMode::Buffered)
+      : StreamBufferBase(filename),
         filename_(std::string(filename)),
-        stream_(std::make_shared<Stream>(filename)),
+        stream_(std::make_shared<Stream>(filename, read_mode)),
         isRun_(AFlagOnce()),
         cache_size_page_(size_t(cache_size_page)),
         max_cache_size_(size_t(max_cache_size)),
         caches_(
-            CacheBucket(stream_, options, cache_size_page, max_cache_size)){};
+            CacheBucket(stream_, options, cache_size_page, max_cache_size)),
+        read_ahead_(
+            [this](uint64_t page_id) {
+              return caches_.PrefetchCachePage(page_id);
+            },
+            0){};
 
   ~StreamBuffer(){
       // if (IsStreamOpen()) {
@@ -115,6 +205,8 @@ class StreamBuffer : public StreamBase, public IMemoryBufferAdapter {
       return nullptr;
     }
 
+    read_ahead_.Advance(locator->start_page_id);
+
     if (locator->end_page_id != locator->start_page_id) {
       resolve_result = PageLocatorInfo();
       resolve_result.type = PageLocatorResolvement::CrossPage;
@@ -129,14 +221,21 @@ class StreamBuffer : public StreamBase, public IMemoryBufferAdapter {
   std::vector<BufferPointer> GetAsPointer(
       std::streampos pos, std::streamsize size,
       PageLocatorInfo& resolve_result) override {
-    return caches_.GetAsPointer(pos, size, resolve_result);
+    absl::ReaderMutexLock lock(&mu_);
+    auto pointers = caches_.GetAsPointer(pos, size, resolve_result);
+    if (!pointers.empty()) read_ahead_.Advance(resolve_result.end_page_id);
+
+    return pointers;
   }
 
   std::shared_ptr<MemoryBuffer> GetAsCopy(
       std::streampos pos, std::streamsize size,
       PageLocatorInfo& resolve_result) override {
     absl::ReaderMutexLock lock(&mu_);
-    return caches_.GetAsCopy(pos, size, resolve_result);
+    auto buffer = caches_.GetAsCopy(pos, size, resolve_result);
+    if (buffer) read_ahead_.Advance(resolve_result.end_page_id);
+
+    return buffer;
   }
 
   absl::node_hash_map<uint64_t, BufferPage> GetRequiredBufferPages() override {
@@ -157,23 +256,78 @@ class StreamBuffer : public StreamBase, public IMemoryBufferAdapter {
     return caches_.RemoveCaches(buffer_page_id);
   }
 
-  IMemoryBufferAdapter* GetAdapter() { return this; }
+  bool PrefetchBufferPage(uint64_t buffer_page_id) override {
+    absl::ReaderMutexLock lock(&mu_);
+    return caches_.PrefetchCachePage(buffer_page_id);
+  }
 
-  StreamState Open() override {
+  bool PinBufferPage(uint64_t buffer_page_id) override {
     absl::ReaderMutexLock lock(&mu_);
+    return caches_.PinCachePage(buffer_page_id);
+  }
+
+  void UnpinBufferPage(uint64_t buffer_page_id) override {
+    absl::ReaderMutexLock lock(&mu_);
+    caches_.UnpinCachePage(buffer_page_id);
+  }
+
+  StreamReadMode ReadMode() const { return stream_->ReadMode(); }
+
+  /**
+   * @brief Keep the next `window_pages` pages materialized on background I/O
+   * threads while the consumer walks the file. Applied on the next Open().
+   * More than one I/O thread only pays off with the positional backend.
+   */
+  bool SetReadAhead(size_t window_pages, uint16_t io_threads = 1) {
+    return read_ahead_.Configure(window_pages, io_threads);
+  }
+
+  size_t ReadAheadWindow() const { return read_ahead_.Window(); }
+
+  void SetReadAheadRanges(const std::vector<std::streampos>& starts) override {
+    std::vector<uint64_t> first_pages;
+    for (auto pos : starts) {
+      auto locator = caches_.GetBufferLocator(pos, 0);
+      if (locator && locator->state) {
+        first_pages.push_back(locator->start_page_id);
+      }
+    }
+
+    read_ahead_.SetCursors(std::move(first_pages));
+  }
+
+  // 0 when the bucket is unbounded
+  size_t MaxCachePages() { return caches_.MaxCachePages(); }
+
+  size_t ResidentPages() { return caches_.ResidentCachePages(); }
+
+  StreamState Open() override {
+    absl::MutexLock lock(&mu_);
     if (isRun_.State()) return StreamState::AlreadyOpen;
 
-    isRun_.Signal();
     auto state = stream_->Open();
+    if (state != StreamState::Ok) return state;
+
+    isRun_.Signal();
     caches_.Reset();
+
+    if (read_ahead_.IsEnabled()) {
+      read_ahead_.Start(caches_.TotalPages());
+    }
+
     return state;
   }
 
   StreamState Close() override {
-    absl::ReaderMutexLock lock(&mu_);
+    // I/O threads must be gone before the pages are destroyed
+    read_ahead_.Stop();
+
+    absl::MutexLock lock(&mu_);
     if (!isRun_.State()) return StreamState::Stoped;
 
+    // page buffers stay pooled in the bucket for the next Open()
     caches_.Destroy();
+    isRun_.Reset();
     return stream_->Close();
   }
 
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "nvm/macro.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief Backend used to fetch file data into the buffer adapter.
+ *
+ * Buffered     : std::ifstream + CacheBucket pages (default).
+ * MemoryMapped : mmap the whole file, pages are views into the mapping.
+ * Positional   : pread on a shared descriptor, no shared cursor, safe to
+ *                fetch different pages from several threads at once.
+ * Direct       : Positional with O_DIRECT, bypasses the kernel page cache
+ *                for one-shot bulk ingest so it does not evict hot data.
+ * ForwardOnly  : sequential read of a non-seekable source (pipe, stdin as
+ *                "-"), through a bounded ring buffer, no random access.
+ */
+enum class StreamReadMode {
+  Buffered = 0,
+  MemoryMapped = 1,
+  Positional = 2,
+  Direct = 3,
+  ForwardOnly = 4
+};
+
+NVM_ENUM_CLASS_DISPLAY_TRAIT(StreamReadMode)
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "mavix/v1/core/ring_queue.h"
+
+namespace mavix {
+namespace v1 {
+namespace core {
+
+/**
+ * @brief Hands items to a fixed set of worker threads, each with its own
+ * queue, and lets idle workers steal from the others.
+ *
+ * Submit() spreads items round robin over the workers of a group (the NUMA
+ * node of the producer, say). Take() serves the worker from its own queue
+ * first, then steals from the busiest worker of its group and only then
+ * from any other, so uneven items no longer leave one worker with a backlog
+ * while the rest are idle. Queues are lock-free rings; a worker with nothing
+ * to take parks until the next Submit() or Close().
+ */
+template <typename T>
+class WorkStealingScheduler {
+ public:
+  static constexpr size_t kAnyGroup = std::numeric_limits<size_t>::max();
+
+ private:
+  using Queue_T = MpmcRingQueue<T>;
+
+  std::vector<std::unique_ptr<Queue_T>> queues_;
+  // group of every worker and the workers of every group
+  std::vector<size_t> worker_groups_;
+  std::vector<std::vector<uint16_t>> group_workers_;
+  std::unique_ptr<std::atomic<size_t>[]> group_cursors_;
+  std::atomic<size_t> cursor_;
+
+  std::atomic<bool> closed_;
+  std::atomic<size_t> stolen_;
+  RingWaiter work_;
+
+  // the fullest queue among `candidates`, -1 when all are empty
+  int Busiest(const std::vector<uint16_t> &candidates, uint16_t self) const {
+    int busiest = -1;
+    size_t most = 0;
+
+    for (auto worker : candidates) {
+      if (worker == self) continue;
+
+      auto size = queues_[worker]->Size();
+      if (size > most) {
+        most = size;
+        busiest = worker;
+      }
+    }
+
+    return busiest;
+  }
+
+  bool Steal(const std::vector<uint16_t> &candidates, uint16_t self,
+             T &item) {
+    // the busiest victim can be emptied under our feet, look again then; a
+    // slot claimed but not yet published counts too, so give up eventually
+    for (size_t attempt = 0; attempt < candidates.size(); attempt++) {
+      auto victim = Busiest(candidates, self);
+      if (victim < 0) return false;
+
+      if (queues_[victim]->TryDequeue(item)) {
+        stolen_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  uint16_t NextWorker(size_t group) {
+    if (group >= group_workers_.size() || group_workers_[group].empty()) {
+      return static_cast<uint16_t>(
+          cursor_.fetch_add(1, std::memory_order_relaxed) % queues_.size());
+    }
+
+    auto &workers = group_workers_[group];
+    auto next = group_cursors_[group].fetch_add(1, std::memory_order_relaxed);
+    return workers[next % workers.size()];
+  }
+
+ public:
+  /**
+   * @brief `worker_groups` gives the group of every worker, empty puts them
+   * all in one. Each worker queues at most `capacity` items.
+   */
+  WorkStealingScheduler(uint16_t workers, size_t capacity,
+                        std::vector<size_t> worker_groups = {})
+      : queues_(),
+        worker_groups_(std::move(worker_groups)),
+        group_workers_(),
+        group_cursors_(nullptr),
+        cursor_(0),
+        closed_(false),
+        stolen_(0),
+        work_() {
+    workers = std::max<uint16_t>(1, workers);
+    worker_groups_.resize(workers, 0);
+
+    for (uint16_t i = 0; i < workers; i++) {
+      queues_.emplace_back(std::make_unique<Queue_T>(capacity));
+
+      auto group = worker_groups_[i];
+      if (group >= group_workers_.size()) group_workers_.resize(group + 1);
+      group_workers_[group].push_back(i);
+    }
+
+    group_cursors_.reset(new std::atomic<size_t>[group_workers_.size()]);
+    for (size_t i = 0; i < group_workers_.size(); i++) group_cursors_[i] = 0;
+  }
+
+  ~WorkStealingScheduler() { Clear(); }
+
+  WorkStealingScheduler(const WorkStealingScheduler &) = delete;
+  WorkStealingScheduler &operator=(const WorkStealingScheduler &) = delete;
+
+  uint16_t WorkerCount() const { return static_cast<uint16_t>(queues_.size()); }
+
+  /**
+   * @brief Queue `item` on the next worker of `group`, or on any worker with
+   * room when that one is full. Blocks while every queue is full; false once
+   * closed.
+   */
+  bool Submit(T &&item, size_t group = kAnyGroup) {
+    if (closed_.load(std::memory_order_acquire)) return false;
+
+    auto first = NextWorker(group);
+    auto count = queues_.size();
+    for (size_t i = 0; i < count; i++) {
+      auto worker = (first + i) % count;
+      if (queues_[worker]->TryEnqueue(std::move(item))) {
+        work_.NotifyOne();
+        return true;
+      }
+    }
+
+    if (!queues_[first]->Enqueue(std::move(item))) return false;
+
+    work_.NotifyOne();
+    return true;
+  }
+
+  /**
+   * @brief Next item for `worker` without waiting: its own queue, then a
+   * steal within its group, then from any worker.
+   */
+  bool TryTake(uint16_t worker, T &item) {
+    if (queues_[worker]->TryDequeue(item)) return true;
+
+    auto &group = group_workers_[worker_groups_[worker]];
+    if (Steal(group, worker, item)) return true;
+    if (group_workers_.size() < 2) return false;
+
+    for (size_t g = 0; g < group_workers_.size(); g++) {
+      if (g == worker_groups_[worker]) continue;
+      if (Steal(group_workers_[g], worker, item)) return true;
+    }
+
+    return false;
+  }
+
+  // parks while no worker has anything queued, false once closed
+  bool Take(uint16_t worker, T &item) {
+    bool ok = false;
+    work_.Wait([&]() {
+      if (closed_.load(std::memory_order_acquire)) return true;
+      ok = TryTake(worker, item);
+      return ok;
+    });
+
+    return ok;
+  }
+
+  // wake every waiting worker and producer, Submit()/Take() fail from here
+  void Close() {
+    closed_.store(true, std::memory_order_release);
+    for (auto &queue : queues_) queue->Close();
+    work_.Notify();
+  }
+
+  bool IsClosed() const { return closed_.load(std::memory_order_acquire); }
+
+  // drops whatever is still queued
+  void Clear() {
+    for (auto &queue : queues_) queue->Clear();
+  }
+
+  // a snapshot of everything queued
+  size_t Pending() const {
+    size_t pending = 0;
+    for (auto &queue : queues_) pending += queue->Size();
+    return pending;
+  }
+
+  // items taken from another worker's queue so far
+  size_t Stolen() const { return stolen_.load(std::memory_order_relaxed); }
+};
+
+}  // namespace core
+}  // namespace v1
+}  // namespace mavix
@@ -15,10 +15,14 @@
 #include "absl/synchronization/mutex.h"
 #include "absl/synchronization/notification.h"
 #include "absl/time/time.h"
-#include "mavix/v1/core/concurrent_queue.h"
-#include "mavix/v1/core/round_robin_scheduler.h"
+#include "mavix/v1/core/async_counter.h"
+#include "mavix/v1/core/memory/memory_governor.h"
+#include "mavix/v1/core/numa_topology.h"
+#include "mavix/v1/core/ring_queue.h"
 #include "mavix/v1/core/telemetry_monitor.h"
+#include "mavix/v1/core/work_stealing_scheduler.h"
 #include "mavix/v1/osm/pbf/pbf_declare.h"
+#include "mavix/v1/osm/pbf/pbf_decode_context.h"
 #include "mavix/v1/osm/pbf/pbf_decoder.h"
 #include "mavix/v1/osm/pbf/pbf_field_decoder.h"
 #include "mavix/v1/osm/pbf/pbf_stream_reader.h"
@@ -35,9 +39,14 @@ namespace osmf = mavix::v1::osm::formats;
 namespace core = mavix::v1::core;
 
 class OsmPbfReader {
-  using Concurrent_T = core::ConcurrentQueue<pbf::PbfBlobData>;
+  using Scheduler_T =
+      core::WorkStealingScheduler<std::shared_ptr<pbf::PbfBlobData>>;
+  using Handoff_T = core::SpscRingQueue<std::shared_ptr<pbf::PbfBlobData>>;
 
  private:
+  // blobs queued per worker when max_pending_processing is not given
+  static constexpr uint16_t kDefaultPendingPerWorker = 64;
+
   void (*on_reader_start_callback_)(OsmPbfReader* sender,
                                     core::StreamState state);
 
@@ -54,9 +63,7 @@ class OsmPbfReader {
 
   absl::CondVar cv_main_worker_;
   absl::CondVar cv_all_threads_ready_;
-  absl::CondVar cv_processing_;
 
-  std::allocator<Concurrent_T> queue_shard_;
   std::thread main_worker_;
   std::vector<std::thread> process_workers_;
 
@@ -69,9 +76,22 @@ class OsmPbfReader {
   core::AsyncCounter<size_t> tasks_received_;
   core::AsyncCounter<size_t> tasks_created_;
 
-  core::RoundRobinScheduler round_robin_;
-  std::vector<Concurrent_T*> processing_queue_ptr_;
+  // per worker queues of decoded blobs, idle workers steal from the others
+  std::unique_ptr<Scheduler_T> scheduler_;
+  // forward-only input: blobs from the tokenizer to the dispatcher thread
+  std::unique_ptr<Handoff_T> handoff_;
+  std::thread dispatcher_;
   bool verbose_;
+  bool is_block_index_persist_;
+
+  bool is_numa_aware_;
+  core::NumaTopology topology_;
+  // node of every worker and the workers of every node
+  std::vector<size_t> worker_nodes_;
+  std::vector<std::vector<uint16_t>> node_workers_;
+  // nodes with at least one worker, tokenizer ranges are spread over them
+  std::vector<size_t> dispatch_nodes_;
+  uint16_t tokenizer_threads_;
 
   pbf::PbfStreamReader stream_;
   uint16_t initialized_thread_count_;
@@ -81,32 +101,14 @@ class OsmPbfReader {
   bool already_joined_;
   bool processing_already_joined_;
 
-  Concurrent_T* CreateProcessQueue() {
-    auto ptr = queue_shard_.allocate(1);
-    if (!ptr) return nullptr;
-
-    queue_shard_.construct(ptr);
-    processing_queue_ptr_.push_back(ptr);
-
-    return ptr;
-  }
-
-  bool DestroyProcessQueue(Concurrent_T* ptr) {
-    if (!ptr) return false;
-
-    queue_shard_.destroy(ptr);
-    queue_shard_.deallocate(ptr, 1);
-
-    processing_queue_ptr_.erase(std::remove(processing_queue_ptr_.begin(),
-                                            processing_queue_ptr_.end(), ptr),
-                                processing_queue_ptr_.end());
-    return true;
+  // wakes every worker waiting for a blob and the tokenizer on full queues
+  void CloseProcessQueues() {
+    if (scheduler_) scheduler_->Close();
   }
 
   void Initialize() {
     if (process_worker_num_ == 0) {
       process_worker_num_ = std::thread::hardware_concurrency();
-      round_robin_.Reset(process_worker_num_);
     }
 #if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_OSM_THREAD)
     std::cout << "Hardware Thread: " << process_worker_num_ << std::endl;
@@ -114,6 +116,80 @@ class OsmPbfReader {
     process_workers_.reserve(process_worker_num_);
   }
 
+  /**
+   * @brief Spread the workers over the NUMA nodes in contiguous groups,
+   * sized by the CPUs each node has.
+   */
+  void PlanNumaPlacement() {
+    topology_ = core::NumaTopology::Detect();
+    worker_nodes_.assign(process_worker_num_, 0);
+    node_workers_.assign(topology_.NodeCount(), std::vector<uint16_t>());
+
+    size_t total_cpus = 0;
+    for (size_t node = 0; node < topology_.NodeCount(); node++) {
+      total_cpus += topology_.Cpus(node).size();
+    }
+
+    size_t node = 0;
+    size_t node_end = topology_.Cpus(0).size();
+    for (uint16_t worker = 0; worker < process_worker_num_; worker++) {
+      // position of the worker scaled onto the cpu range of all nodes
+      auto slot = size_t(worker) * total_cpus / process_worker_num_;
+      while (slot >= node_end && node + 1 < topology_.NodeCount()) {
+        node++;
+        node_end += topology_.Cpus(node).size();
+      }
+
+      worker_nodes_[worker] = node;
+      node_workers_[node].push_back(worker);
+    }
+
+    dispatch_nodes_.clear();
+    for (size_t i = 0; i < node_workers_.size(); i++) {
+      if (!node_workers_[i].empty()) dispatch_nodes_.push_back(i);
+    }
+  }
+
+  /**
+   * @brief Pin a worker to the CPUs of its node, so the decode context and
+   * the pool blocks it touches first are allocated on that node. The kernel
+   * still balances the workers over the cores of the node.
+   */
+  void PlaceWorker(size_t worker_index) {
+    if (!is_numa_aware_ || worker_index >= worker_nodes_.size()) return;
+
+    auto node = worker_nodes_[worker_index];
+    core::NumaTopology::PinCurrentThread(topology_.Cpus(node));
+#if defined(MAVIX_ALLOCATOR_POOL)
+    core::memory::PoolAllocator::SetThreadNode(node);
+#endif
+  }
+
+  // scheduler group the calling tokenizer thread submits its blobs to
+  static size_t& TokenizerGroup() {
+    thread_local size_t group = Scheduler_T::kAnyGroup;
+    return group;
+  }
+
+  /**
+   * @brief Pin the tokenizer of `range` to a node, ranges are spread over
+   * the nodes in contiguous runs. The blobs it reads are first touched on
+   * that node, so they go to the workers of that node. A single tokenizer
+   * stays unpinned and hands blobs to any worker.
+   */
+  void PlaceTokenizer(size_t range, size_t count) {
+    TokenizerGroup() = Scheduler_T::kAnyGroup;
+    if (!is_numa_aware_ || dispatch_nodes_.size() < 2 || count < 2) return;
+
+    auto node = dispatch_nodes_[range * dispatch_nodes_.size() / count];
+    if (!core::NumaTopology::PinCurrentThread(topology_.Cpus(node))) return;
+#if defined(MAVIX_ALLOCATOR_POOL)
+    core::memory::PoolAllocator::SetThreadNode(node);
+#endif
+
+    TokenizerGroup() = node;
+  }
+
   void WaitForAllThreadsToBeReady() {
     absl::MutexLock lock(&mu_);
     initialized_thread_count_++;
@@ -136,10 +212,63 @@ class OsmPbfReader {
     // #endif
   }
 
-  void ProcessBlockTokenizer(uint16_t worker_id,
-                             uint16_t max_pending_processing,
-                             std::vector<Concurrent_T*>&& queue_shard_ptr) {
-    auto pq_ptr = std::forward<std::vector<Concurrent_T*>>(queue_shard_ptr);
+  static bool IsMemoryPressure(core::memory::MemoryGovernor& governor) {
+    return governor.IsOverBudget(core::memory::MemoryCategory::BlobQueue) ||
+           governor.IsOverBudget(core::memory::MemoryCategory::Inflate) ||
+           governor.IsOverBudget(core::memory::MemoryCategory::Decode);
+  }
+
+  /**
+   * @brief Pause the tokenizer while the pipeline is over its memory budget.
+   * Cache pages are reclaimed first, then it waits for the workers to free
+   * blobs. Gives up once no task is left in flight that could free any.
+   */
+  void ApplyBackpressure() {
+    auto& governor = core::memory::MemoryGovernor::Global();
+
+    while (IsMemoryPressure(governor)) {
+      if (governor.Reclaim(core::memory::MemoryCategory::BlobQueue) > 0) {
+        continue;
+      }
+
+      if (tasks_finished_.Value() >= tasks_created_.Value()) break;
+
+      {
+        absl::MutexLock lock(&mu_);
+        if (should_stop_) break;
+      }
+
+      governor.WaitForRelease(absl::Milliseconds(50));
+    }
+  }
+
+  /**
+   * @brief Forward-only input: move blobs from the tokenizer handoff into the
+   * worker queues, so the tokenizer keeps draining the source while every
+   * worker queue is full. Runs until the tokenizer closes the handoff.
+   */
+  void ProcessDispatch(Handoff_T* handoff, Scheduler_T* scheduler) {
+    std::shared_ptr<pbf::PbfBlobData> data;
+    auto dispatch = [&]() {
+      // blocks while every queue is full, fails once the reader stops
+      if (!scheduler->Submit(std::move(data))) {
+        tasks_finished_.Inc();
+        return;
+      }
+
+      tasks_dispatched_.Inc();
+    };
+
+    while (handoff->Dequeue(data)) dispatch();
+
+    // the tokenizer is done, whatever it queued before closing still counts
+    while (handoff->TryDequeue(data)) dispatch();
+  }
+
+  void ProcessBlockTokenizer(uint16_t worker_id, Scheduler_T* scheduler) {
+    stream_.OnTokenizerThreadStart([this](size_t range, size_t count) {
+      PlaceTokenizer(range, count);
+    });
 
     stream_.OnFinished(
         [this](pbf::PbfTokenizer* sender, core::StreamState state) {
@@ -148,6 +277,12 @@ class OsmPbfReader {
             cv_main_worker_.WaitWithTimeout(&mu_worker_,
                                             absl::Duration(absl::Seconds(1)));
 
+            {
+              // stopped, blobs still queued are dropped and never finish
+              absl::MutexLock lock(&mu_);
+              if (should_stop_) break;
+            }
+
             auto c = tasks_created_.Value();
             auto f = tasks_finished_.Value();
             auto p = (static_cast<float>(f) / static_cast<float>(c)) * 100.0;
@@ -157,23 +292,38 @@ class OsmPbfReader {
 
           std::cout << "PROCESSING FINISHED" << std::endl;
 
+          if (is_block_index_persist_) stream_.SaveBlockIndex();
+
           absl::MutexLock lock(&mu_);
           should_stop_ = true;
-          cv_processing_.SignalAll();
+          CloseProcessQueues();
         });
 
     stream_.OnDataReady(
-        [this, &pq_ptr](pbf::PbfTokenizer* sender,
-                        std::shared_ptr<pbf::PbfBlobData> data) {
+        [this, scheduler](pbf::PbfTokenizer* sender,
+                          std::shared_ptr<pbf::PbfBlobData> data) {
           tasks_created_.Inc();
 
-          auto worker = round_robin_.Dispatch();
-          // std::cout << "To Worker:" << worker << std::endl;
-          auto q = pq_ptr.at(worker);
+          // single tokenizer, the dispatcher thread submits it
+          if (handoff_) {
+            if (!handoff_->Enqueue(std::move(data))) {
+              tasks_finished_.Inc();
+              return;
+            }
+
+            ApplyBackpressure();
+            return;
+          }
+
+          // workers on the node of this tokenizer first. Blocks while every
+          // queue is full, fails once the reader stops
+          if (!scheduler->Submit(std::move(data), TokenizerGroup())) {
+            tasks_finished_.Inc();
+            return;
+          }
 
-          q->Enqueue(*data);
           tasks_dispatched_.Inc();
-          cv_processing_.SignalAll();
+          ApplyBackpressure();
         });
 
     WaitForAllThreadsToBeReady();
@@ -182,48 +332,52 @@ class OsmPbfReader {
       absl::MutexLock lock(&mu_worker_);
       stream_.Start(verbose_);
     }
+
+    // only this thread produces, closing lets the dispatcher drain and exit
+    if (handoff_) handoff_->Close();
   }
 
-  void ProcessOsmPbfBlob(uint16_t worker_id, Concurrent_T* queue) {
+  void ProcessOsmPbfBlob(uint16_t worker_id, Scheduler_T* scheduler) {
+    // worker ids start at 2, 1 is the tokenizer
+    PlaceWorker(worker_id - 2);
     WaitForAllThreadsToBeReady();
+
+    SkipOptions options;
+    std::shared_ptr<pbf::PbfBlockIndex> index;
+    bool summarize;
     {
       absl::MutexLock lock(&mu_);
-      auto options = SkipOptions(stream_.DecoderOptions());
-
-      DebugCondVar(worker_id, should_stop_, "BLOB-PROC");
-
-      while (true) {
-        if (queue->Empty() && is_run_ && !should_stop_) {
-          DebugCondVar(worker_id, should_stop_, "WAITJOB");
-          cv_processing_.Wait(&mu_);
-        }
-
-        if (should_stop_) {
-          break;
-        }
-
-        if (queue->Empty()) {
-          continue;  // Go back to waiting or ending the loop.
-        }
-
-        mu_.Unlock();
+      options = SkipOptions(stream_.DecoderOptions());
+      index = stream_.BlockIndex();
+      summarize = is_block_index_persist_ && !stream_.IsBlockSelected();
+    }
 
-        std::shared_ptr<pbf::PbfBlobData> p =
-            std::make_shared<pbf::PbfBlobData>();
-        auto state = queue->TryDequeue(*p);
-        tasks_received_.Inc();
-        // std::cout << "Processing: " << worker_id << std::endl;
+    // decode storage of this worker, released in one go per block
+    pbf::PbfDecodeContext context;
 
-        auto decoder = std::make_shared<pbf::PbfDecoder>(p, options);
-        decoder->Run();
-        decoder.reset();
-        p->blob_data->Destroy();
-        p->blob.clear_data();
+    DebugCondVar(worker_id, should_stop_, "BLOB-PROC");
 
-        tasks_finished_.Inc();
+    std::shared_ptr<pbf::PbfBlobData> p;
+    // own queue first, then steals; parks while every queue is empty and
+    // fails once the scheduler is closed
+    while (scheduler->Take(worker_id - 2, p)) {
+      tasks_received_.Inc();
 
-        mu_.Lock();
+      auto decoder =
+          std::make_shared<pbf::PbfDecoder>(p, options, summarize, &context);
+      decoder->Run();
+      if (summarize && p->block_ordinal >= 0) {
+        index->Summarize(static_cast<size_t>(p->block_ordinal),
+                         decoder->Summary());
       }
+      decoder.reset();
+      context.Reset();
+      // the payload is freed here unless a callback still holds it
+      p->blob_data.Reset();
+      p->blob.clear_data();
+      p.reset();
+
+      tasks_finished_.Inc();
     }
 
     std::cout << "PROCESS FINISHED: " << worker_id << std::endl;
@@ -239,41 +393,52 @@ class OsmPbfReader {
         t.join();
       }
     }
+
   }
 
   void ClearProcessQueue() {
     absl::MutexLock lock(&mu_);
     // std::cout << "CLEAR-TASK" << std::endl;
 
-    for (auto ptr : processing_queue_ptr_) {
-      for (size_t i = 0; i < ptr->Size(); i++) {
-        pbf::PbfBlobData p;
-        ptr->TryDequeue(p);
-        p.blob_data->Destroy();
-      }
-      ptr->Clear();
-      DestroyProcessQueue(ptr);
-    }
+    // queued payloads are freed along with their entries
+    if (scheduler_) scheduler_->Clear();
   }
 
  public:
+  /**
+   * @brief `read_ahead_pages` above 0 prefetches that many cache pages on
+   * background I/O threads. Pass CacheGenerationOptions::HugePages as
+   * `cache_options` to back the cache pages with 2 MB huge pages.
+   */
   explicit OsmPbfReader(
       const std::string& filename, osm::SkipOptions options,
       uint16_t process_worker = std::thread::hardware_concurrency(),
-      uint16_t max_pending_processing = 0, bool verbose = false)
+      uint16_t max_pending_processing = 0, bool verbose = false,
+      core::StreamReadMode read_mode = core::StreamReadMode::Buffered,
+      size_t read_ahead_pages = 0,
+      core::CacheGenerationOptions cache_options =
+          core::CacheGenerationOptions::None)
       : is_run_(false),
         on_pbf_raw_blob_ready_(nullptr),
         on_reader_start_callback_(nullptr),
         on_reader_finished_callback_(nullptr),
         on_osm_data_ready_(nullptr),
-        queue_shard_(),
-        processing_queue_ptr_(),
-        round_robin_(0),
+        scheduler_(nullptr),
+        handoff_(nullptr),
+        dispatcher_(),
         process_workers_(),
         process_worker_num_(process_worker),
         max_pending_processing_(max_pending_processing),
-        stream_(std::string(filename), verbose),
+        stream_(std::string(filename), options, cache_options,
+                1024 * 1024 * 20, verbose, read_mode, read_ahead_pages),
         verbose_(verbose),
+        is_block_index_persist_(false),
+        is_numa_aware_(false),
+        topology_(),
+        worker_nodes_(),
+        node_workers_(),
+        dispatch_nodes_(),
+        tokenizer_threads_(1),
         initialized_thread_count_(0),
         all_threads_created_(false),
         should_stop_(false),
@@ -304,20 +469,14 @@ class OsmPbfReader {
     tasks_received_.Reset();
     tasks_dispatched_.Reset();
     tasks_finished_.Reset();
-    round_robin_.Reset(process_worker_num_);
+    if (is_numa_aware_) PlanNumaPlacement();
 
-    for (auto ptr : processing_queue_ptr_) {
-      for (size_t i = 0; i < ptr->Size(); i++) {
-        pbf::PbfBlobData p;
-        ptr->TryDequeue(p);
-        p.blob_data->Destroy();
-      }
-
-      ptr->Clear();
-      DestroyProcessQueue(ptr);
+    // a tokenizer per node at least, each feeds the workers of its node
+    auto tokenizers = tokenizer_threads_;
+    if (is_numa_aware_ && dispatch_nodes_.size() > 1) {
+      tokenizers = std::max<uint16_t>(tokenizers, dispatch_nodes_.size());
     }
-
-    processing_queue_ptr_.clear();
+    stream_.SetTokenizerThreads(tokenizers);
 
     auto state = stream_.Open();
     if (state != core::StreamState::Ok) {
@@ -325,18 +484,26 @@ class OsmPbfReader {
       return state;
     }
 
-    std::vector<Concurrent_T*> processing_ptr_for_main_worker;
+    auto capacity = max_pending_processing_ > 0 ? max_pending_processing_
+                                                : kDefaultPendingPerWorker;
+    scheduler_ = std::make_unique<Scheduler_T>(
+        process_worker_num_, capacity,
+        is_numa_aware_ ? worker_nodes_ : std::vector<size_t>());
 
     for (auto i = 0; i < process_worker_num_; i++) {
-      auto qptr = CreateProcessQueue();
-      processing_ptr_for_main_worker.emplace_back(qptr);
-      process_workers_.emplace_back(
-          std::thread(&OsmPbfReader::ProcessOsmPbfBlob, this, i + 2, qptr));
+      process_workers_.emplace_back(std::thread(
+          &OsmPbfReader::ProcessOsmPbfBlob, this, i + 2, scheduler_.get()));
+    }
+
+    handoff_.reset();
+    if (stream_.ReadMode() == core::StreamReadMode::ForwardOnly) {
+      handoff_ = std::make_unique<Handoff_T>(capacity);
+      dispatcher_ = std::thread(&OsmPbfReader::ProcessDispatch, this,
+                                handoff_.get(), scheduler_.get());
     }
 
     main_worker_ = std::thread(&OsmPbfReader::ProcessBlockTokenizer, this, 1,
-                               max_pending_processing_,
-                               std::move(processing_ptr_for_main_worker));
+                               scheduler_.get());
 
     return core::StreamState::Ok;
   }
@@ -348,6 +515,8 @@ class OsmPbfReader {
     if (main_worker_.joinable()) {
       main_worker_.join();
     }
+
+    if (dispatcher_.joinable()) dispatcher_.join();
   }
 
   core::StreamState Stop() {
@@ -360,7 +529,7 @@ class OsmPbfReader {
         should_stop_ = true;
         is_run_ = false;
 
-        cv_processing_.SignalAll();
+        CloseProcessQueues();
         cv_main_worker_.SignalAll();
       } else {
         is_run_ = false;
@@ -378,6 +547,64 @@ class OsmPbfReader {
     return core::StreamState::Ok;
   }
 
+  /**
+   * @brief Summarize every block while decoding and write the block index
+   * sidecar once a full scan finishes.
+   */
+  void PersistBlockIndex(bool persist) {
+    absl::MutexLock lock(&mu_);
+    is_block_index_persist_ = persist;
+  }
+
+  /**
+   * @brief Pin workers to the CPUs of their NUMA node and run at least one
+   * range tokenizer per node, pinned the same way. Blobs go to the workers
+   * of the node that read them, an idle worker steals from its own node
+   * before any other. Only while stopped, a single node host and forward-only
+   * input (one tokenizer) behave as before.
+   */
+  bool SetNumaAware(bool numa_aware) {
+    absl::MutexLock lock(&mu_);
+    if (is_run_) return false;
+
+    is_numa_aware_ = numa_aware;
+    return true;
+  }
+
+  bool LoadBlockIndex() { return stream_.LoadBlockIndex(); }
+
+  /**
+   * @brief Cap what the whole process holds, 0 lifts the cap. Budgets per
+   * category are set on core::memory::MemoryGovernor::Global().
+   */
+  void SetMemoryBudget(size_t bytes) {
+    core::memory::MemoryGovernor::Global().SetTotalBudget(bytes);
+  }
+
+  /**
+   * @brief Tokenizers running on separate ranges of the file, only while
+   * stopped. One by default; the ranges share the page cache of the
+   * stream, so size it for a page per tokenizer before raising this.
+   */
+  bool SetTokenizerThreads(uint16_t threads) {
+    absl::MutexLock lock(&mu_);
+    if (is_run_) return false;
+
+    tokenizer_threads_ = std::max<uint16_t>(1, threads);
+    return true;
+  }
+
+  std::shared_ptr<pbf::PbfBlockIndex> BlockIndex() const {
+    return stream_.BlockIndex();
+  }
+
+  // restrict the next Start() to blocks picked from BlockIndex()
+  bool SelectBlocks(std::vector<pbf::PbfBlockIndexEntry> blocks) {
+    return stream_.SelectBlocks(std::move(blocks));
+  }
+
+  void ClearSelectedBlocks() { stream_.ClearSelectedBlocks(); }
+
   void OnFoundRawDataCallback(void (*callback)(
       OsmPbfReader* sender, std::shared_ptr<pbf::PbfBlobData> blob)) {
     absl::MutexLock lock(&mu_);
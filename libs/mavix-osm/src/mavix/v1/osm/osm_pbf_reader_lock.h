@@ -182,7 +182,7 @@ class OsmPbfReaderLock {
         auto decoder = std::make_shared<pbf::PbfDecoder>(p,options);
         decoder->Run();
         decoder.reset();
-        p->blob_data->Destroy();
+        p->blob_data.Reset();
         tasks_finished_.Inc();
         mu_.Lock();
         CheckForTaskFinished();
@@ -207,11 +207,9 @@ class OsmPbfReaderLock {
     absl::MutexLock lock(&mu_);
     // std::cout << "CLEAR-TASK" << std::endl;
 
-    for (size_t i = 0; i < process_queue_.size(); i++) {
-      auto p = process_queue_.front();
-      p->blob_data->Destroy();
+    // payloads are freed with the last reference to their blob
+    while (!process_queue_.empty()) {
       process_queue_.pop();
-
     }
   }
 
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "mavix/v1/core/stream_state.h"
+#include "osmpbf/osmpbf.h"
+
+namespace mavix {
+namespace v1 {
+namespace osm {
+namespace pbf {
+
+/**
+ * @brief Writes PBF file blocks in the order they are given: the BlobHeader
+ * length as 4 bytes big endian, the BlobHeader, then the Blob. The path "-"
+ * writes stdout. Not thread safe, one writer per output.
+ */
+class PbfBlobWriter {
+ private:
+  std::string file_;
+  int fd_;
+  bool owns_fd_;
+  uint64_t bytes_written_;
+  size_t blocks_written_;
+  std::string frame_;
+
+  bool WriteAll(const char* data, size_t size) {
+    while (size > 0) {
+      auto n = ::write(fd_, data, size);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+
+      data += n;
+      size -= static_cast<size_t>(n);
+      bytes_written_ += static_cast<uint64_t>(n);
+    }
+
+    return true;
+  }
+
+ public:
+  explicit PbfBlobWriter(const std::string& file)
+      : file_(std::string(file)),
+        fd_(-1),
+        owns_fd_(file != "-"),
+        bytes_written_(0),
+        blocks_written_(0),
+        frame_() {}
+
+  ~PbfBlobWriter() {
+    if (IsOpen()) Close();
+  }
+
+  PbfBlobWriter(const PbfBlobWriter&) = delete;
+  PbfBlobWriter& operator=(const PbfBlobWriter&) = delete;
+
+  // truncates an existing file
+  core::StreamState Open() {
+    if (fd_ >= 0) return core::StreamState::AlreadyOpen;
+
+    if (file_ == "-") {
+      fd_ = STDOUT_FILENO;
+      return core::StreamState::Ok;
+    }
+
+    fd_ = ::open(file_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                 0644);
+    if (fd_ < 0) {
+      auto err = errno;
+      std::cerr << "Failed to open file for writing: " << file_ << std::endl;
+      if (err == ENOENT) return core::StreamState::FileNotExist;
+      if (err == EACCES) return core::StreamState::PermissionFailed;
+      return core::StreamState::Error;
+    }
+
+    return core::StreamState::Ok;
+  }
+
+  core::StreamState Close() {
+    if (fd_ < 0) return core::StreamState::Error;
+
+    auto closed = owns_fd_ ? ::close(fd_) : 0;
+    fd_ = -1;
+    return closed == 0 ? core::StreamState::Ok : core::StreamState::Error;
+  }
+
+  bool IsOpen() const { return fd_ >= 0; }
+
+  /**
+   * @brief Append one block of `type` ("OSMHeader" or "OSMData") holding
+   * `blob`. False on a write error, the output is incomplete then.
+   */
+  bool Write(const std::string& type, const OSMPBF::Blob& blob) {
+    if (fd_ < 0) return false;
+
+    OSMPBF::BlobHeader header;
+    header.set_type(type);
+    header.set_datasize(static_cast<int32_t>(blob.ByteSizeLong()));
+
+    auto header_size = static_cast<uint32_t>(header.ByteSizeLong());
+    frame_.clear();
+    frame_.push_back(static_cast<char>(header_size >> 24));
+    frame_.push_back(static_cast<char>(header_size >> 16));
+    frame_.push_back(static_cast<char>(header_size >> 8));
+    frame_.push_back(static_cast<char>(header_size));
+
+    if (!header.AppendToString(&frame_) || !blob.AppendToString(&frame_)) {
+      return false;
+    }
+
+    if (!WriteAll(frame_.data(), frame_.size())) return false;
+
+    blocks_written_++;
+    return true;
+  }
+
+  uint64_t BytesWritten() const { return bytes_written_; }
+
+  size_t BlocksWritten() const { return blocks_written_; }
+
+  const std::string& Filename() const { return file_; }
+};
+
+}  // namespace pbf
+}  // namespace osm
+}  // namespace v1
+}  // namespace mavix
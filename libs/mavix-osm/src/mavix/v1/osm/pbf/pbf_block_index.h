@@ -0,0 +1,435 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "mavix/v1/osm/pbf/pbf_block_map.h"
+#include "nvm/macro.h"
+
+namespace mavix {
+namespace v1 {
+namespace osm {
+namespace pbf {
+
+enum class PbfBlobType : uint8_t { Unknown = 0, OsmHeader = 1, OsmData = 2 };
+
+NVM_ENUM_CLASS_DISPLAY_TRAIT(PbfBlobType)
+
+enum class PbfBlockElements : uint8_t {
+  None = 0,
+  Nodes = 1,
+  Ways = 2,
+  Relations = 4
+};
+
+NVM_ENUMCLASS_ENABLE_BITMASK_OPERATORS(PbfBlockElements);
+
+/**
+ * @brief What a decoded OSMData block holds: element kinds, node bbox in
+ * 1e-7 degrees and the id range over all its elements.
+ */
+struct PbfBlockSummary {
+  PbfBlockElements elements;
+  int32_t min_lat;
+  int32_t min_lon;
+  int32_t max_lat;
+  int32_t max_lon;
+  int64_t min_id;
+  int64_t max_id;
+
+  PbfBlockSummary()
+      : elements(PbfBlockElements::None),
+        min_lat(std::numeric_limits<int32_t>::max()),
+        min_lon(std::numeric_limits<int32_t>::max()),
+        max_lat(std::numeric_limits<int32_t>::min()),
+        max_lon(std::numeric_limits<int32_t>::min()),
+        min_id(std::numeric_limits<int64_t>::max()),
+        max_id(std::numeric_limits<int64_t>::min()) {}
+
+  bool HasBoundingBox() const { return min_lat <= max_lat; }
+
+  void AddElement(PbfBlockElements kind, int64_t id) {
+    elements = elements | kind;
+    min_id = std::min(min_id, id);
+    max_id = std::max(max_id, id);
+  }
+
+  // coordinates in nanodegrees, as decoded from a PrimitiveBlock
+  void AddNode(int64_t id, int64_t lat_nano, int64_t lon_nano) {
+    AddElement(PbfBlockElements::Nodes, id);
+
+    auto lat = static_cast<int32_t>(lat_nano / 100);
+    auto lon = static_cast<int32_t>(lon_nano / 100);
+    min_lat = std::min(min_lat, lat);
+    min_lon = std::min(min_lon, lon);
+    max_lat = std::max(max_lat, lat);
+    max_lon = std::max(max_lon, lon);
+  }
+};
+
+struct PbfBlockIndexEntry {
+  // start of the 4 byte BlobHeader length
+  uint64_t offset;
+  uint32_t header_size;
+  uint32_t blob_size;
+  PbfBlobType type;
+  bool is_summarized;
+  PbfBlockSummary summary;
+
+  PbfBlockIndexEntry()
+      : offset(0),
+        header_size(0),
+        blob_size(0),
+        type(PbfBlobType::Unknown),
+        is_summarized(false),
+        summary() {}
+
+  PbfBlockIndexEntry(uint64_t offset, uint32_t header_size, uint32_t blob_size,
+                     PbfBlobType type)
+      : offset(offset),
+        header_size(header_size),
+        blob_size(blob_size),
+        type(type),
+        is_summarized(false),
+        summary() {}
+
+  PbfBlockMap Map() const {
+    return PbfBlockMap(std::streampos(offset + 4), header_size,
+                       std::streampos(offset + 4 + header_size), blob_size);
+  }
+
+  uint64_t End() const { return offset + 4 + header_size + blob_size; }
+
+  bool HasElements(PbfBlockElements elements) const {
+    return (summary.elements & elements) != PbfBlockElements::None;
+  }
+
+  bool Intersects(int32_t min_lat, int32_t min_lon, int32_t max_lat,
+                  int32_t max_lon) const {
+    if (!summary.HasBoundingBox()) return false;
+
+    return summary.min_lat <= max_lat && summary.max_lat >= min_lat &&
+           summary.min_lon <= max_lon && summary.max_lon >= min_lon;
+  }
+};
+
+/**
+ * @brief Per-block index of a PBF file, built while tokenizing and persisted
+ * next to it as `<file>.mbi` so later opens can seek straight to the blocks
+ * they need instead of rescanning the file.
+ *
+ * The tokenizer appends entries and decoder workers summarize them
+ * concurrently, access is serialized on the index lock. The sidecar is tied
+ * to the size and mtime of the PBF it was built from, a stale one is
+ * refused on load.
+ */
+class PbfBlockIndex {
+ private:
+  // "MBIX", little endian, followed by the version
+  static constexpr uint32_t kMagic = 0x5849424d;
+  static constexpr uint32_t kVersion = 1;
+  static constexpr size_t kHeaderBytes = 32;
+  static constexpr size_t kEntryBytes = 52;
+
+  static constexpr uint8_t kFlagSummarized = 1;
+
+  mutable absl::Mutex mu_;
+  std::vector<PbfBlockIndexEntry> entries_;
+  uint64_t file_size_;
+  int64_t file_mtime_;
+  bool is_complete_;
+  bool is_dirty_;
+
+  template <typename T>
+  static void Put(std::vector<uint8_t>& out, T value) {
+    auto raw = static_cast<uint64_t>(value);
+    for (size_t i = 0; i < sizeof(T); i++) {
+      out.push_back(static_cast<uint8_t>(raw >> (i * 8)));
+    }
+  }
+
+  template <typename T>
+  static T Get(const uint8_t*& in) {
+    uint64_t raw = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      raw |= static_cast<uint64_t>(in[i]) << (i * 8);
+    }
+
+    in += sizeof(T);
+    return static_cast<T>(raw);
+  }
+
+ public:
+  PbfBlockIndex()
+      : mu_(),
+        entries_(),
+        file_size_(0),
+        file_mtime_(0),
+        is_complete_(false),
+        is_dirty_(false) {}
+
+  ~PbfBlockIndex() {}
+
+  static void SortByOffset(std::vector<PbfBlockIndexEntry>& entries) {
+    std::sort(entries.begin(), entries.end(),
+              [](const PbfBlockIndexEntry& a, const PbfBlockIndexEntry& b) {
+                return a.offset < b.offset;
+              });
+  }
+
+  static std::string SidecarPath(const std::string& file) {
+    return file + ".mbi";
+  }
+
+  static bool StatFile(const std::string& file, uint64_t& size,
+                       int64_t& mtime) {
+    struct stat st;
+    if (::stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) return false;
+
+    size = static_cast<uint64_t>(st.st_size);
+    mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 +
+            st.st_mtim.tv_nsec;
+    return true;
+  }
+
+  /**
+   * @brief Start a new index for `file`, entries of a previous scan are
+   * dropped. Non-regular inputs (pipes, stdin) index fine but can not be
+   * persisted.
+   */
+  void Reset(const std::string& file) {
+    absl::MutexLock lock(&mu_);
+    entries_.clear();
+    file_size_ = 0;
+    file_mtime_ = 0;
+    StatFile(file, file_size_, file_mtime_);
+    is_complete_ = false;
+    is_dirty_ = true;
+  }
+
+  size_t Add(const PbfBlockIndexEntry& entry) {
+    absl::MutexLock lock(&mu_);
+    entries_.push_back(entry);
+    return entries_.size() - 1;
+  }
+
+  bool Summarize(size_t ordinal, const PbfBlockSummary& summary) {
+    absl::MutexLock lock(&mu_);
+    if (ordinal >= entries_.size()) return false;
+
+    entries_[ordinal].summary = summary;
+    entries_[ordinal].is_summarized = true;
+    is_dirty_ = true;
+    return true;
+  }
+
+  // the tokenizer reached the end of the file without errors
+  void SetComplete() {
+    absl::MutexLock lock(&mu_);
+    is_complete_ = true;
+  }
+
+  bool IsComplete() const {
+    absl::MutexLock lock(&mu_);
+    return is_complete_;
+  }
+
+  bool IsDirty() const {
+    absl::MutexLock lock(&mu_);
+    return is_dirty_;
+  }
+
+  size_t Size() const {
+    absl::MutexLock lock(&mu_);
+    return entries_.size();
+  }
+
+  // in ordinal order, concurrent range tokenizers interleave the offsets
+  std::vector<PbfBlockIndexEntry> Entries() const {
+    absl::MutexLock lock(&mu_);
+    return entries_;
+  }
+
+  /**
+   * @brief Blocks holding any of `elements`. Header blocks and blocks that
+   * were never summarized are always kept, they can not be ruled out.
+   */
+  std::vector<PbfBlockIndexEntry> Select(PbfBlockElements elements) const {
+    absl::MutexLock lock(&mu_);
+
+    std::vector<PbfBlockIndexEntry> blocks;
+    for (auto& entry : entries_) {
+      if (entry.type != PbfBlobType::OsmData || !entry.is_summarized ||
+          entry.HasElements(elements)) {
+        blocks.push_back(entry);
+      }
+    }
+
+    SortByOffset(blocks);
+    return blocks;
+  }
+
+  /**
+   * @brief Blocks holding any of `elements` whose node bbox intersects the
+   * given one in degrees. Way and relation blocks carry no coordinates and
+   * are kept when asked for, same as unsummarized blocks.
+   */
+  std::vector<PbfBlockIndexEntry> Select(PbfBlockElements elements,
+                                         double min_lat, double min_lon,
+                                         double max_lat,
+                                         double max_lon) const {
+    auto min_lat_e7 = static_cast<int32_t>(min_lat * 1e7);
+    auto min_lon_e7 = static_cast<int32_t>(min_lon * 1e7);
+    auto max_lat_e7 = static_cast<int32_t>(max_lat * 1e7);
+    auto max_lon_e7 = static_cast<int32_t>(max_lon * 1e7);
+
+    std::vector<PbfBlockIndexEntry> blocks;
+    for (auto& entry : Select(elements)) {
+      if (!entry.is_summarized || !entry.summary.HasBoundingBox() ||
+          entry.Intersects(min_lat_e7, min_lon_e7, max_lat_e7, max_lon_e7)) {
+        blocks.push_back(entry);
+      }
+    }
+
+    return blocks;
+  }
+
+  /**
+   * @brief Write the sidecar. Only a complete index of a regular file is
+   * written, the file is replaced atomically.
+   */
+  bool Save(const std::string& path) {
+    std::vector<uint8_t> out;
+    {
+      absl::MutexLock lock(&mu_);
+      if (!is_complete_ || file_size_ == 0) return false;
+
+      auto entries = entries_;
+      SortByOffset(entries);
+
+      out.reserve(kHeaderBytes + entries.size() * kEntryBytes);
+      Put<uint32_t>(out, kMagic);
+      Put<uint32_t>(out, kVersion);
+      Put<uint64_t>(out, file_size_);
+      Put<int64_t>(out, file_mtime_);
+      Put<uint64_t>(out, entries.size());
+
+      for (auto& entry : entries) {
+        Put<uint64_t>(out, entry.offset);
+        Put<uint32_t>(out, entry.header_size);
+        Put<uint32_t>(out, entry.blob_size);
+        Put<uint8_t>(out, static_cast<uint8_t>(entry.type));
+        Put<uint8_t>(out, entry.is_summarized ? kFlagSummarized : 0);
+        Put<uint8_t>(out, static_cast<uint8_t>(entry.summary.elements));
+        Put<uint8_t>(out, 0);
+        Put<int32_t>(out, entry.summary.min_lat);
+        Put<int32_t>(out, entry.summary.min_lon);
+        Put<int32_t>(out, entry.summary.max_lat);
+        Put<int32_t>(out, entry.summary.max_lon);
+        Put<int64_t>(out, entry.summary.min_id);
+        Put<int64_t>(out, entry.summary.max_id);
+      }
+    }
+
+    auto temp = path + ".tmp";
+    {
+      std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+      if (!file.is_open()) return false;
+
+      file.write(reinterpret_cast<const char*>(out.data()), out.size());
+      if (!file.good()) {
+        file.close();
+        std::remove(temp.c_str());
+        return false;
+      }
+    }
+
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+      std::remove(temp.c_str());
+      return false;
+    }
+
+    absl::MutexLock lock(&mu_);
+    is_dirty_ = false;
+    return true;
+  }
+
+  /**
+   * @brief Load the sidecar at `path` built from `file`. Fails, leaving the
+   * index untouched, when the sidecar is missing, corrupt or older than
+   * the file.
+   */
+  bool Load(const std::string& path, const std::string& file) {
+    uint64_t file_size = 0;
+    int64_t file_mtime = 0;
+    if (!StatFile(file, file_size, file_mtime)) return false;
+
+    std::ifstream stream(path, std::ios::binary | std::ios::ate);
+    if (!stream.is_open()) return false;
+
+    auto size = static_cast<size_t>(stream.tellg());
+    if (size < kHeaderBytes) return false;
+
+    std::vector<uint8_t> in(size);
+    stream.seekg(0, std::ios::beg);
+    if (!stream.read(reinterpret_cast<char*>(in.data()), size)) return false;
+
+    const uint8_t* cursor = in.data();
+    if (Get<uint32_t>(cursor) != kMagic) return false;
+    if (Get<uint32_t>(cursor) != kVersion) return false;
+    if (Get<uint64_t>(cursor) != file_size) return false;
+    if (Get<int64_t>(cursor) != file_mtime) return false;
+
+    auto count = Get<uint64_t>(cursor);
+    if (count > (size - kHeaderBytes) / kEntryBytes ||
+        size != kHeaderBytes + count * kEntryBytes) {
+      return false;
+    }
+
+    std::vector<PbfBlockIndexEntry> entries;
+    entries.reserve(count);
+    for (uint64_t i = 0; i < count; i++) {
+      auto entry = PbfBlockIndexEntry();
+      entry.offset = Get<uint64_t>(cursor);
+      entry.header_size = Get<uint32_t>(cursor);
+      entry.blob_size = Get<uint32_t>(cursor);
+      entry.type = static_cast<PbfBlobType>(Get<uint8_t>(cursor));
+      entry.is_summarized = (Get<uint8_t>(cursor) & kFlagSummarized) != 0;
+      entry.summary.elements =
+          static_cast<PbfBlockElements>(Get<uint8_t>(cursor));
+      Get<uint8_t>(cursor);
+      entry.summary.min_lat = Get<int32_t>(cursor);
+      entry.summary.min_lon = Get<int32_t>(cursor);
+      entry.summary.max_lat = Get<int32_t>(cursor);
+      entry.summary.max_lon = Get<int32_t>(cursor);
+      entry.summary.min_id = Get<int64_t>(cursor);
+      entry.summary.max_id = Get<int64_t>(cursor);
+
+      if (entry.End() > file_size) return false;
+      entries.push_back(entry);
+    }
+
+    absl::MutexLock lock(&mu_);
+    entries_ = std::move(entries);
+    file_size_ = file_size;
+    file_mtime_ = file_mtime;
+    is_complete_ = true;
+    is_dirty_ = false;
+    return true;
+  }
+};
+
+}  // namespace pbf
+}  // namespace osm
+}  // namespace v1
+}  // namespace mavix
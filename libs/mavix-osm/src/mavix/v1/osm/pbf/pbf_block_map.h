@@ -19,12 +19,10 @@ class PbfBlockMap {
  public:
   PbfBlockMap(const std::streampos &header_start, const size_t &header_size,
               const std::streampos &raw_start, const size_t &raw_size)
-      : header_size_(size_t(header_size)),
-        raw_pbf_size_(size_t(raw_size)),
-        raw_pbf_start_(std::streampos(header_start)),
-        header_start_(std::streampos(raw_size)){
-
-        };
+      : header_start_(std::streampos(header_start)),
+        raw_pbf_start_(std::streampos(raw_start)),
+        header_size_(size_t(header_size)),
+        raw_pbf_size_(size_t(raw_size)){};
         
   ~PbfBlockMap(){
 
@@ -2,9 +2,10 @@
 
 #include <mavix/v1/core/core.h>
 
+#include <cstdint>
 #include <sstream>
 
-#include "mavix/v1/core/memory_buffer.h"
+#include "mavix/v1/core/buffer_slice.h"
 #include "osmpbf/osmpbf.h"
 
 namespace mavix {
@@ -15,13 +16,20 @@ using namespace mavix::v1::core;
 struct PbfBlobData {
   OSMPBF::BlobHeader header;
   OSMPBF::Blob blob;
-  std::shared_ptr<MemoryBuffer> blob_data;
+  // compressed payload moved out of `blob`, freed with the last reference
+  BufferSlice blob_data;
+  // entry in the PbfBlockIndex being built, -1 when not indexed
+  int64_t block_ordinal;
 
-  PbfBlobData() : header(), blob(), blob_data() {}
+  PbfBlobData() : header(), blob(), blob_data(), block_ordinal(-1) {}
 
   PbfBlobData(OSMPBF::BlobHeader header, OSMPBF::Blob blob,
-              std::shared_ptr<MemoryBuffer> blob_data)
-      : header(header), blob(blob), blob_data(blob_data) {}
+              BufferSlice blob_data,
+              int64_t block_ordinal = -1)
+      : header(std::move(header)),
+        blob(std::move(blob)),
+        blob_data(std::move(blob_data)),
+        block_ordinal(block_ordinal) {}
 
   
   std::string ToString() {
@@ -29,7 +37,7 @@ struct PbfBlobData {
     info << "PbfBlobData {"
          << "header=" << header.type() << ", datasize=" << header.datasize()
          << ", size=" << header.ByteSizeLong()
-         << ", blob: " << (blob_data ? blob_data->Size() : 0) << "}"
+         << ", blob: " << blob_data.Size() << "}"
          << std::endl;
 
     return std::move(info.str());
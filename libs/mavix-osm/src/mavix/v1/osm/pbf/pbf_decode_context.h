@@ -0,0 +1,220 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+
+#include <google/protobuf/arena.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include "mavix/v1/core/memory/block_arena.h"
+#include "mavix/v1/core/memory/memory_governor.h"
+#include "mavix/v1/osm/element_type.h"
+#include "mavix/v1/utils/lz4_compression.h"
+#include "mavix/v1/utils/lzma_compression.h"
+#include "mavix/v1/utils/zlib_compression.h"
+#include "mavix/v1/utils/zstd_compression.h"
+#include "osmpbf/osmpbf.h"
+
+namespace mavix {
+namespace v1 {
+namespace osm {
+namespace pbf {
+
+namespace protobuf = google::protobuf;
+
+// key and value point into the string table of the decoded PrimitiveBlock
+struct PbfTag {
+  std::string_view key;
+  std::string_view value;
+};
+
+struct PbfNode {
+  int64_t id;
+  double lat;
+  double lon;
+  const PbfTag* tags;
+  uint32_t tag_count;
+};
+
+struct PbfWay {
+  int64_t id;
+  const PbfTag* tags;
+  uint32_t tag_count;
+  const int64_t* refs;
+  uint32_t ref_count;
+};
+
+struct PbfRelationMember {
+  int64_t ref;
+  ElementType type;
+  std::string_view role;
+};
+
+struct PbfRelation {
+  int64_t id;
+  const PbfTag* tags;
+  uint32_t tag_count;
+  const PbfRelationMember* members;
+  uint32_t member_count;
+};
+
+/**
+ * @brief Per-worker storage for decoding one block at a time.
+ *
+ * The protobuf messages are parsed into a protobuf Arena, tag, ref and
+ * member arrays come from a BlockArena and the element lists keep their
+ * capacity, so decoding a block makes next to no allocator calls once the
+ * worker warmed up. Blobs with a known raw size are inflated into a scratch
+ * buffer, through an inflate state that is reset, not recreated, per block.
+ * The scratch grows up to the OSM PBF blob limit and drops back to a
+ * typical block size after an outsized one. Everything handed out is valid
+ * until Reset(), which releases the whole block at once.
+ *
+ * The footprint kept between blocks is charged to MemoryCategory::Decode.
+ */
+class PbfDecodeContext {
+ public:
+  // OSM PBF specification limit for the uncompressed size of a blob
+  static constexpr size_t kMaxInflateSize = 32 * 1024 * 1024;
+
+ private:
+  // inflate scratch kept between blocks, most blocks inflate to 1-2 MB
+  static constexpr size_t kRetainedInflateSize = 4 * 1024 * 1024;
+
+  // covers the parsed PrimitiveBlock of a typical 8000 element block
+  static constexpr size_t kInitialProtoBlockSize = 4 * 1024 * 1024;
+  static constexpr size_t kMaxProtoBlockSize = 8 * 1024 * 1024;
+
+  std::unique_ptr<char[]> proto_block_;
+  std::unique_ptr<protobuf::Arena> proto_arena_;
+  core::memory::BlockArena block_arena_;
+  std::vector<PbfNode> nodes_;
+  std::vector<PbfWay> ways_;
+  std::vector<PbfRelation> relations_;
+  std::unique_ptr<uint8_t[]> inflate_buffer_;
+  size_t inflate_capacity_;
+  utils::ZlibCompression zlib_;
+  utils::Lz4Compression lz4_;
+  utils::LzmaCompression lzma_;
+  utils::ZstdCompression zstd_;
+  size_t charged_;
+
+  size_t Footprint() const {
+    return std::max<size_t>(proto_arena_->SpaceAllocated(),
+                            kInitialProtoBlockSize) +
+           block_arena_.Reserved() + inflate_capacity_ +
+           nodes_.capacity() * sizeof(PbfNode) +
+           ways_.capacity() * sizeof(PbfWay) +
+           relations_.capacity() * sizeof(PbfRelation);
+  }
+
+  static protobuf::ArenaOptions ProtoArenaOptions(char* initial_block) {
+    protobuf::ArenaOptions options;
+    options.initial_block = initial_block;
+    options.initial_block_size = kInitialProtoBlockSize;
+    options.start_block_size = kInitialProtoBlockSize;
+    options.max_block_size = kMaxProtoBlockSize;
+    return options;
+  }
+
+ public:
+  PbfDecodeContext()
+      : proto_block_(new char[kInitialProtoBlockSize]),
+        proto_arena_(std::make_unique<protobuf::Arena>(
+            ProtoArenaOptions(proto_block_.get()))),
+        block_arena_(1024 * 1024, 4),
+        nodes_(),
+        ways_(),
+        relations_(),
+        inflate_buffer_(nullptr),
+        inflate_capacity_(0),
+        zlib_(),
+        lz4_(),
+        lzma_(),
+        zstd_(),
+        charged_(0) {}
+
+  ~PbfDecodeContext() {
+    core::memory::MemoryGovernor::Global().Release(
+        core::memory::MemoryCategory::Decode, charged_);
+
+    // the arena must go before the initial block it was given
+    proto_arena_.reset();
+  }
+
+  template <typename TMessage>
+  TMessage* NewMessage() {
+    return protobuf::Arena::CreateMessage<TMessage>(proto_arena_.get());
+  }
+
+  core::memory::BlockArena& Arena() { return block_arena_; }
+
+  std::vector<PbfNode>& Nodes() { return nodes_; }
+
+  std::vector<PbfWay>& Ways() { return ways_; }
+
+  std::vector<PbfRelation>& Relations() { return relations_; }
+
+  /**
+   * @brief Scratch for the inflated block, at least `size` bytes, nullptr
+   * above kMaxInflateSize. The content does not survive the next call.
+   */
+  uint8_t* InflateBuffer(size_t size) {
+    if (size > kMaxInflateSize) return nullptr;
+
+    // an outsized block is not kept once ordinary blocks follow
+    if (inflate_capacity_ > kRetainedInflateSize &&
+        size <= kRetainedInflateSize) {
+      inflate_buffer_.reset(new uint8_t[kRetainedInflateSize]);
+      inflate_capacity_ = kRetainedInflateSize;
+    }
+
+    if (size > inflate_capacity_) {
+      // not value-initialized, inflate overwrites every byte it reports
+      inflate_buffer_.reset(new uint8_t[size]);
+      inflate_capacity_ = size;
+    }
+
+    return inflate_buffer_.get();
+  }
+
+  utils::ZlibCompression& Zlib() { return zlib_; }
+
+  utils::Lz4Compression& Lz4() { return lz4_; }
+
+  utils::LzmaCompression& Lzma() { return lzma_; }
+
+  utils::ZstdCompression& Zstd() { return zstd_; }
+
+  /**
+   * @brief Release everything decoded since the last Reset(), the parsed
+   * messages and every element view become invalid.
+   */
+  void Reset() {
+    auto footprint = Footprint();
+    if (footprint > charged_) {
+      core::memory::MemoryGovernor::Global().Charge(
+          core::memory::MemoryCategory::Decode, footprint - charged_);
+      charged_ = footprint;
+    } else if (footprint < charged_) {
+      core::memory::MemoryGovernor::Global().Release(
+          core::memory::MemoryCategory::Decode, charged_ - footprint);
+      charged_ = footprint;
+    }
+
+    nodes_.clear();
+    ways_.clear();
+    relations_.clear();
+    block_arena_.Reset();
+    proto_arena_->Reset();
+  }
+};
+
+}  // namespace pbf
+}  // namespace osm
+}  // namespace v1
+}  // namespace mavix
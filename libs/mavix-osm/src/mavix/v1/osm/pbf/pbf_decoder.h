@@ -15,7 +15,9 @@
 #include "mavix/v1/osm/formats/osm_file_header.h"
 #include "mavix/v1/osm/formats/relation.h"
 #include "mavix/v1/osm/formats/way.h"
+#include "mavix/v1/osm/pbf/pbf_block_index.h"
 #include "mavix/v1/osm/pbf/pbf_declare.h"
+#include "mavix/v1/osm/pbf/pbf_decode_context.h"
 #include "mavix/v1/osm/pbf/pbf_field_decoder.h"
 #include "mavix/v1/osm/skip_options.h"
 #include "mavix/v1/utils/compression.h"
@@ -43,36 +45,60 @@ enum class PbfBlobCompressionType {
 
 class PbfDecoder {
  public:
-  explicit PbfDecoder(std::shared_ptr<PbfBlobData> data, SkipOptions options)
+  /**
+   * @brief Decode `data` into `context`, typically owned by the worker and
+   * reset once the block is released. Without a context the decoder uses
+   * one of its own.
+   */
+  explicit PbfDecoder(std::shared_ptr<PbfBlobData> data, SkipOptions options,
+                      bool summarize = false,
+                      PbfDecodeContext *context = nullptr)
       : mu_(),
         data_(data),
         isDataValid_(false),
         skip_options_(options),
+        summarize_(summarize),
+        summary_(),
+        owned_context_(context ? nullptr
+                               : std::make_unique<PbfDecodeContext>()),
+        context_(context ? context : owned_context_.get()),
         compression_type_(PbfBlobCompressionType::None),
-        raw_uncompressed_(nullptr),
+        raw_uncompressed_(),
         elements_(std::make_shared<std::vector<ElementBase>>()){
             // elements_->reserve(50);
         };
 
   ~PbfDecoder() {
     elements_->clear();
-    if (raw_uncompressed_ &&
-        compression_type_ == PbfBlobCompressionType::Zlib) {
-      // std::cout << "Decoder finalized" << std::endl;
-      raw_uncompressed_->Destroy();
-      raw_uncompressed_ = nullptr;
-    }
     data_ = nullptr;
   };
 
+  /**
+   * @brief Decoded elements as ElementBase, built from the context views on
+   * first call. Prefer Nodes()/Ways()/Relations() on hot paths.
+   */
   std::shared_ptr<std::vector<ElementBase>> Elements() const {
+    if (elements_->size() == header_elements_) ComposeElements();
     return elements_;
   }
 
+  // views valid until the context is reset
+  const std::vector<PbfNode> &Nodes() const { return context_->Nodes(); }
+
+  const std::vector<PbfWay> &Ways() const { return context_->Ways(); }
+
+  const std::vector<PbfRelation> &Relations() const {
+    return context_->Relations();
+  }
+
   std::shared_ptr<PbfBlobData> PbfBlob() { return data_; }
 
+  // filled by Run() when the decoder was created with `summarize`
+  const PbfBlockSummary &Summary() const { return summary_; }
+
   void Run() {
     elements_->clear();
+    header_elements_ = 0;
 
     bool is_raw_available = GetBufferUncompressed();
     if (data_->header.type() == "OSMHeader" && is_raw_available) {
@@ -89,11 +115,47 @@ class PbfDecoder {
   absl::Mutex mu_;
   std::shared_ptr<std::vector<ElementBase>> elements_;
   std::shared_ptr<PbfBlobData> data_;
-  std::shared_ptr<MemoryBuffer> raw_uncompressed_;
+  // the payload itself for raw blobs, otherwise the inflated block in the
+  // context scratch, or an owned copy when the raw size was unusable
+  BufferSlice raw_uncompressed_;
   bool isDataValid_;
   SkipOptions skip_options_;
+  bool summarize_;
+  PbfBlockSummary summary_;
+  std::unique_ptr<PbfDecodeContext> owned_context_;
+  PbfDecodeContext *context_;
+  size_t header_elements_ = 0;
   PbfBlobCompressionType compression_type_;
 
+  template <typename TCodec>
+  bool InflatePayload(TCodec &codec) {
+    auto &payload = data_->blob_data;
+
+    // the size is known, inflate in one go into the context scratch
+    auto raw_size = static_cast<size_t>(std::max(0, data_->blob.raw_size()));
+    if (raw_size > PbfDecodeContext::kMaxInflateSize) {
+      std::cerr << "Blob raw_size " << raw_size << " exceeds the "
+                << PbfDecodeContext::kMaxInflateSize << " bytes limit"
+                << std::endl;
+      return false;
+    }
+
+    if (raw_size > 0) {
+      auto dest = context_->InflateBuffer(raw_size);
+      if (codec.InflateInto(payload.Data(), payload.Size(), dest, raw_size)) {
+        raw_uncompressed_ = BufferSlice(dest, raw_size, nullptr);
+        return true;
+      }
+    }
+
+    // raw_size missing or wrong, let the codec find the size itself
+    bool state;
+    raw_uncompressed_ = BufferSlice::FromMemoryBuffer(
+        codec.Inflate(payload.Data(), payload.Size(), 0, state));
+
+    return state;
+  }
+
   bool GetBufferUncompressed() {
     if (compression_type_ != PbfBlobCompressionType::None) return false;
 
@@ -107,14 +169,20 @@ class PbfDecoder {
 
     } else if (data_->blob.has_zlib_data()) {
       compression_type_ = PbfBlobCompressionType::Zlib;
+      return InflatePayload(context_->Zlib());
+
+    } else if (data_->blob.has_lzma_data()) {
+      compression_type_ = PbfBlobCompressionType::Lzma;
+      return InflatePayload(context_->Lzma());
 
-      auto zlib = GetCompression<ZlibCompression>();
-      bool state;
+    } else if (data_->blob.has_lz4_data()) {
+      compression_type_ = PbfBlobCompressionType::Lz4;
+      return InflatePayload(context_->Lz4());
 
-      raw_uncompressed_ = zlib.Inflate(data_->blob_data->Data(),
-                                       data_->blob_data->Size(), state);
+    } else if (data_->blob.has_zstd_data()) {
+      compression_type_ = PbfBlobCompressionType::ZStd;
+      return InflatePayload(context_->Zstd());
 
-      return state;
     } else {
       // Not yet supported
       throw std::runtime_error("Compresion not supported");
@@ -122,9 +190,9 @@ class PbfDecoder {
   }
 
   void ProcessOsmHeader() {
-    auto pbf_header = OSMPBF::HeaderBlock();
-    auto is_parsed = pbf_header.ParseFromArray(raw_uncompressed_->Data(),
-                                               raw_uncompressed_->Size());
+    auto &pbf_header = *context_->NewMessage<OSMPBF::HeaderBlock>();
+    auto is_parsed = pbf_header.ParseFromArray(raw_uncompressed_.Data(),
+                                               raw_uncompressed_.Size());
     //     if (!is_parsed) {
     // #if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_PBF_DECODER)
     //       std::cerr << "OsmHeader: parsed from bytes failed" << std::endl;
@@ -169,12 +237,13 @@ class PbfDecoder {
 
     elements_->emplace_back(std::move(header_file));
     // elements_->emplace_back(std::move(bound));
+    header_elements_ = elements_->size();
   }
 
   void ProcessOsmPrimitives() {
-    auto primitive_block = OSMPBF::PrimitiveBlock();
-    auto is_parsed = primitive_block.ParseFromArray(raw_uncompressed_->Data(),
-                                                    raw_uncompressed_->Size());
+    auto &primitive_block = *context_->NewMessage<OSMPBF::PrimitiveBlock>();
+    auto is_parsed = primitive_block.ParseFromArray(raw_uncompressed_.Data(),
+                                                    raw_uncompressed_.Size());
     if (!is_parsed) {
 #if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_PBF_DECODER)
       std::cerr << "Failed parsing PRIMITIVE GROUPS from bytes stream"
@@ -183,6 +252,8 @@ class PbfDecoder {
       return;
     }
 
+    if (summarize_) SummarizePrimitiveBlock(primitive_block);
+
     auto pbf_field_decoder = PbfFieldDecoder(primitive_block);
 
     auto is_skip_nodes =
@@ -200,8 +271,6 @@ class PbfDecoder {
 
     for (auto &pg : primitive_block.primitivegroup()) {
       if (!is_skip_nodes) {
-        // !TODO: Implement overload method ProcessNodes for Dense Nodes
-
         ProcessNodes(pg.dense(), pbf_field_decoder);
         ProcessNodes(pg.nodes(), pbf_field_decoder);
       }
@@ -210,244 +279,260 @@ class PbfDecoder {
         ProcessWays(pg.ways(), pbf_field_decoder);
       }
 
-      // if (!is_skip_relations) {
-      //   ProcessRelations(pg.relations(), pbf_field_decoder);
-      // }
+      if (!is_skip_relations) {
+        ProcessRelations(pg.relations(), pbf_field_decoder);
+      }
     }
   }
 
-  Option<absl::node_hash_map<std::string, BasicElementProperty>> ComposeTags(
-      const protobuf::RepeatedField<uint32_t> &keys,
-      const protobuf::RepeatedField<uint32_t> &values,
-      const PbfFieldDecoder &field_decoder) {
-    if (keys.size() != values.size()) {
-      return Option<absl::node_hash_map<std::string, BasicElementProperty>>();
-    }
+  /**
+   * @brief Collect element kinds, node bbox and id range for the block
+   * index. Walks every group regardless of the skip options.
+   */
+  void SummarizePrimitiveBlock(const OSMPBF::PrimitiveBlock &block) {
+    summary_ = PbfBlockSummary();
+
+    int64_t granularity = block.granularity();
+    int64_t lat_offset = block.lat_offset();
+    int64_t lon_offset = block.lon_offset();
+
+    for (auto &pg : block.primitivegroup()) {
+      auto &dense = pg.dense();
+      if (dense.id_size() == dense.lat_size() &&
+          dense.id_size() == dense.lon_size()) {
+        int64_t id = 0;
+        int64_t lat = 0;
+        int64_t lon = 0;
+        for (int i = 0; i < dense.id_size(); i++) {
+          id += dense.id(i);
+          lat += dense.lat(i);
+          lon += dense.lon(i);
+          summary_.AddNode(id, lat_offset + granularity * lat,
+                           lon_offset + granularity * lon);
+        }
+      }
 
-    auto key_iterator = keys.begin();
-    auto value_iterator = values.begin();
+      for (auto &node : pg.nodes()) {
+        summary_.AddNode(node.id(), lat_offset + granularity * node.lat(),
+                         lon_offset + granularity * node.lon());
+      }
 
-    absl::node_hash_map<std::string, BasicElementProperty> tags;
+      for (auto &way : pg.ways()) {
+        summary_.AddElement(PbfBlockElements::Ways, way.id());
+      }
 
-    while (key_iterator != keys.end() && value_iterator != values.end()) {
-      auto key = field_decoder.GetString(*key_iterator).unwrap();
-      auto value = field_decoder.GetString(*value_iterator).unwrap();
-      tags.emplace(
-          std::move(key),
-          ElementProperty<std::string>(
-              std::move(value), KnownPropertyType::String, std::string()));
+      for (auto &relation : pg.relations()) {
+        summary_.AddElement(PbfBlockElements::Relations, relation.id());
+      }
+    }
+  }
 
-      key_iterator++;
-      value_iterator++;
+  // key/value string ids into an arena array of views
+  const PbfTag *ComposeTags(const protobuf::RepeatedField<uint32_t> &keys,
+                            const protobuf::RepeatedField<uint32_t> &values,
+                            const PbfFieldDecoder &field_decoder,
+                            uint32_t &count) {
+    count = 0;
+    if (keys.size() != values.size() || keys.empty()) return nullptr;
+
+    auto tags = context_->Arena().AllocateArray<PbfTag>(keys.size());
+    for (int i = 0; i < keys.size(); i++) {
+      tags[i].key = field_decoder.GetStringView(keys.Get(i));
+      tags[i].value = field_decoder.GetStringView(values.Get(i));
     }
 
-    return Option<absl::node_hash_map<std::string, BasicElementProperty>>(
-        std::move(tags));
+    count = static_cast<uint32_t>(keys.size());
+    return tags;
   }
 
   void ProcessNodes(const protobuf::RepeatedPtrField<OSMPBF::Node> &nodes,
                     const PbfFieldDecoder &field_decoder) {
     if (nodes.size() == 0) return;
     std::cout << "Nodes count: " << nodes.size() << std::endl;
-    for (auto &node : nodes) {
-      auto tags = ComposeTags(node.keys(), node.vals(), field_decoder);
-
-      auto osm_node = formats::Node(
-          node.id(), field_decoder.DecodeLatitude(node.lat()),
-          field_decoder.DecodeLongitude(node.lon()), std::move(tags.unwrap()));
 
-#if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_PBF_DECODER)
-      std::cout << osm_node.ToString() << std::endl;
-#endif
-      elements_->emplace_back(std::move(osm_node));
+    auto &out = context_->Nodes();
+    for (auto &node : nodes) {
+      auto osm_node = PbfNode();
+      osm_node.id = node.id();
+      osm_node.lat = field_decoder.DecodeLatitude(node.lat());
+      osm_node.lon = field_decoder.DecodeLongitude(node.lon());
+      osm_node.tags = ComposeTags(node.keys(), node.vals(), field_decoder,
+                                  osm_node.tag_count);
+
+      out.push_back(osm_node);
     }
   }
 
   void ProcessNodes(const OSMPBF::DenseNodes &node,
-                    PbfFieldDecoder field_decoder) {
+                    const PbfFieldDecoder &field_decoder) {
     if (node.id_size() == 0) return;
     std::cout << "Dense Nodes count: " << node.id_size() << std::endl;
 
-    auto ids = node.id();
-    auto lats = node.lat();
-    auto lons = node.lon();
-
     if (node.id_size() != node.lon_size() ||
         node.id_size() != node.lat_size()) {
       return;
     }
 
-    auto kv_iterator = node.keys_vals().begin();
+    // keys_vals holds (key, value)* 0 per node, or nothing when no node in
+    // the block has tags
+    auto &kv = node.keys_vals();
+    auto kv_count = kv.size();
+    auto tags = kv_count > 0
+                    ? context_->Arena().AllocateArray<PbfTag>(kv_count / 2)
+                    : nullptr;
+    int kv_index = 0;
+    uint32_t tag_index = 0;
+
+    auto &out = context_->Nodes();
+    out.reserve(out.size() + node.id_size());
 
     int64_t node_id = 0;
     int64_t lat = 0;
     int64_t lon = 0;
 
-    for (size_t i = 0; i < node.id_size(); i++) {
-      node_id += ids.at(i);
-      lat += lats.at(i);
-      lon += lons.at(i);
-
-      absl::node_hash_map<std::string, BasicElementProperty> tags;
-      while (kv_iterator != node.keys_vals().end()) {
-        auto key_index = *kv_iterator;
-        if (key_index == 0) {
-          break;
-        }
-
-        kv_iterator++;
-        auto value_index = *kv_iterator;
-
-        kv_iterator++;
+    for (int i = 0; i < node.id_size(); i++) {
+      node_id += node.id(i);
+      lat += node.lat(i);
+      lon += node.lon(i);
+
+      auto osm_node = PbfNode();
+      osm_node.id = node_id;
+      osm_node.lat = field_decoder.DecodeLatitude(lat);
+      osm_node.lon = field_decoder.DecodeLongitude(lon);
+      osm_node.tags = tags ? tags + tag_index : nullptr;
+      osm_node.tag_count = 0;
+
+      while (kv_index < kv_count) {
+        auto key_index = kv.Get(kv_index++);
+        if (key_index == 0 || kv_index >= kv_count) break;
+
+        auto value_index = kv.Get(kv_index++);
+        tags[tag_index].key = field_decoder.GetStringView(key_index);
+        tags[tag_index].value = field_decoder.GetStringView(value_index);
+        tag_index++;
+        osm_node.tag_count++;
       }
 
-      auto osm_node =
-          formats::Node(node_id, field_decoder.DecodeLatitude(lat),
-                        field_decoder.DecodeLongitude(lon), std::move(tags));
-
-      elements_->emplace_back(std::move(osm_node));
+      out.push_back(osm_node);
     }
-
-    // Map<String, Object> tags = null;
-    // while (keysValuesIterator.hasNext()) {
-    //   int keyIndex = keysValuesIterator.next();
-    //   if (keyIndex == 0) {
-    //     break;
-    //   }
-    //   if (checkData) {
-    //     if (!keysValuesIterator.hasNext()) {
-    //       throw new RuntimeException(
-    //           "The PBF DenseInfo keys/values list contains a key with no "
-    //           "corresponding value.");
-    //     }
-    //   }
-    //   int valueIndex = keysValuesIterator.next();
-
-    //   if (tags == null) {
-    //     // divide by 2 as key&value, multiple by 2 because of the better
-    //     // approximation
-    //     tags = new HashMap<>(Math.max(
-    //         3, 2 * (nodes.getKeysValsList().size() / 2) / idList.size()));
-    //   }
-
-    //   tags.put(fieldDecoder.decodeString(keyIndex),
-    //            fieldDecoder.decodeString(valueIndex));
-    // }
-
-    // ReaderNode node =
-    //     new ReaderNode(nodeId, fieldDecoder.decodeLatitude(latitude),
-    //                    fieldDecoder.decodeLongitude(longitude));
-    // node.setTags(tags);
-
-    // // Add the bound object to the results.
-    // decodedEntities.add(node);
-    //}
   }
 
   void ProcessWays(const protobuf::RepeatedPtrField<OSMPBF::Way> &ways,
                    const PbfFieldDecoder &field_decoder) {
     if (ways.size() == 0) return;
     std::cout << "Ways count: " << ways.size() << std::endl;
-    for (auto &way : ways) {
-      auto tags = ComposeTags(way.keys(), way.vals(), field_decoder);
 
-      auto osm_way = formats::Way(way.id(), std::move(tags.unwrap()));
-      osm_way.InitializeNodes(way.refs_size());
+    auto &out = context_->Ways();
+    for (auto &way : ways) {
+      auto osm_way = PbfWay();
+      osm_way.id = way.id();
+      osm_way.tags = ComposeTags(way.keys(), way.vals(), field_decoder,
+                                 osm_way.tag_count);
 
       // The node ids are delta encoded.
       // id is stored as a delta against
       // the previous one.
-
+      auto refs = context_->Arena().AllocateArray<int64_t>(way.refs_size());
       int64_t node_id = 0;
-      for (auto &node_offset_id : way.refs()) {
-        node_id += node_offset_id;
-        osm_way.Nodes().emplace_back(node_id);
+      for (int i = 0; i < way.refs_size(); i++) {
+        node_id += way.refs(i);
+        refs[i] = node_id;
       }
 
-#if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_PBF_DECODER)
-      // std::cout << osm_way.ToString() << std::endl;
-#endif
+      osm_way.refs = refs;
+      osm_way.ref_count = static_cast<uint32_t>(way.refs_size());
+      out.push_back(osm_way);
+    }
+  }
 
-      elements_->emplace_back(std::move(osm_way));
+  static ElementType GetMemberType(int32_t member_type) {
+    if (member_type == OSMPBF::Relation_MemberType::Relation_MemberType_WAY) {
+      return ElementType::Way;
+    } else if (member_type ==
+               OSMPBF::Relation_MemberType::Relation_MemberType_RELATION) {
+      return ElementType::Relation;
+    } else if (member_type ==
+               OSMPBF::Relation_MemberType::Relation_MemberType_NODE) {
+      return ElementType::Node;
     }
+
+    return ElementType::Unknown;
   }
 
-  bool ComposeRelationMembers(
-      formats::Relation &relation,
-      const protobuf::RepeatedField<int64_t> &member_ids,
-      const protobuf::RepeatedField<int32_t> &member_roles,
-      const protobuf::RepeatedField<int32_t> &member_types,
+  void ProcessRelations(
+      const protobuf::RepeatedPtrField<OSMPBF::Relation> &relations,
       const PbfFieldDecoder &field_decoder) {
-    if ((member_ids.size() != member_roles.size()) ||
-        (member_ids.size() != member_types.size())) {
-      return false;
-    }
+    if (relations.size() == 0) return;
+    std::cout << "Relations count: " << relations.size() << std::endl;
 
-    auto member_id_iterator = member_ids.begin();
-    auto member_role_iterator = member_roles.begin();
-    auto member_type_iterator = member_types.begin();
-
-    // The member ids are delta encoded.
-    // id is stored as a delta against
-    // the previous one.
-    int64_t ref_id = 0;
-    while (member_id_iterator != member_ids.end() &&
-           member_role_iterator != member_roles.end() &&
-           member_type_iterator != member_types.end()) {
-      auto member_id = *member_id_iterator;
-      auto member_role = *member_role_iterator;
-      auto member_type = *member_type_iterator;
-
-      ref_id += member_id;
-      ElementType type = ElementType::Unknown;
-      if (member_type == OSMPBF::Relation_MemberType::Relation_MemberType_WAY) {
-        type = ElementType::Way;
-      } else if (member_type ==
-                 OSMPBF::Relation_MemberType::Relation_MemberType_RELATION) {
-        type = ElementType::Relation;
-      } else if (member_type ==
-                 OSMPBF::Relation_MemberType::Relation_MemberType_NODE) {
-        type = ElementType::Node;
-      }
+    auto &out = context_->Relations();
+    for (auto &relation : relations) {
+      auto osm_relation = PbfRelation();
+      osm_relation.id = relation.id();
+      osm_relation.tags = ComposeTags(relation.keys(), relation.vals(),
+                                      field_decoder, osm_relation.tag_count);
+      osm_relation.members = nullptr;
+      osm_relation.member_count = 0;
+
+      auto member_count = relation.memids_size();
+      if (member_count == relation.roles_sid_size() &&
+          member_count == relation.types_size() && member_count > 0) {
+        auto members =
+            context_->Arena().AllocateArray<PbfRelationMember>(member_count);
+
+        // The member ids are delta encoded.
+        int64_t ref_id = 0;
+        for (int i = 0; i < member_count; i++) {
+          ref_id += relation.memids(i);
+          members[i].ref = ref_id;
+          members[i].type = GetMemberType(relation.types(i));
+          members[i].role = field_decoder.GetStringView(relation.roles_sid(i));
+        }
 
-      if (type == ElementType::Unknown) {
-        return false;
+        osm_relation.members = members;
+        osm_relation.member_count = static_cast<uint32_t>(member_count);
       }
 
-      auto member = formats::RelationMember(
-          type, ref_id, field_decoder.GetString(member_role).unwrap());
-
-      relation.Add(std::move(member));
+      out.push_back(osm_relation);
+    }
+  }
 
-      elements_->emplace_back(std::move(relation));
-      member_id_iterator++;
-      member_role_iterator++;
-      member_type_iterator++;
+  static absl::node_hash_map<std::string, BasicElementProperty> ToTags(
+      const PbfTag *tags, uint32_t count) {
+    absl::node_hash_map<std::string, BasicElementProperty> properties;
+    for (uint32_t i = 0; i < count; i++) {
+      properties.emplace(
+          std::string(tags[i].key),
+          ElementProperty<std::string>(std::string(tags[i].value),
+                                       KnownPropertyType::String,
+                                       std::string()));
     }
 
-    return true;
+    return properties;
   }
 
-  void ProcessRelations(
-      const protobuf::RepeatedPtrField<OSMPBF::Relation> &relations,
-      const PbfFieldDecoder &field_decoder) {
-        if (relations.size() == 0) return;
-    std::cout << "Relations count: " << relations.size() << std::endl;
-
-    for (auto &relation : relations) {
-      auto tags = ComposeTags(relation.keys(), relation.vals(), field_decoder);
+  void ComposeElements() const {
+    for (auto &node : context_->Nodes()) {
+      elements_->emplace_back(formats::Node(node.id, node.lat, node.lon,
+                                            ToTags(node.tags, node.tag_count)));
+    }
 
-      // std::cout << "Rel Tags:" << tags.unwrap().size() << std::endl;
-      auto osm_relation =
-          formats::Relation(relation.id(), std::move(tags.unwrap()));
+    for (auto &way : context_->Ways()) {
+      auto osm_way = formats::Way(way.id, ToTags(way.tags, way.tag_count));
+      osm_way.InitializeNodes(way.ref_count);
+      osm_way.Nodes().assign(way.refs, way.refs + way.ref_count);
+      elements_->emplace_back(std::move(osm_way));
+    }
 
-      ComposeRelationMembers(osm_relation, relation.memids(),
-                             relation.roles_sid(), relation.types(),
-                             field_decoder);
+    for (auto &relation : context_->Relations()) {
+      auto osm_relation = formats::Relation(
+          relation.id, ToTags(relation.tags, relation.tag_count));
+      for (uint32_t i = 0; i < relation.member_count; i++) {
+        auto &member = relation.members[i];
+        osm_relation.Add(formats::RelationMember(member.type, member.ref,
+                                                 std::string(member.role)));
+      }
 
-#if defined(MAVIX_DEBUG_CORE) && defined(MAVIX_DEBUG_PBF_DECODER)
-      // std::cout << osm_relation.ToString() << std::endl;
-#endif
       elements_->emplace_back(std::move(osm_relation));
     }
   }
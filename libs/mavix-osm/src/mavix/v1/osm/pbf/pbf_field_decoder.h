@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "absl/time/time.h"
@@ -16,12 +17,13 @@ namespace pbf {
 using namespace nvm;
 class PbfFieldDecoder {
  private:
-  std::vector<std::string> string_table_;
+  // views into the PrimitiveBlock, which must outlive the decoder
+  std::vector<std::string_view> string_table_;
   constexpr static double COORDINATE_SCALING_FACTOR = 0.000000001;
   int32_t date_granularity_;
   int32_t coord_granularity_;
-  uint64_t lon_offset_;
-  uint64_t lat_offset_;
+  int64_t lon_offset_;
+  int64_t lat_offset_;
 
   int32_t LoadStringTable(const OSMPBF::PrimitiveBlock &primitive_block) {
     int32_t string_count = primitive_block.stringtable().s_size();
@@ -29,8 +31,7 @@ class PbfFieldDecoder {
 
     string_table_.reserve(string_count);
     for (int32_t i = 0; i < string_count; i++) {
-      string_table_.emplace_back(
-          std::string(primitive_block.stringtable().s(i)));
+      string_table_.emplace_back(primitive_block.stringtable().s(i));
     }
 
     return string_count;
@@ -42,14 +43,14 @@ class PbfFieldDecoder {
         lat_offset_(0),
         lon_offset_(0),
         date_granularity_(0),
-        string_table_(std::vector<std::string>()) {}
+        string_table_(std::vector<std::string_view>()) {}
 
   explicit PbfFieldDecoder(const OSMPBF::PrimitiveBlock &primitive_block)
       : coord_granularity_(primitive_block.granularity()),
         lat_offset_(primitive_block.lat_offset()),
         lon_offset_(primitive_block.lon_offset()),
         date_granularity_(primitive_block.date_granularity()),
-        string_table_(std::vector<std::string>()) {
+        string_table_(std::vector<std::string_view>()) {
     LoadStringTable(primitive_block);
   }
 
@@ -59,12 +60,12 @@ class PbfFieldDecoder {
     return COORDINATE_SCALING_FACTOR;
   }
 
-  double DecodeLatitude(uint64_t raw_lat) const {
+  double DecodeLatitude(int64_t raw_lat) const {
     return COORDINATE_SCALING_FACTOR *
            (lat_offset_ + (coord_granularity_ * raw_lat));
   }
 
-  double DecodeLongitude(uint64_t raw_lon) const {
+  double DecodeLongitude(int64_t raw_lon) const {
     return COORDINATE_SCALING_FACTOR *
            (lon_offset_ + (coord_granularity_ * raw_lon));
   }
@@ -80,7 +81,14 @@ class PbfFieldDecoder {
     return Option<std::string>(std::move(std::string(string_table_.at(index))));
   }
 
-  const std::vector<std::string> &StringTable() { return string_table_; }
+  // empty for an index outside the table
+  std::string_view GetStringView(const size_t &index) const {
+    if (index >= string_table_.size()) return std::string_view();
+
+    return string_table_[index];
+  }
+
+  const std::vector<std::string_view> &StringTable() { return string_table_; }
 
   Option<std::string> GetFromStringTable(size_t index) const {
     if (index >= string_table_.size()) return Option<std::string>();
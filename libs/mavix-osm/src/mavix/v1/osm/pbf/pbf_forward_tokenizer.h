@@ -0,0 +1,128 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+
+#include <memory>
+#include <vector>
+
+#include "mavix/v1/core/byte_ring_buffer.h"
+#include "mavix/v1/osm/pbf/pbf_tokenizer.h"
+
+namespace mavix {
+namespace v1 {
+namespace osm {
+namespace pbf {
+
+/**
+ * @brief Tokenizer for non-seekable input (pipe, stdin, decompressing
+ * stream). Frames are read strictly in order from a ByteRingBuffer, so
+ * decoding starts as soon as the first blob arrives and never needs the
+ * total size. Raises the same callbacks as PbfTokenizer.
+ */
+class PbfForwardTokenizer : public PbfTokenizer {
+ private:
+  core::ByteRingBuffer* ring_;
+  std::vector<uint8_t> frame_;
+
+  bool ReadFrame(size_t size) {
+    frame_.resize(size);
+    return ring_->Read(frame_.data(), size) == size;
+  }
+
+  void RaiseFrameError(std::streampos position, StreamState state) {
+    bool skipped = false;
+    RaiseOnErr(PbfTokenizerErr(position, state, &skipped));
+  }
+
+ public:
+  explicit PbfForwardTokenizer(core::ByteRingBuffer* ring, bool verbose = true)
+      : PbfTokenizer(nullptr, verbose), ring_(ring), frame_() {}
+
+  ~PbfForwardTokenizer() {}
+
+  nvm::Option<PbfBlockMap> Split() override {
+    if (!ring_) return nvm::Option<PbfBlockMap>();
+
+    size_t blob_count = 0;
+    auto state = StreamState::Ok;
+
+    while (true) {
+      if (IsStopRequested()) {
+        state = StreamState::Stoped;
+        break;
+      }
+
+      auto position = std::streampos(ring_->Consumed());
+
+      uint8_t length[4];
+      auto n = ring_->Read(length, 4);
+      if (n == 0) break;
+
+      if (n != 4) {
+        state = StreamState::IndexOutOfBound;
+        RaiseFrameError(position, state);
+        break;
+      }
+
+      ByteOpResult byte_result;
+      auto header_size = static_cast<size_t>(
+          ToInt32<uint8_t>(length, 4, byte_result, EndianessType::BigEndian));
+
+      if (header_size == 0 || header_size > kMaxBlobHeaderSize) {
+        state = StreamState::Error;
+        RaiseFrameError(position, state);
+        break;
+      }
+
+      auto header = OSMPBF::BlobHeader();
+      if (!ReadFrame(header_size) ||
+          !header.ParseFromArray(frame_.data(), header_size)) {
+        state = StreamState::Error;
+        RaiseFrameError(position, state);
+        break;
+      }
+
+      auto data_size = static_cast<size_t>(header.datasize());
+      if (data_size > kMaxBlobSize) {
+        state = StreamState::Error;
+        RaiseFrameError(position, state);
+        break;
+      }
+
+      auto blob = OSMPBF::Blob();
+      if (!ReadFrame(data_size) ||
+          !blob.ParseFromArray(frame_.data(), data_size)) {
+        state = StreamState::Error;
+        RaiseFrameError(position, state);
+        break;
+      }
+
+      auto ordinal = RecordBlock(position, header_size, header);
+
+      auto payload = GetPayloadFromProto(blob);
+
+      bool raised = false;
+      auto data = std::make_shared<PbfBlobData>(header, std::move(blob),
+                                                std::move(payload), ordinal);
+      RaiseOnDataReady(data, raised);
+
+      blob_count++;
+    }
+
+    if (ring_->IsError()) state = StreamState::Error;
+    if (state == StreamState::Ok) MarkIndexComplete();
+
+#if defined(MAVIX_DEBUG_CORE)
+    std::cout << "Pbf Forward Tokenizer : { blob: " << blob_count
+              << ", bytes: " << ring_->Consumed() << " }" << std::endl;
+#endif
+
+    RaiseOnFinished(state);
+    return nvm::Option<PbfBlockMap>();
+  }
+};
+
+}  // namespace pbf
+}  // namespace osm
+}  // namespace v1
+}  // namespace mavix
@@ -2,16 +2,25 @@
 
 #include <mavix/v1/core/core.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <functional>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "mavix/v1/core/aflag_once.h"
+#include "mavix/v1/core/byte_ring_buffer.h"
+#include "mavix/v1/core/byte_source.h"
 #include "mavix/v1/core/memory_buffer.h"
+#include "mavix/v1/core/memory_mapped_stream_buffer.h"
 #include "mavix/v1/core/stream.h"
 #include "mavix/v1/core/stream_buffer.h"
+#include "mavix/v1/core/stream_read_mode.h"
 #include "mavix/v1/osm/block_type.h"
+#include "mavix/v1/osm/pbf/pbf_block_index.h"
 #include "mavix/v1/osm/pbf/pbf_decoder.h"
+#include "mavix/v1/osm/pbf/pbf_forward_tokenizer.h"
 #include "mavix/v1/osm/pbf/pbf_tokenizer.h"
 #include "mavix/v1/osm/skip_options.h"
 namespace mavix {
@@ -24,8 +33,18 @@ namespace pbf {
 ///         one-producer and multi-consumer approach.
 ///         Use wait() method for waiting until decoder finished all processing.
 /// @author Linggawasistha Djohari <linggawasistha.djohari@outlook.com>
+struct PbfTokenizeRange {
+  uint64_t start;
+  uint64_t end;
+  // `start` is known to be a block offset, no resync needed
+  bool is_block_start;
+};
+
 class PbfStreamReader {
  private:
+  // below this a range is not worth its own tokenizer thread
+  static constexpr int64_t kMinTokenizeRangeSize = 1024 * 1024;
+
  protected:
   void (*on_tokenizer_start_callback_)(PbfTokenizer* sender,
                                        core::StreamState state);
@@ -38,34 +57,237 @@ class PbfStreamReader {
   std::function<void(PbfTokenizer*, std::shared_ptr<pbf::PbfBlobData>)>
       on_pbf_raw_blob_ready_;
 
+  // raised on the thread of every tokenizer before it starts reading
+  std::function<void(size_t range, size_t count)> on_tokenizer_thread_start_;
+
   void (*on_osm_data_ready_)(PbfTokenizer* sender,
                              std::shared_ptr<osm::ElementBase> osm_element);
 
   std::string file_;
   size_t cache_size_;
-  std::shared_ptr<core::StreamBuffer> stream_;
+  core::StreamReadMode read_mode_;
+  std::shared_ptr<core::StreamBufferBase> stream_;
+  std::shared_ptr<core::IByteSource> source_;
+  std::shared_ptr<core::ByteRingBuffer> ring_;
+  std::shared_ptr<PbfBlockIndex> index_;
+  std::vector<PbfBlockIndexEntry> selected_blocks_;
+  size_t tokenizer_threads_;
   SkipOptions options_;
   core::AFlagOnce isRun_;
   bool verbose_;
 
+  void RaiseTokenizerThreadStart(size_t range, size_t count) {
+    if (on_tokenizer_thread_start_) on_tokenizer_thread_start_(range, count);
+  }
+
   virtual void Process() {
+    if (IsForwardOnly()) {
+      RaiseTokenizerThreadStart(0, 1);
+      auto tokenizer = pbf::PbfForwardTokenizer(ring_.get(), verbose_);
+      RunTokenizer(tokenizer);
+      return;
+    }
+
+    if (tokenizer_threads_ > 1) {
+      ProcessRanges();
+      return;
+    }
+
+    RaiseTokenizerThreadStart(0, 1);
     auto tokenizer = pbf::PbfTokenizer(stream_->GetAdapter(), verbose_);
+    RunTokenizer(tokenizer);
+  }
 
+  void RegisterCallbacks(pbf::PbfTokenizer& tokenizer) {
     if (on_tokenizer_err_) tokenizer.OnDataError(on_tokenizer_err_);
     if (on_pbf_raw_blob_ready_) tokenizer.OnDataReady(on_pbf_raw_blob_ready_);
     if (on_tokenizer_start_callback_)
       tokenizer.OnStarted(on_tokenizer_start_callback_);
     if (on_tokenizer_finished_callback_)
       tokenizer.OnFinished(on_tokenizer_finished_callback_);
+  }
 
-    tokenizer.Split();
-
+  void UnregisterCallbacks(pbf::PbfTokenizer& tokenizer) {
     tokenizer.OnDataErrorUnregister();
     tokenizer.OnDataReadyUnregister();
     tokenizer.OnStartedUnregister();
     tokenizer.OnFinishedUnregister();
   }
 
+  void RunTokenizer(pbf::PbfTokenizer& tokenizer) {
+    RegisterCallbacks(tokenizer);
+
+    // a selection seeks through a loaded index, a full scan rebuilds it
+    if (!selected_blocks_.empty()) {
+      tokenizer.SplitBlocks(selected_blocks_);
+    } else {
+      index_->Reset(file_);
+      tokenizer.SetBlockIndex(index_.get());
+      tokenizer.Split();
+      tokenizer.SetBlockIndex(nullptr);
+    }
+
+    UnregisterCallbacks(tokenizer);
+  }
+
+  /**
+   * @brief Byte ranges for the tokenizer threads. Cut on block offsets of
+   * a complete index when there is one, otherwise evenly and the
+   * tokenizers resync to the next block.
+   */
+  std::vector<PbfTokenizeRange> SplitRanges(size_t count) const {
+    auto size = static_cast<uint64_t>(stream_->Size());
+    std::vector<PbfTokenizeRange> ranges;
+
+    auto entries = index_->IsComplete() ? index_->Entries()
+                                        : std::vector<PbfBlockIndexEntry>();
+    PbfBlockIndex::SortByOffset(entries);
+
+    uint64_t start = 0;
+    size_t cursor = 0;
+    for (size_t i = 1; i <= count; i++) {
+      auto end = i == count ? size : size * i / count;
+      auto is_block_start = i == 1 || !entries.empty();
+
+      if (!entries.empty() && i < count) {
+        while (cursor < entries.size() && entries[cursor].offset < end) {
+          cursor++;
+        }
+        end = cursor < entries.size() ? entries[cursor].offset : size;
+      }
+
+      if (end > start) ranges.push_back({start, end, is_block_start});
+      start = end;
+    }
+
+    return ranges;
+  }
+
+  /**
+   * @brief Tokenize with `tokenizer_threads_` tokenizers, each on its own
+   * range of the file (or share of the selected blocks), all feeding the
+   * same callbacks concurrently. OnFinished is raised once at the end.
+   */
+  void ProcessRanges() {
+    auto adapter = stream_->GetAdapter();
+    auto is_selection = !selected_blocks_.empty();
+
+    auto count = is_selection
+                     ? std::min(tokenizer_threads_, selected_blocks_.size())
+                     : std::min<size_t>(
+                           tokenizer_threads_,
+                           std::max<int64_t>(1, stream_->Size() /
+                                                    kMinTokenizeRangeSize));
+
+    auto ranges = is_selection ? std::vector<PbfTokenizeRange>()
+                               : SplitRanges(count);
+    if (!is_selection) {
+      count = ranges.size();
+      index_->Reset(file_);
+    }
+
+    std::vector<std::unique_ptr<pbf::PbfTokenizer>> tokenizers;
+    std::vector<core::StreamState> states(count, core::StreamState::Ok);
+    std::vector<std::thread> threads;
+
+    for (size_t i = 0; i < count; i++) {
+      tokenizers.emplace_back(
+          std::make_unique<pbf::PbfTokenizer>(adapter, verbose_));
+      RegisterCallbacks(*tokenizers.back());
+      tokenizers.back()->OnFinishedUnregister();
+      if (!is_selection) tokenizers.back()->SetBlockIndex(index_.get());
+    }
+
+    // one read-ahead cursor per range, a shared one only follows the furthest
+    std::vector<std::streampos> starts;
+    for (size_t i = 0; i < count; i++) {
+      starts.push_back(
+          is_selection
+              ? std::streampos(
+                    selected_blocks_[selected_blocks_.size() * i / count]
+                        .offset)
+              : std::streampos(ranges[i].start));
+    }
+    stream_->SetReadAheadRanges(starts);
+
+    auto run = [&](size_t i) {
+      RaiseTokenizerThreadStart(i, count);
+
+      if (is_selection) {
+        auto first = selected_blocks_.size() * i / count;
+        auto last = selected_blocks_.size() * (i + 1) / count;
+        auto blocks = std::vector<PbfBlockIndexEntry>(
+            selected_blocks_.begin() + first, selected_blocks_.begin() + last);
+        states[i] = tokenizers[i]->TokenizeBlocks(blocks);
+        return;
+      }
+
+      states[i] = tokenizers[i]->TokenizeRange(
+          std::streampos(ranges[i].start), std::streampos(ranges[i].end),
+          ranges[i].is_block_start);
+    };
+
+    for (size_t i = 1; i < count; i++) {
+      threads.emplace_back(run, i);
+    }
+    if (count > 0) run(0);
+
+    for (auto& t : threads) {
+      t.join();
+    }
+
+    stream_->SetReadAheadRanges({});
+
+    auto state = core::StreamState::Ok;
+    for (auto& s : states) {
+      if (s != core::StreamState::Ok) state = s;
+    }
+
+    if (!is_selection && state == core::StreamState::Ok) {
+      index_->SetComplete();
+    }
+
+    if (on_tokenizer_finished_callback_) {
+      on_tokenizer_finished_callback_(
+          tokenizers.empty() ? nullptr : tokenizers.front().get(), state);
+    }
+
+    for (auto& tokenizer : tokenizers) {
+      tokenizer->SetBlockIndex(nullptr);
+      UnregisterCallbacks(*tokenizer);
+    }
+  }
+
+  bool IsForwardOnly() const {
+    return read_mode_ == core::StreamReadMode::ForwardOnly;
+  }
+
+  static std::shared_ptr<core::StreamBufferBase> CreateStreamBuffer(
+      const std::string& file, core::StreamReadMode read_mode,
+      core::CacheGenerationOptions cache_options, const size_t& cache_size,
+      const size_t& max_cache_size, size_t read_ahead_pages = 0) {
+    // forward-only input has no random access, it bypasses the page cache
+    if (read_mode == core::StreamReadMode::ForwardOnly) return nullptr;
+
+    // mapped pages are paged in by the kernel, its own readahead applies
+    if (read_mode == core::StreamReadMode::MemoryMapped) {
+      return std::make_shared<core::MemoryMappedStreamBuffer>(file,
+                                                              cache_size);
+    }
+
+    auto buffer = std::make_shared<core::StreamBuffer>(
+        file, cache_options, cache_size, max_cache_size, read_mode);
+    if (read_ahead_pages > 0) {
+      auto io_threads = read_mode == core::StreamReadMode::Positional ||
+                                read_mode == core::StreamReadMode::Direct
+                            ? 2
+                            : 1;
+      buffer->SetReadAhead(read_ahead_pages, io_threads);
+    }
+
+    return buffer;
+  }
+
  public:
   explicit PbfStreamReader(const std::string& file,
                            SkipOptions options = SkipOptions::None,
@@ -73,17 +295,33 @@ class PbfStreamReader {
                                core::CacheGenerationOptions::None,
                            const size_t& processing_cache_size = 1024 * 1024 *
                                                                  20,
-                           bool verbose = true)
+                           bool verbose = true,
+                           core::StreamReadMode read_mode =
+                               core::StreamReadMode::Buffered,
+                           size_t read_ahead_pages = 0)
       : file_(std::string(file)),
         cache_size_(processing_cache_size),
-        stream_(std::make_shared<core::StreamBuffer>(
-            file, cache_options, processing_cache_size,
-            processing_cache_size * 20)),
+        read_mode_(read_mode),
+        stream_(CreateStreamBuffer(file, read_mode, cache_options,
+                                   processing_cache_size,
+                                   processing_cache_size * 20,
+                                   read_ahead_pages)),
+        source_(read_mode == core::StreamReadMode::ForwardOnly
+                    ? std::make_shared<core::DescriptorByteSource>(file)
+                    : nullptr),
+        ring_(read_mode == core::StreamReadMode::ForwardOnly
+                  ? std::make_shared<core::ByteRingBuffer>(
+                        source_, processing_cache_size)
+                  : nullptr),
+        index_(std::make_shared<PbfBlockIndex>()),
+        selected_blocks_(),
+        tokenizer_threads_(1),
         options_(options),
         isRun_(core::AFlagOnce()),
         verbose_(verbose),
         on_osm_data_ready_(nullptr),
         on_pbf_raw_blob_ready_(nullptr),
+        on_tokenizer_thread_start_(nullptr),
         on_tokenizer_err_(nullptr),
         on_tokenizer_finished_callback_(nullptr),
         on_tokenizer_start_callback_(nullptr){
@@ -93,14 +331,21 @@ class PbfStreamReader {
   explicit PbfStreamReader(const std::string& file, bool verbose = true)
       : file_(std::string(file)),
         cache_size_(1024 * 1024 * 20),
-        stream_(std::make_shared<core::StreamBuffer>(
-            file, core::CacheGenerationOptions::None, 1024 * 1024 * 20,
-            1024 * 1024 * 20 * 20)),
+        read_mode_(core::StreamReadMode::Buffered),
+        stream_(CreateStreamBuffer(file, core::StreamReadMode::Buffered,
+                                   core::CacheGenerationOptions::None,
+                                   1024 * 1024 * 20, 1024 * 1024 * 20 * 20)),
+        source_(nullptr),
+        ring_(nullptr),
+        index_(std::make_shared<PbfBlockIndex>()),
+        selected_blocks_(),
+        tokenizer_threads_(1),
         options_(SkipOptions::None),
         isRun_(core::AFlagOnce()),
         verbose_(verbose),
         on_osm_data_ready_(nullptr),
         on_pbf_raw_blob_ready_(nullptr),
+        on_tokenizer_thread_start_(nullptr),
         on_tokenizer_err_(nullptr),
         on_tokenizer_finished_callback_(nullptr),
         on_tokenizer_start_callback_(nullptr){
@@ -108,36 +353,114 @@ class PbfStreamReader {
         };
 
   ~PbfStreamReader() {
-    if (stream_->IsOpen()) {
-      stream_->Close();
+    if (IsStreamOpen()) {
+      Close();
     }
 
     on_pbf_raw_blob_ready_ = nullptr;
   };
 
-  std::string GetFilename() const { return stream_->GetFilename(); };
+  std::string GetFilename() const {
+    return stream_ ? stream_->GetFilename() : file_;
+  };
 
-  std::string GetDirectoryPath() const { return stream_->GetDirectoryPath(); };
+  std::string GetDirectoryPath() const {
+    return stream_ ? stream_->GetDirectoryPath() : std::string();
+  };
 
   std::string GetDirectorySeparatorPath() const {
-    return stream_->GetDirectorySeparatorPath();
+    return stream_ ? stream_->GetDirectorySeparatorPath() : std::string();
   };
 
-  std::string GetFileExtension() const { return stream_->GetFileExtension(); };
+  std::string GetFileExtension() const {
+    return stream_ ? stream_->GetFileExtension() : std::string();
+  };
 
   const std::string& Filename() const { return file_; }
 
-  bool IsStreamOpen() const { return stream_->IsOpen(); }
+  bool IsStreamOpen() const {
+    return IsForwardOnly() ? source_->IsOpen() : stream_->IsOpen();
+  }
 
-  bool IsStreamGood() const { return stream_->IsGood(); }
+  bool IsStreamGood() const {
+    return IsForwardOnly() ? source_->IsOpen() && !ring_->IsError()
+                           : stream_->IsGood();
+  }
 
-  bool IsStreamEof() const { return stream_->IsEof(); }
+  bool IsStreamEof() const {
+    return IsForwardOnly() ? ring_->IsEof() : stream_->IsEof();
+  }
 
-  std::streamsize StreamSize() const { return stream_->Size(); }
+  // -1 for forward-only input, its size is not known up front
+  std::streamsize StreamSize() const {
+    return IsForwardOnly() ? std::streamsize(-1) : stream_->Size();
+  }
+
+  core::StreamReadMode ReadMode() const { return read_mode_; }
 
-  core::StreamState Open() { return stream_->Open(); }
+  /**
+   * @brief Index of the last full scan, or of the sidecar loaded by
+   * LoadBlockIndex().
+   */
+  std::shared_ptr<PbfBlockIndex> BlockIndex() const { return index_; }
 
-  core::StreamState Close() { return stream_->Close(); }
+  // false when there is no sidecar or it is stale against the file
+  bool LoadBlockIndex() {
+    if (IsForwardOnly()) return false;
+    return index_->Load(PbfBlockIndex::SidecarPath(file_), file_);
+  }
+
+  // writes `<file>.mbi` when the last full scan completed with new data
+  bool SaveBlockIndex() {
+    if (!index_->IsComplete() || !index_->IsDirty()) return false;
+    return index_->Save(PbfBlockIndex::SidecarPath(file_));
+  }
+
+  /**
+   * @brief Restrict the next Start() to `blocks`, typically picked with
+   * PbfBlockIndex::Select(). Not available for forward-only input.
+   */
+  bool SelectBlocks(std::vector<PbfBlockIndexEntry> blocks) {
+    if (IsForwardOnly() || isRun_.State()) return false;
+
+    selected_blocks_ = std::move(blocks);
+    return true;
+  }
+
+  void ClearSelectedBlocks() { selected_blocks_.clear(); }
+
+  /**
+   * @brief Number of tokenizers running concurrently on separate ranges of
+   * the file. Only while stopped, forward-only input always uses one.
+   */
+  bool SetTokenizerThreads(size_t threads) {
+    if (isRun_.State()) return false;
+
+    tokenizer_threads_ = std::max<size_t>(1, threads);
+    return true;
+  }
+
+  size_t TokenizerThreads() const {
+    return IsForwardOnly() ? 1 : tokenizer_threads_;
+  }
+
+  bool IsBlockSelected() const { return !selected_blocks_.empty(); }
+
+  core::StreamState Open() {
+    if (!IsForwardOnly()) return stream_->Open();
+
+    auto state = source_->Open();
+    if (state != core::StreamState::Ok) return state;
+
+    return ring_->Start();
+  }
+
+  core::StreamState Close() {
+    if (!IsForwardOnly()) return stream_->Close();
+
+    ring_->Stop();
+    return source_->Close();
+  }
 
   core::StreamState Start(bool verbose = false) {
     if (isRun_.State()) return core::StreamState::Processing;
@@ -198,6 +521,20 @@ class PbfStreamReader {
       std::function<void(PbfTokenizer*, core::StreamState state)> callback) {
     on_tokenizer_finished_callback_ = callback;
   }
+
+  /**
+   * @brief Raised on each tokenizer thread before it reads, with the index
+   * of its range and the number of ranges, (0, 1) for a single tokenizer.
+   * Lets the caller place the thread, e.g. pin it to a NUMA node.
+   */
+  void OnTokenizerThreadStart(
+      std::function<void(size_t range, size_t count)> callback) {
+    on_tokenizer_thread_start_ = callback;
+  }
+
+  void OnTokenizerThreadStartUnregister() {
+    on_tokenizer_thread_start_ = nullptr;
+  }
 };
 
 }  // namespace pbf
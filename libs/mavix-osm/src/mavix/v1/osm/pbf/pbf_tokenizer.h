@@ -2,13 +2,18 @@
 
 #include <mavix/v1/core/core.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <fstream>
 #include <memory>
 
 #include "mavix/v1/core/stream_buffer.h"
 #include "mavix/v1/osm/block_type.h"
+#include "mavix/v1/osm/pbf/pbf_block_index.h"
 #include "mavix/v1/osm/pbf/pbf_block_map.h"
 #include "mavix/v1/osm/pbf/pbf_declare.h"
+#include "mavix/v1/osm/pbf/pbf_zero_copy_stream.h"
 #include "nvm/bytes/byte.h"
 #include "nvm/option.h"
 #include "nvm/strings/readable_bytes.h"
@@ -36,8 +41,14 @@ struct PbfTokenizerErr {
 
 class PbfTokenizer {
  private:
+  // length prefix is followed by 0x0a <len> "OSMData" / "OSMHeader"
+  static constexpr uint64_t kBlobTypeSignatureSize = 11;
+  static constexpr uint64_t kResyncWindowSize = 256 * 1024;
+
   bool verbose_;
   IMemoryBufferAdapter* buffer_;
+  PbfBlockIndex* index_;
+  std::atomic<bool> stop_requested_;
 
   void (*on_tokenizer_err_)(PbfTokenizer* sender, PbfTokenizerErr err);
 
@@ -51,6 +62,10 @@ class PbfTokenizer {
       on_pbf_raw_blob_ready_;
 
  protected:
+  // limits from the OSM PBF format specification
+  static constexpr uint64_t kMaxBlobHeaderSize = 64 * 1024;
+  static constexpr uint64_t kMaxBlobSize = 32 * 1024 * 1024;
+
   void RaiseOnDataReady(std::shared_ptr<PbfBlobData> data, bool& raised) {
     if (!on_pbf_raw_blob_ready_) {
       raised = false;
@@ -79,15 +94,76 @@ class PbfTokenizer {
     on_tokenizer_finished_callback_(this, state);
   }
 
+  static PbfBlobType GetBlobType(const OSMPBF::BlobHeader& header) {
+    if (header.type() == "OSMData") return PbfBlobType::OsmData;
+    if (header.type() == "OSMHeader") return PbfBlobType::OsmHeader;
+    return PbfBlobType::Unknown;
+  }
+
+  // ordinal of the recorded block, -1 when no index is attached
+  int64_t RecordBlock(const std::streampos& block_start,
+                      const size_t& header_size,
+                      const OSMPBF::BlobHeader& header) {
+    if (!index_) return -1;
+
+    return static_cast<int64_t>(index_->Add(PbfBlockIndexEntry(
+        static_cast<uint64_t>(block_start), static_cast<uint32_t>(header_size),
+        static_cast<uint32_t>(header.datasize()), GetBlobType(header))));
+  }
+
+  static bool MatchBlobTypeSignature(const uint8_t* data, uint64_t at) {
+    auto type = data + at + 4;
+    if (type[0] != 0x0a) return false;
+
+    if (type[1] == 7) return std::memcmp(type + 2, "OSMData", 7) == 0;
+    if (type[1] == 9) return std::memcmp(type + 2, "OSMHeader", 9) == 0;
+    return false;
+  }
+
+  void MarkIndexComplete() {
+    if (index_) index_->SetComplete();
+  }
+
+ protected:
+  bool IsStopRequested() const {
+    return stop_requested_.load(std::memory_order_relaxed);
+  }
+
+ private:
+
+  /**
+   * @brief Parse a message that crosses cache pages straight from the page
+   * spans. Falls back to a contiguous copy when the adapter gives no spans.
+   */
+  template <typename TMessage>
+  bool ParseFromBufferPages(TMessage& message, const std::streampos& position,
+                            const size_t& size, PageLocatorInfo& result) {
+    auto spans = buffer_->GetAsPointer(position, size, result);
+
+    if (spans.empty()) {
+      auto raw = buffer_->GetAsCopy(position, size, result);
+      if (!raw) return false;
+
+      auto state = message.ParseFromArray(raw->Data(), size);
+      raw->Destroy();
+      return state;
+    }
+
+    auto stream = PbfZeroCopyInputStream(spans);
+    return message.ParseFromZeroCopyStream(&stream);
+  }
+
  public:
   explicit PbfTokenizer(IMemoryBufferAdapter* buffer, bool verbose = true)
       : buffer_(buffer),
+        index_(nullptr),
+        stop_requested_(false),
         verbose_(verbose),
         on_tokenizer_err_(nullptr),
         on_pbf_raw_blob_ready_(nullptr),
         on_tokenizer_start_callback_(nullptr),
         on_tokenizer_finished_callback_(nullptr){};
-  ~PbfTokenizer() { on_pbf_raw_blob_ready_ = nullptr; };
+  virtual ~PbfTokenizer() { on_pbf_raw_blob_ready_ = nullptr; };
 
   void OnDataReady(
       std::function<void(PbfTokenizer*, std::shared_ptr<pbf::PbfBlobData>)>
@@ -117,20 +193,41 @@ class PbfTokenizer {
 
   void OnFinishedUnregister() { on_tokenizer_finished_callback_ = nullptr; }
 
+  /**
+   * @brief Record every block Split() passes into `index`, the caller
+   * resets it beforehand and keeps it alive for the whole scan.
+   */
+  void SetBlockIndex(PbfBlockIndex* index) { index_ = index; }
+
+  /**
+   * @brief End the scan after the current block, typically from the
+   * OnDataReady callback. The scan then finishes as StreamState::Stoped and
+   * leaves the index incomplete.
+   */
+  void RequestStop() { stop_requested_.store(true, std::memory_order_relaxed); }
+
   int32_t GetHeaderLength(std::streampos& position, PageLocatorInfo& result) {
     ByteOpResult byte_result;
+    BufferPagePin pin(buffer_, position, 4);
 
     uint8_t* ptr = buffer_->GetAsInlinePointer(position, 4, result);
     int32_t header_size = 0;
 
-    if (result.type == PageLocatorResolvement::SinglePage) {
+    // Adapters backed by a contiguous mapping resolve cross-page ranges
+    // inline too, only fall back to a copy when no pointer is given.
+    if (ptr) {
       header_size =
           ToInt32<uint8_t>(ptr, 4, byte_result, EndianessType::BigEndian);
     } else if (result.type == PageLocatorResolvement::CrossPage) {
-      auto raw = buffer_->GetAsCopy(position, 4, result);
-      header_size = ToInt32<uint8_t>(raw->Data(), 4, byte_result,
-                                     EndianessType::BigEndian);
-      raw->Destroy();
+      uint8_t raw[4] = {0, 0, 0, 0};
+      size_t cursor = 0;
+      for (auto& span : buffer_->GetAsPointer(position, 4, result)) {
+        std::memcpy(raw + cursor, span.ptr, span.size);
+        cursor += span.size;
+      }
+
+      header_size =
+          ToInt32<uint8_t>(raw, 4, byte_result, EndianessType::BigEndian);
     }
 
     position += std::streamsize(4);
@@ -141,16 +238,15 @@ class PbfTokenizer {
                                     const size_t& data_size,
                                     std::streampos& position,
                                     PageLocatorInfo& result) {
+    BufferPagePin pin(buffer_, position, data_size);
     uint8_t* ptr = buffer_->GetAsInlinePointer(position, data_size, result);
 
     auto blob = OSMPBF::Blob();
 
-    if (result.type == PageLocatorResolvement::SinglePage) {
+    if (ptr) {
       blob.ParseFromArray(ptr, data_size);
     } else if (result.type == PageLocatorResolvement::CrossPage) {
-      auto raw = buffer_->GetAsCopy(position, data_size, result);
-      blob.ParseFromArray(raw->Data(), data_size);
-      raw->Destroy();
+      ParseFromBufferPages(blob, position, data_size, result);
     }
 
     if (verbose_) {
@@ -172,16 +268,15 @@ class PbfTokenizer {
 
   OSMPBF::Blob GetPbfBlob(const size_t& header_size, const size_t& data_size,
                           std::streampos& position, PageLocatorInfo& result) {
+    BufferPagePin pin(buffer_, position, header_size);
     uint8_t* ptr = buffer_->GetAsInlinePointer(position, header_size, result);
 
     auto blob = OSMPBF::Blob();
 
-    if (result.type == PageLocatorResolvement::SinglePage) {
+    if (ptr) {
       blob.ParseFromArray(ptr, header_size);
     } else if (result.type == PageLocatorResolvement::CrossPage) {
-      auto raw = buffer_->GetAsCopy(position, header_size, result);
-      blob.ParseFromArray(raw->Data(), header_size);
-      raw->Destroy();
+      ParseFromBufferPages(blob, position, header_size, result);
     }
 
     if (verbose_) {
@@ -221,16 +316,15 @@ class PbfTokenizer {
   OSMPBF::BlobHeader GetPbfHeader(const size_t& header_size,
                                   std::streampos& position,
                                   PageLocatorInfo& result) {
+    BufferPagePin pin(buffer_, position, header_size);
     uint8_t* ptr = buffer_->GetAsInlinePointer(position, header_size, result);
 
     auto header = OSMPBF::BlobHeader();
 
-    if (result.type == PageLocatorResolvement::SinglePage) {
+    if (ptr) {
       header.ParseFromArray(ptr, header_size);
     } else if (result.type == PageLocatorResolvement::CrossPage) {
-      auto raw = buffer_->GetAsCopy(position, header_size, result);
-      header.ParseFromArray(raw->Data(), header_size);
-      raw->Destroy();
+      ParseFromBufferPages(header, position, header_size, result);
     }
 
     if (verbose_) {
@@ -251,26 +345,29 @@ class PbfTokenizer {
     return std::move(header);
   }
 
-  std::shared_ptr<MemoryBuffer> GetRawBufferFromProto(
-      OSMPBF::Blob& blob, bool& result, bool shrink_after_copy = true) {
+  /**
+   * @brief Move the compressed payload out of `blob` into a slice, no bytes
+   * are copied. The blob keeps its data case, with the payload left empty.
+   */
+  static BufferSlice GetPayloadFromProto(OSMPBF::Blob& blob) {
     if (blob.has_raw()) {
-      auto buffer = std::make_shared<MemoryBuffer>(blob.raw().size());
-      std::memcpy(buffer->Data(),
-                  reinterpret_cast<const uint8_t*>(blob.raw().data()),
-                  blob.raw().size());
-      if (shrink_after_copy) {
-      }
-      return buffer;
-
+      return BufferSlice::Adopt(std::move(*blob.mutable_raw()),
+                                memory::MemoryCategory::BlobQueue);
     } else if (blob.has_zlib_data()) {
-      auto buffer = std::make_shared<MemoryBuffer>(blob.zlib_data().size());
-      std::memcpy(buffer->Data(),
-                  reinterpret_cast<const uint8_t*>(blob.zlib_data().data()),
-                  blob.zlib_data().size());
-      return buffer;
+      return BufferSlice::Adopt(std::move(*blob.mutable_zlib_data()),
+                                memory::MemoryCategory::BlobQueue);
+    } else if (blob.has_lzma_data()) {
+      return BufferSlice::Adopt(std::move(*blob.mutable_lzma_data()),
+                                memory::MemoryCategory::BlobQueue);
+    } else if (blob.has_lz4_data()) {
+      return BufferSlice::Adopt(std::move(*blob.mutable_lz4_data()),
+                                memory::MemoryCategory::BlobQueue);
+    } else if (blob.has_zstd_data()) {
+      return BufferSlice::Adopt(std::move(*blob.mutable_zstd_data()),
+                                memory::MemoryCategory::BlobQueue);
     }
 
-    return nullptr;
+    return BufferSlice();
   }
 
   void CleanupBuffer(const PageLocatorInfo& current,
@@ -285,70 +382,253 @@ class PbfTokenizer {
     }
   }
 
-  nvm::Option<PbfBlockMap> Split() {
-    if (!buffer_ || buffer_->Size() == 0) return nvm::Option<PbfBlockMap>();
+  /**
+   * @brief Tokenize the block starting at `position` and raise it. Returns
+   * the map of the block, empty when the header is malformed.
+   */
+  PbfBlockMap NextBlock(std::streampos& position, PageLocatorInfo& result,
+                        PageLocatorInfo& prev_result, bool record = true) {
+    auto block_start = position;
+
+    auto header_size = GetHeaderLength(position, result);
+    CleanupBuffer(result, prev_result);
+    prev_result = result;
+    if (header_size <= 0) return PbfBlockMap(block_start, 0, block_start, 0);
+
+    auto header = GetPbfHeader(header_size, position, result);
+    CleanupBuffer(result, prev_result);
+    prev_result = result;
+
+    auto raw_start = position;
+    auto blob =
+        GetPbfBlobWithBuffer(header_size, header.datasize(), position, result);
+    CleanupBuffer(result, prev_result);
+    prev_result = result;
+
+    auto ordinal = record ? RecordBlock(block_start, header_size, header) : -1;
+
+    auto payload = GetPayloadFromProto(blob);
+
+    if (verbose_) {
+      std::cout << "Raw buffer: "
+                << nvm::strings::ConvertBytesToReadableSizeString(
+                       payload.Size())
+                << std::endl;
+    }
+
+    bool raised = false;
+    auto data = std::make_shared<PbfBlobData>(header, std::move(blob),
+                                              std::move(payload), ordinal);
+    RaiseOnDataReady(data, raised);
+
+    return PbfBlockMap(block_start + std::streamoff(4),
+                       static_cast<size_t>(header_size), raw_start,
+                       static_cast<size_t>(header.datasize()));
+  }
+
+  /**
+   * @brief Whether a block starts at `position`: the length prefix, the
+   * BlobHeader and its datasize must be sane, the block must fit in the
+   * file and be followed by the end of the file or another plausible
+   * BlobHeader.
+   */
+  bool IsBlockBoundary(const std::streampos& position) {
+    auto size = static_cast<uint64_t>(buffer_->Size());
+    auto offset = static_cast<uint64_t>(position);
+    if (offset + 4 > size) return false;
+
+    PageLocatorInfo result = PageLocatorInfo();
+    auto length = buffer_->GetAsCopy(position, 4, result);
+    if (!length) return false;
+
+    ByteOpResult byte_result;
+    auto header_size = static_cast<uint64_t>(static_cast<uint32_t>(
+        ToInt32<uint8_t>(length->Data(), 4, byte_result,
+                         EndianessType::BigEndian)));
+    length->Destroy();
+    if (header_size == 0 || header_size > kMaxBlobHeaderSize ||
+        offset + 4 + header_size > size) {
+      return false;
+    }
+
+    auto header = OSMPBF::BlobHeader();
+    auto raw = buffer_->GetAsCopy(position + std::streamoff(4), header_size,
+                                  result);
+    if (!raw) return false;
+
+    auto parsed = header.ParseFromArray(raw->Data(), header_size);
+    raw->Destroy();
+    if (!parsed || GetBlobType(header) == PbfBlobType::Unknown) return false;
+    if (header.datasize() <= 0 ||
+        static_cast<uint64_t>(header.datasize()) > kMaxBlobSize) {
+      return false;
+    }
+
+    auto next = offset + 4 + header_size + header.datasize();
+    if (next == size) return true;
+    if (next + 4 + kBlobTypeSignatureSize > size) return false;
+
+    auto follow = buffer_->GetAsCopy(std::streampos(next),
+                                     4 + kBlobTypeSignatureSize, result);
+    if (!follow) return false;
+
+    auto plausible = MatchBlobTypeSignature(follow->Data(), 0);
+    follow->Destroy();
+    return plausible;
+  }
+
+  /**
+   * @brief Find the first block boundary in [position, end). Scans for the
+   * BlobHeader type string behind a length prefix, then confirms the
+   * candidate with IsBlockBoundary(). Returns -1 when there is none.
+   */
+  std::streampos Resync(std::streampos position, const std::streampos& end) {
+    auto size = static_cast<uint64_t>(buffer_->Size());
+    auto offset = static_cast<uint64_t>(position);
+    auto limit = std::min(static_cast<uint64_t>(end), size);
+
+    PageLocatorInfo result = PageLocatorInfo();
+    while (offset < limit) {
+      // windows overlap by one signature so no candidate is cut in half
+      auto window = std::min<uint64_t>(kResyncWindowSize, size - offset);
+      if (window < 4 + kBlobTypeSignatureSize) break;
+
+      auto chunk = buffer_->GetAsCopy(std::streampos(offset), window, result);
+      if (!chunk) break;
+
+      auto scan = window - (4 + kBlobTypeSignatureSize) + 1;
+      for (uint64_t i = 0; i < scan && offset + i < limit; i++) {
+        if (!MatchBlobTypeSignature(chunk->Data(), i)) continue;
+
+        if (IsBlockBoundary(std::streampos(offset + i))) {
+          chunk->Destroy();
+          return std::streampos(offset + i);
+        }
+      }
+
+      chunk->Destroy();
+      offset += scan;
+    }
+
+    return std::streampos(-1);
+  }
+
+  /**
+   * @brief Tokenize the blocks starting in [start, end) and raise them.
+   * Ranges cut at arbitrary offsets resync to the next block, so the ranges
+   * of one file can be tokenized concurrently without overlap. Does not
+   * raise OnFinished, the caller does once every range is done.
+   */
+  StreamState TokenizeRange(std::streampos start, std::streampos end,
+                            bool is_block_start = false) {
+    if (!buffer_ || buffer_->Size() == 0) return StreamState::Error;
+
+    end = std::min(end, std::streampos(buffer_->Size()));
+    auto position = is_block_start || start == 0 ? start : Resync(start, end);
+    if (position < 0) return StreamState::Ok;
 
-    // Get header size
     size_t blob_count = 0;
-    size_t header_count = 0;
+    auto state = StreamState::Ok;
 
-    std::streampos position = 0;
     PageLocatorInfo result = PageLocatorInfo();
     PageLocatorInfo prev_result = PageLocatorInfo();
 
-    while (position < buffer_->Size()) {
-      bool state = false;
+    while (position < end) {
+      if (IsStopRequested()) {
+        state = StreamState::Stoped;
+        break;
+      }
 
-      auto header_size = GetHeaderLength(position, result);
-      CleanupBuffer(result, prev_result);
-      prev_result = result;
+      auto block_start = position;
+      auto block = NextBlock(position, result, prev_result);
 
-      auto header = GetPbfHeader(header_size, position, result);
-      CleanupBuffer(result, prev_result);
-      prev_result = result;
-      header_count++;
+      if (block.IsEmpty()) {
+        state = StreamState::Error;
+        bool skipped = false;
+        RaiseOnErr(PbfTokenizerErr(block_start, state, &skipped));
+        break;
+      }
 
-      auto blob = GetPbfBlobWithBuffer(header_size, header.datasize(), position,
-                                       result);
-      CleanupBuffer(result, prev_result);
-      prev_result = result;
+      blob_count++;
+    }
 
-      bool capture = false;
-      auto raw_buffer = GetRawBufferFromProto(blob, capture, true);
+#if defined(MAVIX_DEBUG_CORE)
+    std::cout << "Pbf Tokenizer : { range: " << start << "-" << end
+              << ", blob: " << blob_count << " }" << std::endl;
+#endif
 
-      std::cout << "Raw buffer: "
-                << (!raw_buffer
-                        ? "0 Bytes"
-                        : nvm::strings::ConvertBytesToReadableSizeString(
-                              raw_buffer->Size()))
-                << std::endl;
-      // auto raw_pos = GetRawBufferPosition(header, blob, position);
-      // position = raw_pos.first + raw_pos.second;
+    return state;
+  }
+
+  /**
+   * @brief Tokenize the given blocks of a loaded PbfBlockIndex, seeking
+   * straight to each of them. Does not raise OnFinished.
+   */
+  StreamState TokenizeBlocks(const std::vector<PbfBlockIndexEntry>& blocks) {
+    if (!buffer_ || buffer_->Size() == 0) return StreamState::Error;
+
+    auto state = StreamState::Ok;
+    PageLocatorInfo result = PageLocatorInfo();
+    PageLocatorInfo prev_result = PageLocatorInfo();
+    size_t blob_count = 0;
+
+    for (auto& entry : blocks) {
+      if (IsStopRequested()) {
+        state = StreamState::Stoped;
+        break;
+      }
+
+      auto position = std::streampos(entry.offset);
 
-      // auto raw_buffer = GetRawBuffer(raw_pos.first, raw_pos.second, result);
+      if (entry.End() > static_cast<uint64_t>(buffer_->Size())) {
+        state = StreamState::IndexOutOfBound;
+        bool skipped = false;
+        RaiseOnErr(PbfTokenizerErr(position, state, &skipped));
+        break;
+      }
 
-      bool raised = false;
-      auto data =
-          std::make_shared<PbfBlobData>(header, blob, std::move(raw_buffer));
-      RaiseOnDataReady(data, raised);
-      if (!raised) {
-        data->blob_data->Destroy();
+      auto block = NextBlock(position, result, prev_result, false);
+      if (block.IsEmpty() ||
+          block.HeaderSize() != std::streampos(entry.header_size)) {
+        state = StreamState::Error;
+        bool skipped = false;
+        RaiseOnErr(PbfTokenizerErr(std::streampos(entry.offset), state,
+                                   &skipped));
+        break;
       }
 
       blob_count++;
     }
+
 #if defined(MAVIX_DEBUG_CORE)
-    std::cout << "Pbf Tokenizer : { header: " << header_count
+    std::cout << "Pbf Tokenizer : { selected: " << blocks.size()
               << " , blob: " << blob_count << " }" << std::endl;
-    std::cout << "Pbf Processing size: "
-              << strings::ConvertBytesToReadableSizeString(
-                     std::streamsize(position))
-              << std::endl;
 #endif
 
-    RaiseOnFinished(StreamState::Ok);
+    return state;
+  }
+
+  virtual nvm::Option<PbfBlockMap> Split() {
+    if (!buffer_ || buffer_->Size() == 0) return nvm::Option<PbfBlockMap>();
+
+    auto state = TokenizeRange(0, std::streampos(buffer_->Size()), true);
+    if (state == StreamState::Ok) MarkIndexComplete();
+
+    RaiseOnFinished(state);
     return nvm::Option<PbfBlockMap>();
   }
+
+  /**
+   * @brief Tokenize only the given blocks of a loaded PbfBlockIndex. Raises
+   * the same callbacks as Split().
+   */
+  virtual StreamState SplitBlocks(
+      const std::vector<PbfBlockIndexEntry>& blocks) {
+    auto state = TokenizeBlocks(blocks);
+
+    RaiseOnFinished(state);
+    return state;
+  }
 };
 
 }  // namespace pbf
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+
+#include <google/protobuf/io/zero_copy_stream.h>
+
+#include <vector>
+
+#include "mavix/v1/core/buffer_struct.h"
+
+namespace mavix {
+namespace v1 {
+namespace osm {
+namespace pbf {
+
+/**
+ * @brief Protobuf input stream over scattered cache page spans.
+ *
+ * Lets a message that crosses a page boundary be parsed in place with
+ * ParseFromZeroCopyStream() instead of copying it into one contiguous
+ * buffer first. The spans must outlive the stream.
+ */
+class PbfZeroCopyInputStream
+    : public google::protobuf::io::ZeroCopyInputStream {
+ private:
+  const std::vector<core::BufferPointer>& spans_;
+  size_t span_index_;
+  size_t span_offset_;
+  int64_t byte_count_;
+
+ public:
+  explicit PbfZeroCopyInputStream(const std::vector<core::BufferPointer>& spans)
+      : spans_(spans), span_index_(0), span_offset_(0), byte_count_(0) {}
+
+  ~PbfZeroCopyInputStream() override {}
+
+  bool Next(const void** data, int* size) override {
+    while (span_index_ < spans_.size()) {
+      auto& span = spans_[span_index_];
+      if (span_offset_ < span.size) {
+        *data = span.ptr + span_offset_;
+        *size = static_cast<int>(span.size - span_offset_);
+
+        byte_count_ += *size;
+        span_offset_ = span.size;
+        return true;
+      }
+
+      span_index_++;
+      span_offset_ = 0;
+    }
+
+    return false;
+  }
+
+  void BackUp(int count) override {
+    // only valid right after Next(), so the bytes belong to the current span
+    span_offset_ -= static_cast<size_t>(count);
+    byte_count_ -= count;
+  }
+
+  bool Skip(int count) override {
+    while (count > 0 && span_index_ < spans_.size()) {
+      auto& span = spans_[span_index_];
+      auto available = span.size - span_offset_;
+
+      if (static_cast<size_t>(count) < available) {
+        span_offset_ += static_cast<size_t>(count);
+        byte_count_ += count;
+        return true;
+      }
+
+      count -= static_cast<int>(available);
+      byte_count_ += static_cast<int64_t>(available);
+      span_index_++;
+      span_offset_ = 0;
+    }
+
+    return count == 0;
+  }
+
+  int64_t ByteCount() const override { return byte_count_; }
+};
+
+}  // namespace pbf
+}  // namespace osm
+}  // namespace v1
+}  // namespace mavix
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <absl/synchronization/mutex.h>
+#include <mavix/v1/core/core.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "mavix/v1/utils/zstd_dict_compression.h"
+#include "mavix/v1/utils/zstd_dictionary.h"
+
+namespace mavix {
+namespace v1 {
+namespace storage {
+
+/**
+ * @brief Inclusive range of zoom levels sharing one dictionary.
+ */
+struct ZoomBand {
+  uint8_t min_zoom;
+  uint8_t max_zoom;
+
+  ZoomBand() : min_zoom(0), max_zoom(0) {}
+
+  ZoomBand(uint8_t min_zoom, uint8_t max_zoom)
+      : min_zoom(min_zoom), max_zoom(max_zoom) {}
+
+  bool Contains(uint8_t zoom) const {
+    return zoom >= min_zoom && zoom <= max_zoom;
+  }
+
+  // file name of the band's dictionary, "z<min>-<max>.zdict"
+  std::string FileName() const {
+    std::ostringstream name;
+    name << "z" << int(min_zoom) << "-" << int(max_zoom) << ".zdict";
+    return name.str();
+  }
+};
+
+/**
+ * @brief One trained zstd dictionary per zoom band for stored tiles.
+ *
+ * Tiles of a band (MVT in particular) repeat the same layer names,
+ * attribute keys and values, which a dictionary trained on a sample of them
+ * captures once instead of in every tile. Samples are collected with
+ * AddSample() while tiles are produced, Train() builds the dictionaries and
+ * Save()/Load() keep them next to the archive. Tiles of a band without a
+ * dictionary are not compressed by the store; callers keep them as is.
+ *
+ * The store is thread safe. Compression itself goes through NewCodec(),
+ * one codec per thread and band.
+ */
+class TileDictionaryStore {
+ public:
+  // tiles are written once and served many times, favour size
+  static constexpr int kDefaultLevel = 9;
+
+ private:
+  struct Band {
+    ZoomBand zoom;
+    utils::ZstdDictionaryTrainer trainer;
+    std::shared_ptr<const utils::ZstdDictionary> dictionary;
+
+    Band(ZoomBand zoom, size_t max_sample_bytes)
+        : zoom(zoom), trainer(max_sample_bytes), dictionary(nullptr) {}
+  };
+
+  mutable absl::Mutex mu_;
+  std::vector<Band> bands_;
+  size_t dictionary_size_;
+  int level_;
+
+  // index into bands_, -1 when no band covers `zoom`
+  int BandIndex(uint8_t zoom) const {
+    for (size_t i = 0; i < bands_.size(); i++) {
+      if (bands_[i].zoom.Contains(zoom)) return static_cast<int>(i);
+    }
+
+    return -1;
+  }
+
+ public:
+  /**
+   * @brief Bands used when none are given: world, region, city and street
+   * level tiles differ enough to want their own dictionary.
+   */
+  static std::vector<ZoomBand> DefaultBands() {
+    return {ZoomBand(0, 5), ZoomBand(6, 9), ZoomBand(10, 12),
+            ZoomBand(13, 14), ZoomBand(15, 30)};
+  }
+
+  explicit TileDictionaryStore(
+      std::vector<ZoomBand> bands = DefaultBands(),
+      size_t dictionary_size =
+          utils::ZstdDictionaryTrainer::kDefaultDictionarySize,
+      int level = kDefaultLevel,
+      size_t max_sample_bytes =
+          utils::ZstdDictionaryTrainer::kDefaultMaxSampleBytes)
+      : mu_(), bands_(), dictionary_size_(dictionary_size), level_(level) {
+    bands_.reserve(bands.size());
+    for (auto& zoom : bands) bands_.emplace_back(zoom, max_sample_bytes);
+  }
+
+  ~TileDictionaryStore() {}
+
+  size_t BandCount() const { return bands_.size(); }
+
+  const ZoomBand& BandAt(size_t index) const { return bands_[index].zoom; }
+
+  /**
+   * @brief Offer a tile of `zoom` as training sample. False when no band
+   * covers `zoom` or its sample budget is used up.
+   */
+  bool AddSample(uint8_t zoom, const uint8_t* data, size_t size) {
+    absl::MutexLock lock(&mu_);
+    auto index = BandIndex(zoom);
+    if (index < 0) return false;
+
+    return bands_[index].trainer.AddSample(data, size);
+  }
+
+  /**
+   * @brief Train every band with enough samples and drop the samples of
+   * those that succeeded. Returns the number of bands trained.
+   */
+  size_t Train() {
+    absl::MutexLock lock(&mu_);
+    size_t trained = 0;
+
+    for (auto& band : bands_) {
+      if (band.trainer.SampleCount() == 0) continue;
+
+      auto dictionary = band.trainer.Train(dictionary_size_, level_);
+      if (!dictionary) continue;
+
+      band.dictionary = std::move(dictionary);
+      band.trainer.Clear();
+      trained++;
+    }
+
+    return trained;
+  }
+
+  bool HasDictionary(uint8_t zoom) const { return Dictionary(zoom) != nullptr; }
+
+  std::shared_ptr<const utils::ZstdDictionary> Dictionary(uint8_t zoom) const {
+    absl::MutexLock lock(&mu_);
+    auto index = BandIndex(zoom);
+    return index < 0 ? nullptr : bands_[index].dictionary;
+  }
+
+  /**
+   * @brief Codec for tiles of `zoom`, nullptr when its band has no
+   * dictionary. Codecs keep their own contexts, one per thread.
+   */
+  std::unique_ptr<utils::ZstdDictCompression> NewCodec(uint8_t zoom) const {
+    auto dictionary = Dictionary(zoom);
+    if (!dictionary) return nullptr;
+
+    return std::make_unique<utils::ZstdDictCompression>(std::move(dictionary));
+  }
+
+  /**
+   * @brief Write every trained dictionary into `directory`, one file per
+   * band. False on the first file that cannot be written.
+   */
+  bool Save(const std::string& directory) const {
+    absl::MutexLock lock(&mu_);
+
+    for (auto& band : bands_) {
+      if (!band.dictionary) continue;
+
+      std::ofstream file(directory + "/" + band.zoom.FileName(),
+                         std::ios::binary | std::ios::trunc);
+      auto& bytes = band.dictionary->Bytes();
+      file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+      if (!file.good()) return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * @brief Read the dictionaries saved in `directory` for the bands of this
+   * store; bands without a file keep what they have. Returns the number of
+   * dictionaries loaded.
+   */
+  size_t Load(const std::string& directory) {
+    absl::MutexLock lock(&mu_);
+    size_t loaded = 0;
+
+    for (auto& band : bands_) {
+      std::ifstream file(directory + "/" + band.zoom.FileName(),
+                         std::ios::binary);
+      if (!file.is_open()) continue;
+
+      std::string bytes((std::istreambuf_iterator<char>(file)),
+                        std::istreambuf_iterator<char>());
+      auto dictionary = utils::ZstdDictionary::Load(std::move(bytes), level_);
+      if (!dictionary) continue;
+
+      band.dictionary = std::move(dictionary);
+      loaded++;
+    }
+
+    return loaded;
+  }
+};
+
+}  // namespace storage
+}  // namespace v1
+}  // namespace mavix
@@ -0,0 +1,495 @@
+// Compression codec benchmark over real PBF blobs and tiles.
+//
+//   mavix-utils-v1-benchmark [file.osm.pbf ...] [--tiles <dir>]
+//                            [--iterations <n>] [--max-blocks <n>]
+//                            [--json <file>]
+//
+// Without inputs every *.pbf of the mavix-osm resources is used. Every blob
+// is inflated once into a corpus per file; each codec then deflates the
+// whole corpus and inflates it with InflateInto() into a buffer of the known
+// raw size, as PbfDecoder does. The best of the iterations is reported.
+// Results go to stdout as a table and, machine readable, to the JSON file.
+// With "--json -" the JSON takes stdout and the table moves to stderr.
+
+#include <mavix/v1/core/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "mavix/v1/core/stream_read_mode.h"
+#include "mavix/v1/osm/pbf/pbf_stream_reader.h"
+#include "mavix/v1/utils/compression.h"
+
+#ifndef MAVIX_BENCHMARK_RESOURCES_DIR
+#define MAVIX_BENCHMARK_RESOURCES_DIR "resources"
+#endif
+
+using namespace mavix::v1;
+
+namespace {
+
+struct Corpus {
+  std::string name;
+  std::string kind;
+  std::vector<std::string> samples;
+  uint64_t bytes = 0;
+};
+
+struct CodecCase {
+  std::string codec;
+  int level;
+  std::function<std::unique_ptr<utils::ICompression>()> create;
+  // InflateInto() of the concrete codec made by `create`
+  std::function<bool(utils::ICompression*, const uint8_t*, size_t, uint8_t*,
+                     size_t)>
+      inflate_into;
+};
+
+struct Result {
+  std::string corpus;
+  std::string codec;
+  int level = 0;
+  size_t samples = 0;
+  uint64_t raw_bytes = 0;
+  uint64_t compressed_bytes = 0;
+  double deflate_seconds = 0;
+  double inflate_seconds = 0;
+  bool ok = false;
+
+  double Ratio() const {
+    return compressed_bytes > 0 ? double(raw_bytes) / compressed_bytes : 0;
+  }
+
+  double DeflateMBps() const {
+    return deflate_seconds > 0 ? raw_bytes / deflate_seconds / 1e6 : 0;
+  }
+
+  double InflateMBps() const {
+    return inflate_seconds > 0 ? raw_bytes / inflate_seconds / 1e6 : 0;
+  }
+};
+
+template <typename TCodec>
+CodecCase MakeCodecCase(const std::string& codec, int level) {
+  return {codec, level,
+          [level]() { return std::make_unique<TCodec>(level); },
+          [](utils::ICompression* compression, const uint8_t* source,
+             size_t source_size, uint8_t* dest, size_t dest_size) {
+            return static_cast<TCodec*>(compression)
+                ->InflateInto(source, source_size, dest, dest_size);
+          }};
+}
+
+std::vector<CodecCase> CodecCases() {
+  std::vector<CodecCase> cases;
+
+  for (int level : {1, 6, 9}) {
+    cases.push_back(MakeCodecCase<utils::ZlibCompression>("zlib", level));
+  }
+
+  // 0 is the fast block compressor, 9 the HC one
+  for (int level : {0, 9}) {
+    cases.push_back(MakeCodecCase<utils::Lz4Compression>("lz4", level));
+  }
+
+  for (int level : {1, 3, 9, 19}) {
+    cases.push_back(MakeCodecCase<utils::ZstdCompression>("zstd", level));
+  }
+
+  for (int level : {1, 5, 9}) {
+    cases.push_back(MakeCodecCase<utils::LzmaCompression>("lzma", level));
+  }
+
+  return cases;
+}
+
+std::shared_ptr<core::MemoryBuffer> InflateBlob(
+    const osm::pbf::PbfBlobData& data) {
+  auto& blob = data.blob;
+  auto& payload = data.blob_data;
+  auto raw_size = static_cast<size_t>(std::max(0, blob.raw_size()));
+  bool state = false;
+
+  switch (blob.data_case()) {
+    case OSMPBF::Blob::kZlibData:
+      return utils::ZlibCompression().Inflate(payload.Data(), payload.Size(),
+                                              raw_size, state);
+    case OSMPBF::Blob::kLz4Data:
+      return utils::Lz4Compression().Inflate(payload.Data(), payload.Size(),
+                                             raw_size, state);
+    case OSMPBF::Blob::kZstdData:
+      return utils::ZstdCompression().Inflate(payload.Data(), payload.Size(),
+                                              raw_size, state);
+    case OSMPBF::Blob::kLzmaData:
+      return utils::LzmaCompression().Inflate(payload.Data(), payload.Size(),
+                                              raw_size, state);
+    default:
+      return nullptr;
+  }
+}
+
+// every blob of `file` uncompressed, at most `max_blocks` of them (0 = all)
+bool LoadPbf(const std::string& file, size_t max_blocks, Corpus& corpus) {
+  corpus.name = std::filesystem::path(file).filename().string();
+  corpus.kind = "pbf";
+
+  absl::Mutex mu;
+  bool failed = false;
+  size_t taken = 0;
+
+  osm::pbf::PbfStreamReader reader(file, osm::SkipOptions::None,
+                                   core::CacheGenerationOptions::None,
+                                   1024 * 1024 * 64, false,
+                                   core::StreamReadMode::ForwardOnly);
+  reader.OnDataReady([&](osm::pbf::PbfTokenizer* tokenizer,
+                         std::shared_ptr<osm::pbf::PbfBlobData> data) {
+    {
+      absl::MutexLock lock(&mu);
+      if (max_blocks > 0 && taken >= max_blocks) return;
+      // the tokenizer stops after the last block wanted
+      if (max_blocks > 0 && ++taken == max_blocks) tokenizer->RequestStop();
+    }
+
+    std::string sample;
+    if (data->blob.data_case() == OSMPBF::Blob::kRaw) {
+      sample.assign(reinterpret_cast<const char*>(data->blob_data.Data()),
+                    data->blob_data.Size());
+    } else {
+      auto raw = InflateBlob(*data);
+      if (raw) {
+        sample.assign(reinterpret_cast<const char*>(raw->Data()), raw->Size());
+        raw->Destroy();
+      }
+    }
+
+    absl::MutexLock lock(&mu);
+    if (sample.empty()) {
+      failed = true;
+      return;
+    }
+
+    corpus.bytes += sample.size();
+    corpus.samples.push_back(std::move(sample));
+  });
+
+  auto finished = core::StreamState::Unknown;
+  reader.OnFinished([&finished](osm::pbf::PbfTokenizer*,
+                                core::StreamState s) { finished = s; });
+
+  auto state = reader.Start(false);
+  reader.Stop();
+
+  auto is_finished = finished == core::StreamState::Ok ||
+                     (finished == core::StreamState::Stoped && max_blocks > 0);
+  if (state != core::StreamState::Ok || !is_finished || failed) {
+    std::cerr << "Benchmark : can not read " << file << std::endl;
+    return false;
+  }
+
+  return !corpus.samples.empty();
+}
+
+// every regular file below `directory` is one tile
+bool LoadTiles(const std::string& directory, Corpus& corpus) {
+  corpus.name = std::filesystem::path(directory).filename().string();
+  corpus.kind = "tiles";
+
+  std::error_code ec;
+  for (auto& entry :
+       std::filesystem::recursive_directory_iterator(directory, ec)) {
+    if (!entry.is_regular_file()) continue;
+
+    std::ifstream file(entry.path(), std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(file)),
+                      std::istreambuf_iterator<char>());
+    if (bytes.empty()) continue;
+
+    corpus.bytes += bytes.size();
+    corpus.samples.push_back(std::move(bytes));
+  }
+
+  if (ec) {
+    std::cerr << "Benchmark : can not read " << directory << " ("
+              << ec.message() << ")" << std::endl;
+  }
+
+  return !corpus.samples.empty();
+}
+
+Result Measure(const Corpus& corpus, const CodecCase& codec_case,
+               size_t iterations) {
+  using clock = std::chrono::steady_clock;
+
+  Result result;
+  result.corpus = corpus.name;
+  result.codec = codec_case.codec;
+  result.level = codec_case.level;
+  result.samples = corpus.samples.size();
+  result.raw_bytes = corpus.bytes;
+
+  auto codec = codec_case.create();
+  std::vector<std::shared_ptr<core::MemoryBuffer>> packed(
+      corpus.samples.size());
+
+  // the raw size is known for every sample, as Blob.raw_size is for PBF
+  size_t largest = 0;
+  for (auto& sample : corpus.samples) {
+    largest = std::max(largest, sample.size());
+  }
+  std::vector<uint8_t> raw(largest);
+
+  auto release = [&packed]() {
+    for (auto& buffer : packed) {
+      if (buffer) buffer->Destroy();
+      buffer.reset();
+    }
+  };
+
+  for (size_t i = 0; i < iterations; i++) {
+    release();
+    uint64_t compressed = 0;
+    bool state = false;
+
+    auto started = clock::now();
+    for (size_t s = 0; s < corpus.samples.size(); s++) {
+      auto& sample = corpus.samples[s];
+      packed[s] = codec->Deflate(
+          reinterpret_cast<const uint8_t*>(sample.data()), sample.size(),
+          state);
+      if (!state || !packed[s]) {
+        release();
+        return result;
+      }
+
+      compressed += packed[s]->Size();
+    }
+    double deflate = std::chrono::duration<double>(clock::now() - started)
+                         .count();
+
+    started = clock::now();
+    for (size_t s = 0; s < corpus.samples.size(); s++) {
+      auto& sample = corpus.samples[s];
+      if (!codec_case.inflate_into(codec.get(), packed[s]->Data(),
+                                   packed[s]->Size(), raw.data(),
+                                   sample.size())) {
+        std::cerr << "Benchmark : " << codec_case.codec << " level "
+                  << codec_case.level << " can not inflate "
+                  << corpus.name << std::endl;
+        release();
+        return result;
+      }
+
+      // the first pass also checks the round trip, later passes are pure
+      // inflate and normally the best
+      auto same =
+          i > 0 || memcmp(raw.data(), sample.data(), sample.size()) == 0;
+      if (!same) {
+        std::cerr << "Benchmark : " << codec_case.codec << " level "
+                  << codec_case.level << " round trip mismatch on "
+                  << corpus.name << std::endl;
+        release();
+        return result;
+      }
+    }
+    double inflate = std::chrono::duration<double>(clock::now() - started)
+                         .count();
+
+    result.compressed_bytes = compressed;
+    if (i == 0 || deflate < result.deflate_seconds) {
+      result.deflate_seconds = deflate;
+    }
+    if (i == 0 || inflate < result.inflate_seconds) {
+      result.inflate_seconds = inflate;
+    }
+  }
+
+  release();
+  result.ok = true;
+  return result;
+}
+
+std::string JsonEscape(const std::string& value) {
+  std::ostringstream out;
+  for (auto c : value) {
+    switch (c) {
+      case '"':
+        out << "\\\"";
+        break;
+      case '\\':
+        out << "\\\\";
+        break;
+      case '\n':
+        out << "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          out << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+              << int(c) << std::dec;
+        } else {
+          out << c;
+        }
+    }
+  }
+
+  return out.str();
+}
+
+void WriteJson(std::ostream& out, const std::vector<Corpus>& corpora,
+               const std::vector<Result>& results, size_t iterations) {
+  out << std::setprecision(6);
+  out << "{\n";
+  out << "  \"timestamp\": " << std::time(nullptr) << ",\n";
+  out << "  \"iterations\": " << iterations << ",\n";
+
+  out << "  \"corpora\": [\n";
+  for (size_t i = 0; i < corpora.size(); i++) {
+    auto& c = corpora[i];
+    out << "    {\"name\": \"" << JsonEscape(c.name) << "\", \"kind\": \""
+        << c.kind << "\", \"samples\": " << c.samples.size()
+        << ", \"bytes\": " << c.bytes << "}"
+        << (i + 1 < corpora.size() ? "," : "") << "\n";
+  }
+  out << "  ],\n";
+
+  out << "  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    auto& r = results[i];
+    out << "    {\"corpus\": \"" << JsonEscape(r.corpus) << "\", "
+        << "\"codec\": \"" << r.codec << "\", "
+        << "\"level\": " << r.level << ", "
+        << "\"ok\": " << (r.ok ? "true" : "false") << ", "
+        << "\"samples\": " << r.samples << ", "
+        << "\"raw_bytes\": " << r.raw_bytes << ", "
+        << "\"compressed_bytes\": " << r.compressed_bytes << ", "
+        << "\"ratio\": " << r.Ratio() << ", "
+        << "\"deflate_seconds\": " << r.deflate_seconds << ", "
+        << "\"inflate_seconds\": " << r.inflate_seconds << ", "
+        << "\"deflate_mb_per_s\": " << r.DeflateMBps() << ", "
+        << "\"inflate_mb_per_s\": " << r.InflateMBps() << "}"
+        << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  out << "  ]\n";
+  out << "}\n";
+}
+
+void PrintUsage() {
+  std::cout << "usage: mavix-utils-v1-benchmark [file.osm.pbf ...] "
+            << "[--tiles <dir>] [--iterations <n>] [--max-blocks <n>] "
+            << "[--json <file>]" << std::endl;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  std::vector<std::string> pbf_files;
+  std::vector<std::string> tile_dirs;
+  std::string json_file = "codec_benchmark.json";
+  size_t iterations = 3;
+  size_t max_blocks = 0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto has_value = i + 1 < argc;
+
+    if (arg == "--help" || arg == "-h") {
+      PrintUsage();
+      return 0;
+    } else if (arg == "--tiles" && has_value) {
+      tile_dirs.push_back(argv[++i]);
+    } else if (arg == "--iterations" && has_value) {
+      iterations = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--max-blocks" && has_value) {
+      max_blocks = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+    } else if (arg == "--json" && has_value) {
+      json_file = argv[++i];
+    } else if (arg.rfind("--", 0) == 0) {
+      PrintUsage();
+      return 1;
+    } else {
+      pbf_files.push_back(arg);
+    }
+  }
+
+  if (pbf_files.empty() && tile_dirs.empty()) {
+    std::error_code ec;
+    for (auto& entry : std::filesystem::directory_iterator(
+             MAVIX_BENCHMARK_RESOURCES_DIR, ec)) {
+      if (entry.path().extension() == ".pbf") {
+        pbf_files.push_back(entry.path().string());
+      }
+    }
+
+    std::sort(pbf_files.begin(), pbf_files.end());
+  }
+
+  std::vector<Corpus> corpora;
+  for (auto& file : pbf_files) {
+    Corpus corpus;
+    if (LoadPbf(file, max_blocks, corpus)) corpora.push_back(std::move(corpus));
+  }
+
+  for (auto& directory : tile_dirs) {
+    Corpus corpus;
+    if (LoadTiles(directory, corpus)) corpora.push_back(std::move(corpus));
+  }
+
+  if (corpora.empty()) {
+    std::cerr << "Benchmark : nothing to measure" << std::endl;
+    PrintUsage();
+    return 1;
+  }
+
+  std::vector<Result> results;
+  bool ok = true;
+
+  // stdout is kept clean for the JSON when it goes there
+  auto& table = json_file == "-" ? std::cerr : std::cout;
+  table << std::left << std::setw(34) << "corpus" << std::setw(6) << "codec"
+        << std::right << std::setw(6) << "level" << std::setw(9) << "ratio"
+        << std::setw(12) << "deflate" << std::setw(12) << "inflate"
+        << std::endl;
+
+  for (auto& corpus : corpora) {
+    for (auto& codec_case : CodecCases()) {
+      auto result = Measure(corpus, codec_case, iterations);
+      ok = ok && result.ok;
+
+      table << std::left << std::setw(34) << corpus.name << std::setw(6)
+            << codec_case.codec << std::right << std::setw(6)
+            << codec_case.level << std::fixed << std::setprecision(2)
+            << std::setw(9) << result.Ratio() << std::setw(7)
+            << result.DeflateMBps() << " MB/s" << std::setw(7)
+            << result.InflateMBps() << " MB/s"
+            << (result.ok ? "" : "  FAILED") << std::endl;
+
+      results.push_back(std::move(result));
+    }
+  }
+
+  if (json_file == "-") {
+    WriteJson(std::cout, corpora, results, iterations);
+  } else {
+    std::ofstream out(json_file, std::ios::trunc);
+    WriteJson(out, corpora, results, iterations);
+    if (!out.good()) {
+      std::cerr << "Benchmark : can not write " << json_file << std::endl;
+      return 1;
+    }
+  }
+
+  return ok ? 0 : 1;
+}
@@ -1,7 +1,11 @@
 #pragma once
 
 #include "mavix/v1/utils/icompression.h"
+#include "mavix/v1/utils/lz4_compression.h"
+#include "mavix/v1/utils/lzma_compression.h"
 #include "mavix/v1/utils/zlib_compression.h"
+#include "mavix/v1/utils/zstd_compression.h"
+#include "mavix/v1/utils/zstd_dict_compression.h"
 
 namespace mavix {
 namespace v1 {
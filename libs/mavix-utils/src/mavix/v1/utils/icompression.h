@@ -13,6 +13,11 @@ using namespace mavix::v1::core;
 class ICompression {
  private:
  public:
+  // upper bound for any inflated buffer, OSM blocks are <= 32 MB
+  static constexpr size_t kMaxInflatedSize = 64 * 1024 * 1024;
+
+  virtual ~ICompression() = default;
+
   virtual std::shared_ptr<MemoryBuffer> Inflate(
       std::shared_ptr<MemoryBuffer> buffer) = 0;
 
@@ -1,21 +1,167 @@
 #pragma once
 
+#include <mavix/v1/core/core.h>
+
+#include <climits>
 #include <cstdint>
+#include <cstring>
+#include <iostream>
 #include <memory>
 #include <vector>
 
 #include "lz4.h"
-
+#include "lz4hc.h"
+#include "mavix/v1/core/memory_buffer.h"
+#include "mavix/v1/utils/icompression.h"
 
 namespace mavix {
 namespace v1 {
 namespace utils {
-    
-class Lz4Compression {
+
+using namespace mavix::v1::core;
+
+/**
+ * @brief LZ4 block codec, as used by Blob.lz4_data. Blocks carry no header,
+ * so the inflated size has to come from the caller (Blob.raw_size); without
+ * it Inflate() grows its guess until the block fits. Levels from
+ * LZ4HC_CLEVEL_MIN up compress with LZ4 HC, decoding is the same.
+ */
+class Lz4Compression : public ICompression {
  private:
+  // first guess when the inflated size is unknown
+  static constexpr size_t kInitialRatio = 4;
+
+  int level_;
+
  public:
-  Lz4Compression();
-  ~Lz4Compression();
+  explicit Lz4Compression(int level = 0) : level_(level) {}
+
+  ~Lz4Compression() {}
+
+  int Level() const { return level_; }
+
+  void SetLevel(int level) { level_ = level; }
+
+  /**
+   * @brief Inflate `source` straight into `dest`. True only when the block
+   * decodes to exactly `dest_size` bytes.
+   */
+  bool InflateInto(const uint8_t *source, size_t source_size, uint8_t *dest,
+                   size_t dest_size) {
+    if (!source || !dest || source_size == 0 || dest_size == 0) return false;
+    if (source_size > INT_MAX || dest_size > INT_MAX) return false;
+
+    auto ret = LZ4_decompress_safe(reinterpret_cast<const char *>(source),
+                                   reinterpret_cast<char *>(dest),
+                                   static_cast<int>(source_size),
+                                   static_cast<int>(dest_size));
+    return ret >= 0 && static_cast<size_t>(ret) == dest_size;
+  }
+
+  /**
+   * @brief Inflate into one buffer of exactly `raw_size` bytes, unknown
+   * sizes (0) go through the growing Inflate().
+   */
+  std::shared_ptr<MemoryBuffer> Inflate(const uint8_t *source,
+                                        size_t source_size, size_t raw_size,
+                                        bool &result) {
+    result = false;
+    if (raw_size == 0) return Inflate(source, source_size, result);
+    if (raw_size > kMaxInflatedSize) {
+      std::cerr << "LZ4 Inflate Exception : raw size " << raw_size
+                << " larger than " << kMaxInflatedSize << " bytes"
+                << std::endl;
+      return nullptr;
+    }
+
+    auto buffer = std::make_shared<MemoryBuffer>(
+        raw_size, memory::MemoryCategory::Inflate);
+    if (InflateInto(source, source_size, buffer->Data(), raw_size)) {
+      result = true;
+      return buffer;
+    }
+
+    buffer->Destroy();
+    std::cerr << "LZ4 Inflate Exception : block does not match raw size "
+              << raw_size << std::endl;
+    return nullptr;
+  }
+
+  std::shared_ptr<MemoryBuffer> Inflate(const uint8_t *source,
+                                        size_t source_size,
+                                        bool &result) override {
+    result = false;
+    if (!source || source_size == 0 || source_size > INT_MAX) return nullptr;
+
+    auto capacity = source_size * kInitialRatio;
+    while (true) {
+      if (capacity > kMaxInflatedSize) capacity = kMaxInflatedSize;
+
+      MemoryBuffer scratch(capacity, memory::MemoryCategory::Inflate);
+      auto ret = LZ4_decompress_safe(
+          reinterpret_cast<const char *>(source),
+          reinterpret_cast<char *>(scratch.Data()),
+          static_cast<int>(source_size), static_cast<int>(capacity));
+
+      if (ret > 0) {
+        auto buffer = std::make_shared<MemoryBuffer>(
+            static_cast<size_t>(ret), memory::MemoryCategory::Inflate);
+        buffer->CopyFrom(scratch.Data(), static_cast<size_t>(ret));
+        scratch.Destroy();
+        result = true;
+        return buffer;
+      }
+
+      scratch.Destroy();
+      if (capacity >= kMaxInflatedSize) break;
+      capacity *= 2;
+    }
+
+    std::cerr << "LZ4 Inflate Exception : malformed block or larger than "
+              << kMaxInflatedSize << " bytes" << std::endl;
+    return nullptr;
+  }
+
+  std::shared_ptr<MemoryBuffer> Deflate(const uint8_t *source, size_t size,
+                                        bool &result) override {
+    result = false;
+    if (!source || size == 0 || size > LZ4_MAX_INPUT_SIZE) return nullptr;
+
+    auto bound = LZ4_compressBound(static_cast<int>(size));
+    MemoryBuffer scratch(static_cast<size_t>(bound));
+
+    auto input = reinterpret_cast<const char *>(source);
+    auto output = reinterpret_cast<char *>(scratch.Data());
+    auto written =
+        level_ >= LZ4HC_CLEVEL_MIN
+            ? LZ4_compress_HC(input, output, static_cast<int>(size), bound,
+                              level_)
+            : LZ4_compress_default(input, output, static_cast<int>(size),
+                                   bound);
+    if (written <= 0) {
+      scratch.Destroy();
+      return nullptr;
+    }
+
+    auto buffer = std::make_shared<MemoryBuffer>(static_cast<size_t>(written));
+    buffer->CopyFrom(scratch.Data(), static_cast<size_t>(written));
+    scratch.Destroy();
+
+    result = true;
+    return buffer;
+  }
+
+  std::shared_ptr<MemoryBuffer> Deflate(
+      std::shared_ptr<MemoryBuffer> buffer) override {
+    bool result;
+    return Deflate(buffer->Data(), buffer->Size(), result);
+  }
+
+  std::shared_ptr<MemoryBuffer> Inflate(
+      std::shared_ptr<MemoryBuffer> buffer) override {
+    bool result;
+    return Inflate(buffer->Data(), buffer->Size(), result);
+  }
 };
 
 }  // namespace utils
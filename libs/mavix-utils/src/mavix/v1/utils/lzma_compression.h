@@ -1,14 +1,330 @@
 #pragma once
 
+#include <mavix/v1/core/core.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <vector>
+
+#include "LzmaDec.h"
+#include "LzmaEnc.h"
+#include "mavix/v1/core/memory/memory_allocator.h"
+#include "mavix/v1/core/memory/memory_governor.h"
+#include "mavix/v1/core/memory_buffer.h"
+#include "mavix/v1/core/segment_buffer.h"
+#include "mavix/v1/utils/icompression.h"
+
 namespace mavix {
 namespace v1 {
 namespace utils {
-    
-class LzmaCompression {
+
+using namespace mavix::v1::core;
+
+/**
+ * @brief LZMA codec for Blob.lzma_data, on top of the LZMA SDK in
+ * deps/lzma/C.
+ *
+ * Payloads use the .lzma ("LZMA alone") layout: 5 bytes of coder properties
+ * followed by the inflated size as 8 bytes little endian, all ones when
+ * unknown. Decoder state, including the dictionary of the streaming path,
+ * lives in the instance and is reused for the next block; it is allocated
+ * through MemoryAllocator and charged as Inflate memory.
+ */
+class LzmaCompression : public ICompression {
+ public:
+  static constexpr size_t kHeaderSize = LZMA_PROPS_SIZE + 8;
+
  private:
+  static constexpr size_t kChunkSize = 32768;
+  static constexpr size_t kAllocHeader = alignof(std::max_align_t);
+  static constexpr uint64_t kUnknownSize = ~uint64_t(0);
+
+  // LZMA SDK allocations, the size is kept in front of the block since
+  // Free() does not receive it
+  static void *PooledAlloc(ISzAllocPtr, size_t size) {
+    memory::MemoryAllocator<uint8_t> allocator;
+    uint8_t *block = nullptr;
+    try {
+      block = allocator.allocate(size + kAllocHeader);
+    } catch (const std::bad_alloc &) {
+      return nullptr;
+    }
+
+    *reinterpret_cast<size_t *>(block) = size;
+    memory::MemoryGovernor::Global().Charge(memory::MemoryCategory::Inflate,
+                                            size);
+    return block + kAllocHeader;
+  }
+
+  static void PooledFree(ISzAllocPtr, void *address) {
+    if (!address) return;
+
+    auto block = static_cast<uint8_t *>(address) - kAllocHeader;
+    auto size = *reinterpret_cast<size_t *>(block);
+    memory::MemoryGovernor::Global().Release(memory::MemoryCategory::Inflate,
+                                             size);
+
+    memory::MemoryAllocator<uint8_t> allocator;
+    allocator.deallocate(block, size + kAllocHeader);
+  }
+
+  static const ISzAlloc *Allocator() {
+    static const ISzAlloc allocator = {&PooledAlloc, &PooledFree};
+    return &allocator;
+  }
+
+  // probability tables only, decodes straight into the caller's buffer
+  std::unique_ptr<CLzmaDec> direct_;
+  // probability tables and dictionary, for the chunked output
+  std::unique_ptr<CLzmaDec> stream_;
+  int level_;
+
+  static uint64_t HeaderSize(const uint8_t *source) {
+    uint64_t size = 0;
+    for (size_t i = 0; i < 8; i++) {
+      size |= uint64_t(source[LZMA_PROPS_SIZE + i]) << (8 * i);
+    }
+
+    return size;
+  }
+
+  static CLzmaDec *NewState(std::unique_ptr<CLzmaDec> &state) {
+    if (!state) {
+      state = std::make_unique<CLzmaDec>();
+      LzmaDec_CONSTRUCT(state.get());
+    }
+
+    return state.get();
+  }
+
  public:
-  LzmaCompression();
-  ~LzmaCompression();
+  explicit LzmaCompression(int level = 5)
+      : direct_(nullptr), stream_(nullptr), level_(level) {}
+
+  ~LzmaCompression() {
+    if (direct_) LzmaDec_FreeProbs(direct_.get(), Allocator());
+    if (stream_) LzmaDec_Free(stream_.get(), Allocator());
+  }
+
+  LzmaCompression(const LzmaCompression &) = delete;
+  LzmaCompression &operator=(const LzmaCompression &) = delete;
+  LzmaCompression(LzmaCompression &&) = default;
+  LzmaCompression &operator=(LzmaCompression &&) = default;
+
+  int Level() const { return level_; }
+
+  void SetLevel(int level) { level_ = level; }
+
+  /**
+   * @brief Inflate `source` straight into `dest`, no dictionary is
+   * allocated. True only when the stream yields exactly `dest_size` bytes.
+   */
+  bool InflateInto(const uint8_t *source, size_t source_size, uint8_t *dest,
+                   size_t dest_size) {
+    if (!source || !dest || source_size <= kHeaderSize || dest_size == 0) {
+      return false;
+    }
+
+    auto declared = HeaderSize(source);
+    if (declared != kUnknownSize && declared != dest_size) return false;
+
+    auto state = NewState(direct_);
+    if (LzmaDec_AllocateProbs(state, source, LZMA_PROPS_SIZE, Allocator()) !=
+        SZ_OK) {
+      return false;
+    }
+
+    state->dic = dest;
+    state->dicBufSize = dest_size;
+    LzmaDec_Init(state);
+
+    SizeT in_size = source_size - kHeaderSize;
+    ELzmaStatus status;
+    auto ret = LzmaDec_DecodeToDic(state, dest_size, source + kHeaderSize,
+                                   &in_size, LZMA_FINISH_END, &status);
+
+    auto written = state->dicPos;
+    state->dic = nullptr;
+    state->dicBufSize = 0;
+
+    return ret == SZ_OK && written == dest_size &&
+           (status == LZMA_STATUS_FINISHED_WITH_MARK ||
+            status == LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK);
+  }
+
+  /**
+   * @brief Inflate into one buffer of exactly `raw_size` bytes. When
+   * `raw_size` is 0 the size from the stream header is used, streams
+   * without one go through the chunked Inflate().
+   */
+  std::shared_ptr<MemoryBuffer> Inflate(const uint8_t *source,
+                                        size_t source_size, size_t raw_size,
+                                        bool &result) {
+    result = false;
+    if (!source || source_size <= kHeaderSize) return nullptr;
+
+    if (raw_size == 0) {
+      auto declared = HeaderSize(source);
+      if (declared == kUnknownSize || declared == 0) {
+        return Inflate(source, source_size, result);
+      }
+
+      if (declared > kMaxInflatedSize) {
+        std::cerr << "LZMA Inflate Exception : declared size " << declared
+                  << " larger than " << kMaxInflatedSize << " bytes"
+                  << std::endl;
+        return nullptr;
+      }
+
+      raw_size = static_cast<size_t>(declared);
+    }
+
+    if (raw_size > kMaxInflatedSize) {
+      std::cerr << "LZMA Inflate Exception : raw size " << raw_size
+                << " larger than " << kMaxInflatedSize << " bytes"
+                << std::endl;
+      return nullptr;
+    }
+
+    auto buffer = std::make_shared<MemoryBuffer>(
+        raw_size, memory::MemoryCategory::Inflate);
+    if (InflateInto(source, source_size, buffer->Data(), raw_size)) {
+      result = true;
+      return buffer;
+    }
+
+    buffer->Destroy();
+    return Inflate(source, source_size, result);
+  }
+
+  std::shared_ptr<MemoryBuffer> Inflate(const uint8_t *source,
+                                        size_t source_size,
+                                        bool &result) override {
+    result = false;
+    if (!source || source_size <= kHeaderSize) return nullptr;
+
+    // keeps the dictionary of the previous block when the size matches
+    auto state = NewState(stream_);
+    if (LzmaDec_Allocate(state, source, LZMA_PROPS_SIZE, Allocator()) !=
+        SZ_OK) {
+      std::cerr << "LZMA Inflate Init Exception : bad properties" << std::endl;
+      return nullptr;
+    }
+
+    LzmaDec_Init(state);
+
+    auto remaining = HeaderSize(source);
+    auto input = source + kHeaderSize;
+    SizeT input_left = source_size - kHeaderSize;
+
+    SegmentBuffer buffers(kChunkSize, memory::MemoryCategory::Inflate);
+    MemoryBuffer outbuffer(kChunkSize, memory::MemoryCategory::Inflate);
+
+    SRes ret = SZ_OK;
+    ELzmaStatus status = LZMA_STATUS_NOT_SPECIFIED;
+    size_t total = 0;
+
+    while (remaining != 0) {
+      SizeT out_size = kChunkSize;
+      auto finish = LZMA_FINISH_ANY;
+      if (remaining != kUnknownSize && remaining <= kChunkSize) {
+        out_size = static_cast<SizeT>(remaining);
+        finish = LZMA_FINISH_END;
+      }
+
+      SizeT in_size = input_left;
+      ret = LzmaDec_DecodeToBuf(state, outbuffer.Data(), &out_size, input,
+                                &in_size, finish, &status);
+      input += in_size;
+      input_left -= in_size;
+
+      total += out_size;
+      if (total > kMaxInflatedSize) break;
+      if (out_size > 0) buffers.Add(outbuffer.Data(), out_size);
+      if (remaining != kUnknownSize) remaining -= out_size;
+
+      if (ret != SZ_OK || status == LZMA_STATUS_FINISHED_WITH_MARK) break;
+      if (in_size == 0 && out_size == 0) break;
+    }
+
+    outbuffer.Destroy();
+
+    if (total > kMaxInflatedSize) {
+      buffers.Destroy();
+      std::cerr << "LZMA Inflate Exception : larger than " << kMaxInflatedSize
+                << " bytes" << std::endl;
+      return nullptr;
+    }
+
+    auto finished =
+        ret == SZ_OK && (status == LZMA_STATUS_FINISHED_WITH_MARK ||
+                         (remaining == 0 &&
+                          status == LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK));
+    if (!finished) {
+      buffers.Destroy();
+      std::cerr << "LZMA Inflate Exception : (" << ret << ") status "
+                << status << std::endl;
+      return nullptr;
+    }
+
+    auto flat_buffer = buffers.CopyAsMemoryBuffer();
+    buffers.Destroy();
+
+    if (flat_buffer) result = true;
+    return flat_buffer;
+  }
+
+  std::shared_ptr<MemoryBuffer> Deflate(const uint8_t *source, size_t size,
+                                        bool &result) override {
+    result = false;
+    if (!source || size == 0) return nullptr;
+
+    CLzmaEncProps props;
+    LzmaEncProps_Init(&props);
+    props.level = level_;
+    props.reduceSize = size;
+    props.numThreads = 1;
+
+    auto bound = kHeaderSize + size + size / 3 + 128;
+    MemoryBuffer scratch(bound);
+
+    SizeT props_size = LZMA_PROPS_SIZE;
+    SizeT written = bound - kHeaderSize;
+    auto ret = LzmaEncode(scratch.Data() + kHeaderSize, &written, source, size,
+                          &props, scratch.Data(), &props_size, 0, nullptr,
+                          Allocator(), Allocator());
+    if (ret != SZ_OK || props_size != LZMA_PROPS_SIZE) {
+      scratch.Destroy();
+      return nullptr;
+    }
+
+    for (size_t i = 0; i < 8; i++) {
+      *scratch.Data(LZMA_PROPS_SIZE + i) = uint8_t(uint64_t(size) >> (8 * i));
+    }
+
+    auto buffer = std::make_shared<MemoryBuffer>(kHeaderSize + written);
+    buffer->CopyFrom(scratch.Data(), kHeaderSize + written);
+    scratch.Destroy();
+
+    result = true;
+    return buffer;
+  }
+
+  std::shared_ptr<MemoryBuffer> Deflate(
+      std::shared_ptr<MemoryBuffer> buffer) override {
+    bool result;
+    return Deflate(buffer->Data(), buffer->Size(), result);
+  }
+
+  std::shared_ptr<MemoryBuffer> Inflate(
+      std::shared_ptr<MemoryBuffer> buffer) override {
+    bool result;
+    return Inflate(buffer->Data(), buffer->Size(), result);
+  }
 };
 
 }  // namespace utils
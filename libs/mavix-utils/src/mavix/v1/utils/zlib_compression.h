@@ -3,27 +3,139 @@
 #include <mavix/v1/core/core.h>
 #include <zlib.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <sstream>
 #include <vector>
 
 #include "mavix/v1/core/memory_buffer.h"
 #include "mavix/v1/core/segment_buffer.h"
 #include "mavix/v1/utils/icompression.h"
+#include "mavix/v1/utils/zlib_parallel_deflate.h"
 #include "nvm/strings/readable_bytes.h"
 namespace mavix {
 namespace v1 {
 namespace utils {
 
 using namespace mavix::v1::core;
+
+/**
+ * @brief zlib codec. The single-shot InflateInto() keeps one inflate state
+ * per instance and only resets it between calls, so a worker holding its own
+ * instance inflates every block without setting zlib up again. Deflate()
+ * does the same with its own deflate state, and hands large inputs to a
+ * shared ZlibParallelDeflate when one is set.
+ */
 class ZlibCompression : public ICompression {
  private:
+  std::unique_ptr<z_stream> inflate_stream_;
+  std::unique_ptr<z_stream> deflate_stream_;
+  std::shared_ptr<ZlibParallelDeflate> parallel_;
+  int level_;
+  int deflate_level_;
+
+  // zlib counts in uInt, larger buffers are handed over a window at a time
+  static void Refill(uInt &avail, size_t &left) {
+    if (avail > 0 || left == 0) return;
+
+    avail = static_cast<uInt>(
+        std::min<size_t>(left, std::numeric_limits<uInt>::max()));
+    left -= avail;
+  }
+
  public:
-  ZlibCompression() {}
+  explicit ZlibCompression(int level = Z_DEFAULT_COMPRESSION)
+      : inflate_stream_(nullptr),
+        deflate_stream_(nullptr),
+        parallel_(nullptr),
+        level_(level),
+        deflate_level_(level) {}
+
+  ~ZlibCompression() {
+    if (inflate_stream_) inflateEnd(inflate_stream_.get());
+    if (deflate_stream_) deflateEnd(deflate_stream_.get());
+  }
+
+  ZlibCompression(const ZlibCompression &) = delete;
+  ZlibCompression &operator=(const ZlibCompression &) = delete;
+  ZlibCompression(ZlibCompression &&) = default;
+  ZlibCompression &operator=(ZlibCompression &&) = default;
+
+  int Level() const { return level_; }
+
+  void SetLevel(int level) { level_ = level; }
+
+  /**
+   * @brief Inflate `source` straight into `dest` when the inflated size is
+   * known up front, as with Blob.raw_size. True only when the stream ends
+   * after exactly `dest_size` bytes.
+   */
+  bool InflateInto(const uint8_t *source, size_t source_size, uint8_t *dest,
+                   size_t dest_size) {
+    if (!source || !dest || source_size == 0 || dest_size == 0) return false;
+
+    if (!inflate_stream_) {
+      inflate_stream_ = std::make_unique<z_stream>();
+      memset(inflate_stream_.get(), 0, sizeof(z_stream));
+
+      if (inflateInit(inflate_stream_.get()) != Z_OK) {
+        std::cerr << "ZLib Inflate Init Exception :" << inflate_stream_->msg
+                  << std::endl;
+        inflate_stream_.reset();
+        return false;
+      }
+    } else if (inflateReset(inflate_stream_.get()) != Z_OK) {
+      return false;
+    }
+
+    auto zs = inflate_stream_.get();
+    zs->next_in = const_cast<Bytef *>(reinterpret_cast<const Bytef *>(source));
+    zs->avail_in = 0;
+    zs->next_out = reinterpret_cast<Bytef *>(dest);
+    zs->avail_out = 0;
+
+    auto in_left = source_size;
+    auto out_left = dest_size;
+    int ret;
+    do {
+      Refill(zs->avail_in, in_left);
+      Refill(zs->avail_out, out_left);
+      ret = inflate(zs, in_left == 0 && out_left == 0 ? Z_FINISH : Z_NO_FLUSH);
+    } while (ret == Z_OK);
 
-  ~ZlibCompression() {}
+    return ret == Z_STREAM_END && out_left == 0 && zs->avail_out == 0;
+  }
+
+  /**
+   * @brief Inflate into one buffer of exactly `raw_size` bytes, falls back
+   * to the chunked Inflate() when the stream does not match `raw_size`.
+   */
+  std::shared_ptr<MemoryBuffer> Inflate(const uint8_t *source,
+                                        size_t source_size, size_t raw_size,
+                                        bool &result) {
+    result = false;
+    if (raw_size == 0) return Inflate(source, source_size, result);
+    if (raw_size > kMaxInflatedSize) {
+      std::cerr << "Zlib Inflate Exception : raw size " << raw_size
+                << " larger than " << kMaxInflatedSize << " bytes"
+                << std::endl;
+      return nullptr;
+    }
+
+    auto buffer = std::make_shared<MemoryBuffer>(
+        raw_size, memory::MemoryCategory::Inflate);
+    if (InflateInto(source, source_size, buffer->Data(), raw_size)) {
+      result = true;
+      return buffer;
+    }
+
+    buffer->Destroy();
+    return Inflate(source, source_size, result);
+  }
 
   std::shared_ptr<MemoryBuffer> Inflate(const uint8_t *source,
                                         size_t source_size,
@@ -62,19 +174,24 @@ class ZlibCompression : public ICompression {
 
     zs_ptr.get()->next_in =
         const_cast<Bytef *>(reinterpret_cast<const Bytef *>(source));
-    zs_ptr.get()->avail_in = static_cast<uInt>(source_size);
+    zs_ptr.get()->avail_in = 0;
+    auto in_left = source_size;
 
     int ret;
-    SegmentBuffer buffers(32768);
-    MemoryBuffer outbuffer(32768);
+    size_t total = 0;
+    SegmentBuffer buffers(32768, memory::MemoryCategory::Inflate);
+    MemoryBuffer outbuffer(32768, memory::MemoryCategory::Inflate);
 
     do {
+      Refill(zs_ptr.get()->avail_in, in_left);
       zs_ptr.get()->next_out = reinterpret_cast<Bytef *>(outbuffer.Data());
       zs_ptr.get()->avail_out = static_cast<uInt>(outbuffer.Size());
 
       ret = inflate(zs_ptr.get(), Z_NO_FLUSH);
       if (ret == Z_OK || ret == Z_STREAM_END) {
         size_t written = 32768 - zs_ptr->avail_out;
+        total += written;
+        if (total > kMaxInflatedSize) break;
         buffers.Add(outbuffer.Data(), written);
       }
     } while (ret == Z_OK);
@@ -82,6 +199,13 @@ class ZlibCompression : public ICompression {
     outbuffer.Destroy();
     inflateEnd(zs_ptr.get());
 
+    if (total > kMaxInflatedSize) {
+      buffers.Destroy();
+      std::cerr << "Zlib Inflate Exception : larger than " << kMaxInflatedSize
+                << " bytes" << std::endl;
+      return nullptr;
+    }
+
     if (ret != Z_STREAM_END) {
       buffers.Destroy();
       std::ostringstream oss;
@@ -101,58 +225,79 @@ class ZlibCompression : public ICompression {
     return flat_buffer;
   };
 
+  /**
+   * @brief Inputs larger than two chunks are compressed by `parallel` from
+   * then on, nullptr goes back to a single stream. The output stays one
+   * zlib stream either way; the level of `parallel` applies.
+   */
+  void SetParallelDeflate(std::shared_ptr<ZlibParallelDeflate> parallel) {
+    parallel_ = std::move(parallel);
+  }
+
+  const std::shared_ptr<ZlibParallelDeflate> &ParallelDeflate() const {
+    return parallel_;
+  }
+
   std::shared_ptr<MemoryBuffer> Deflate(const uint8_t *source, size_t size,
                                         bool &result) override {
-    if (!source || size == 0) {
-      result = false;
-      return nullptr;
+    result = false;
+    if (!source || size == 0) return nullptr;
+
+    if (parallel_ && size > 2 * parallel_->ChunkSize()) {
+      return parallel_->Deflate(source, size, result, DeflateFormat::Zlib);
     }
 
-    auto zs_ptr = std::make_unique<z_stream>();
-    z_stream *zs = zs_ptr.get();
-    memset(zs, 0, sizeof(z_stream));
+    if (!deflate_stream_ || deflate_level_ != level_) {
+      if (deflate_stream_) deflateEnd(deflate_stream_.get());
+
+      deflate_stream_ = std::make_unique<z_stream>();
+      memset(deflate_stream_.get(), 0, sizeof(z_stream));
 
-    if (deflateInit(zs, Z_DEFAULT_COMPRESSION) != Z_OK) {
-      result = false;
+      if (deflateInit(deflate_stream_.get(), level_) != Z_OK) {
+        std::cerr << "ZLib Deflate Init Exception :" << deflate_stream_->msg
+                  << std::endl;
+        deflate_stream_.reset();
+        return nullptr;
+      }
+
+      deflate_level_ = level_;
+    } else if (deflateReset(deflate_stream_.get()) != Z_OK) {
       return nullptr;
     }
 
+    // into a buffer deflate can not overrun, then cut to size
+    auto zs = deflate_stream_.get();
+    auto bound = deflateBound(zs, static_cast<uLong>(size));
+    MemoryBuffer scratch(bound);
+
     zs->next_in = reinterpret_cast<Bytef *>(const_cast<uint8_t *>(source));
-    zs->avail_in = size;
+    zs->avail_in = 0;
+    zs->next_out = reinterpret_cast<Bytef *>(scratch.Data());
+    zs->avail_out = 0;
 
+    size_t in_left = size;
+    size_t out_left = bound;
     int ret;
-    SegmentBuffer buffers(32768);
     do {
-      MemoryBuffer outbuffer(32768);
-      zs->next_out = reinterpret_cast<Bytef *>(outbuffer.Data());
-      zs->avail_out = outbuffer.Size();
-
-      ret = deflate(zs, Z_FINISH);
-      if (ret == Z_OK || ret == Z_STREAM_END) {
-        buffers.Add(std::move(outbuffer));
-        // compressed->insert(compressed->end(), outbuffer.begin(),
-        //                    outbuffer.begin() + (32768 - zs->avail_out));
-      } else {
-        outbuffer.Destroy();
-      }
+      Refill(zs->avail_in, in_left);
+      Refill(zs->avail_out, out_left);
+      ret = deflate(zs, in_left == 0 ? Z_FINISH : Z_NO_FLUSH);
     } while (ret == Z_OK);
 
-    deflateEnd(zs);
-
     if (ret != Z_STREAM_END) {
-      result = false;
+      std::cerr << "Zlib Deflate Exception : (" << ret << ") "
+                << (zs->msg ? zs->msg : "") << std::endl;
+      scratch.Destroy();
       return nullptr;
-
-      // std::ostringstream oss;
-      // oss << "Exception during compression: (" << ret << ") " << zs.msg;
-      // throw std::runtime_error(oss.str());
     }
 
-    result = true;
+    auto written = bound - out_left - zs->avail_out;
+    auto buffer = std::make_shared<MemoryBuffer>(written);
+    buffer->CopyFrom(scratch.Data(), written);
+    scratch.Destroy();
 
-    auto flat_buffer = buffers.CopyAsMemoryBuffer();
-    buffers.Destroy();
-    return std::move(flat_buffer);
+    result = true;
+    return buffer;
   };
 
   std::shared_ptr<MemoryBuffer> Deflate(
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "absl/synchronization/mutex.h"
+#include "mavix/v1/core/memory_buffer.h"
+#include "nvm/macro.h"
+
+namespace mavix {
+namespace v1 {
+namespace utils {
+
+enum class DeflateFormat { Zlib = 0, Gzip = 1 };
+
+// cppcheck-suppress unknownMacro
+NVM_ENUM_CLASS_DISPLAY_TRAIT(DeflateFormat)
+
+/**
+ * @brief pigz style deflate: the input is cut into chunks that compress
+ * independently on a pool of threads, then are stitched into one zlib or
+ * gzip stream.
+ *
+ * Each chunk is primed with the last 32 KB of the chunk before it, so the
+ * ratio stays close to a single stream, and all but the last end on a sync
+ * flush so they concatenate on byte boundaries. Checksums are computed per
+ * chunk and combined. The caller thread works on chunks too, and several
+ * callers may share one instance.
+ */
+class ZlibParallelDeflate {
+ public:
+  static constexpr size_t kDefaultChunkSize = 128 * 1024;
+  static constexpr size_t kDictionarySize = 32768;
+
+ private:
+  struct Batch;
+
+  struct Chunk {
+    Batch *batch;
+    const uint8_t *data;
+    size_t size;
+    bool is_last;
+    std::vector<uint8_t> output;
+    uint32_t check;
+    bool ok;
+  };
+
+  struct Batch {
+    std::vector<Chunk> chunks;
+    DeflateFormat format;
+    int level;
+    size_t pending;
+  };
+
+  // raw deflate state of one thread, kept between chunks
+  class Deflater {
+   private:
+    z_stream stream_;
+    bool is_init_;
+    int level_;
+
+   public:
+    Deflater() : stream_(), is_init_(false), level_(0) {}
+
+    ~Deflater() {
+      if (is_init_) deflateEnd(&stream_);
+    }
+
+    Deflater(const Deflater &) = delete;
+    Deflater &operator=(const Deflater &) = delete;
+
+    bool Run(Chunk &chunk, int level, DeflateFormat format) {
+      if (!is_init_ || level != level_) {
+        if (is_init_) deflateEnd(&stream_);
+        memset(&stream_, 0, sizeof(z_stream));
+
+        is_init_ = deflateInit2(&stream_, level, Z_DEFLATED, -MAX_WBITS, 8,
+                                Z_DEFAULT_STRATEGY) == Z_OK;
+        level_ = level;
+        if (!is_init_) return false;
+      } else if (deflateReset(&stream_) != Z_OK) {
+        return false;
+      }
+
+      // the window the previous chunk leaves behind
+      auto dictionary_size = std::min(
+          kDictionarySize,
+          static_cast<size_t>(chunk.data - chunk.batch->chunks[0].data));
+      if (dictionary_size > 0 &&
+          deflateSetDictionary(&stream_, chunk.data - dictionary_size,
+                               static_cast<uInt>(dictionary_size)) != Z_OK) {
+        return false;
+      }
+
+      // a sync flush adds an empty stored block on top of the bound
+      chunk.output.resize(deflateBound(&stream_, chunk.size) + 16);
+
+      stream_.next_in = const_cast<Bytef *>(chunk.data);
+      stream_.avail_in = static_cast<uInt>(chunk.size);
+      stream_.next_out = chunk.output.data();
+      stream_.avail_out = static_cast<uInt>(chunk.output.size());
+
+      auto ret = deflate(&stream_, chunk.is_last ? Z_FINISH : Z_SYNC_FLUSH);
+      auto expected = chunk.is_last ? Z_STREAM_END : Z_OK;
+      if (ret != expected || stream_.avail_in != 0) return false;
+
+      chunk.output.resize(chunk.output.size() - stream_.avail_out);
+      chunk.check =
+          format == DeflateFormat::Gzip
+              ? crc32(0, chunk.data, static_cast<uInt>(chunk.size))
+              : adler32(1, chunk.data, static_cast<uInt>(chunk.size));
+      return true;
+    }
+  };
+
+  size_t threads_;
+  size_t chunk_size_;
+  int level_;
+  bool is_run_;
+  std::deque<Chunk *> queue_;
+  std::vector<std::thread> workers_;
+  absl::Mutex mu_;
+  absl::CondVar cv_queue_;
+  absl::CondVar cv_done_;
+
+  void Process(Deflater &deflater, Chunk &chunk) {
+    chunk.ok = deflater.Run(chunk, chunk.batch->level, chunk.batch->format);
+
+    absl::MutexLock lock(&mu_);
+    if (--chunk.batch->pending == 0) cv_done_.SignalAll();
+  }
+
+  void Worker() {
+    Deflater deflater;
+
+    while (true) {
+      Chunk *chunk = nullptr;
+      {
+        absl::MutexLock lock(&mu_);
+        while (queue_.empty() && is_run_) cv_queue_.Wait(&mu_);
+        if (!is_run_) return;
+
+        chunk = queue_.front();
+        queue_.pop_front();
+      }
+
+      Process(deflater, *chunk);
+    }
+  }
+
+  void StartWorkers() {
+    absl::MutexLock lock(&mu_);
+    if (is_run_) return;
+
+    is_run_ = true;
+    // the caller thread is one of the compressors
+    for (size_t i = 1; i < threads_; i++) {
+      workers_.emplace_back(std::thread(&ZlibParallelDeflate::Worker, this));
+    }
+  }
+
+  void StopWorkers() {
+    {
+      absl::MutexLock lock(&mu_);
+      if (!is_run_) return;
+
+      is_run_ = false;
+      cv_queue_.SignalAll();
+    }
+
+    for (auto &t : workers_) {
+      if (t.joinable()) t.join();
+    }
+
+    workers_.clear();
+  }
+
+  static size_t WriteHeader(uint8_t *dest, DeflateFormat format, int level) {
+    if (format == DeflateFormat::Gzip) {
+      // no name, no mtime, unix
+      const uint8_t header[10] = {0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 3};
+      memcpy(dest, header, sizeof(header));
+      return sizeof(header);
+    }
+
+    // FLEVEL only informs, it follows what zlib itself writes
+    uint32_t flevel = 2;
+    if (level >= 0 && level < 2) flevel = 0;
+    if (level >= 2 && level < 6) flevel = 1;
+    if (level > 6) flevel = 3;
+
+    uint32_t header = (0x78 << 8) | (flevel << 6);
+    header += 31 - (header % 31);
+
+    dest[0] = static_cast<uint8_t>(header >> 8);
+    dest[1] = static_cast<uint8_t>(header);
+    return 2;
+  }
+
+  static size_t WriteTrailer(uint8_t *dest, DeflateFormat format,
+                             uint32_t check, size_t size) {
+    if (format == DeflateFormat::Gzip) {
+      auto isize = static_cast<uint32_t>(size);
+      for (int i = 0; i < 4; i++) dest[i] = uint8_t(check >> (8 * i));
+      for (int i = 0; i < 4; i++) dest[4 + i] = uint8_t(isize >> (8 * i));
+      return 8;
+    }
+
+    for (int i = 0; i < 4; i++) dest[i] = uint8_t(check >> (24 - 8 * i));
+    return 4;
+  }
+
+ public:
+  /**
+   * @brief `threads` 0 uses every core. Smaller chunks spread better over
+   * the threads but lose a little ratio at each boundary.
+   */
+  explicit ZlibParallelDeflate(size_t threads = 0,
+                               size_t chunk_size = kDefaultChunkSize,
+                               int level = Z_DEFAULT_COMPRESSION)
+      : threads_(threads > 0 ? threads
+                             : std::max<size_t>(
+                                   1, std::thread::hardware_concurrency())),
+        chunk_size_(std::max(chunk_size, kDictionarySize)),
+        level_(level),
+        is_run_(false),
+        queue_(),
+        workers_(),
+        mu_(),
+        cv_queue_(),
+        cv_done_() {}
+
+  ~ZlibParallelDeflate() { StopWorkers(); }
+
+  ZlibParallelDeflate(const ZlibParallelDeflate &) = delete;
+  ZlibParallelDeflate &operator=(const ZlibParallelDeflate &) = delete;
+
+  size_t Threads() const { return threads_; }
+
+  size_t ChunkSize() const { return chunk_size_; }
+
+  int Level() const { return level_; }
+
+  // applies from the next Deflate()
+  void SetLevel(int level) { level_ = level; }
+
+  /**
+   * @brief Compress `source` into one complete zlib or gzip stream.
+   */
+  std::shared_ptr<core::MemoryBuffer> Deflate(
+      const uint8_t *source, size_t size, bool &result,
+      DeflateFormat format = DeflateFormat::Zlib) {
+    result = false;
+    if (!source || size == 0) return nullptr;
+
+    Batch batch;
+    batch.format = format;
+    batch.level = level_;
+
+    auto count = (size + chunk_size_ - 1) / chunk_size_;
+    batch.chunks.resize(count);
+    batch.pending = count;
+
+    for (size_t i = 0; i < count; i++) {
+      auto &chunk = batch.chunks[i];
+      chunk.batch = &batch;
+      chunk.data = source + i * chunk_size_;
+      chunk.size = std::min(chunk_size_, size - i * chunk_size_);
+      chunk.is_last = i + 1 == count;
+      chunk.check = 0;
+      chunk.ok = false;
+    }
+
+    Deflater deflater;
+    if (count == 1 || threads_ == 1) {
+      // nothing to spread, compress right here
+      for (auto &chunk : batch.chunks) {
+        chunk.ok = deflater.Run(chunk, batch.level, format);
+        if (!chunk.ok) return nullptr;
+      }
+    } else {
+      StartWorkers();
+      {
+        absl::MutexLock lock(&mu_);
+        for (auto &chunk : batch.chunks) queue_.push_back(&chunk);
+        cv_queue_.SignalAll();
+      }
+
+      // help with the queue until this batch is done, any batch's chunk will
+      // do
+      while (true) {
+        Chunk *chunk = nullptr;
+        {
+          absl::MutexLock lock(&mu_);
+          if (batch.pending == 0) break;
+
+          if (queue_.empty()) {
+            cv_done_.Wait(&mu_);
+            continue;
+          }
+
+          chunk = queue_.front();
+          queue_.pop_front();
+        }
+
+        Process(deflater, *chunk);
+      }
+    }
+
+    size_t total = 0;
+    uint32_t check = format == DeflateFormat::Gzip ? crc32(0, nullptr, 0)
+                                                   : adler32(0, nullptr, 0);
+    for (auto &chunk : batch.chunks) {
+      if (!chunk.ok) return nullptr;
+
+      total += chunk.output.size();
+      check = format == DeflateFormat::Gzip
+                  ? crc32_combine(check, chunk.check, chunk.size)
+                  : adler32_combine(check, chunk.check, chunk.size);
+    }
+
+    total += format == DeflateFormat::Gzip ? 10 + 8 : 2 + 4;
+
+    auto buffer = std::make_shared<core::MemoryBuffer>(total);
+    auto dest = buffer->Data();
+    auto position = WriteHeader(dest, format, batch.level);
+
+    for (auto &chunk : batch.chunks) {
+      memcpy(dest + position, chunk.output.data(), chunk.output.size());
+      position += chunk.output.size();
+    }
+
+    WriteTrailer(dest + position, format, check, size);
+
+    result = true;
+    return buffer;
+  }
+};
+
+}  // namespace utils
+}  // namespace v1
+}  // namespace mavix
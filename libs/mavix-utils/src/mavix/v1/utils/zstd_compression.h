@@ -1,16 +1,226 @@
 #pragma once
 
+#include <mavix/v1/core/core.h>
+#include <zstd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "mavix/v1/core/memory_buffer.h"
+#include "mavix/v1/core/segment_buffer.h"
+#include "mavix/v1/utils/icompression.h"
+
 namespace mavix {
 namespace v1 {
 namespace utils {
 
-class ZstdCompression {
+using namespace mavix::v1::core;
+
+/**
+ * @brief Zstandard codec, as used by Blob.zstd_data. The decompression and
+ * compression contexts are created on first use and kept for the lifetime
+ * of the instance, so a worker holding its own instance does not pay for
+ * context setup per block.
+ */
+class ZstdCompression : public ICompression {
  private:
+  struct DCtxDeleter {
+    void operator()(ZSTD_DCtx *ctx) const { ZSTD_freeDCtx(ctx); }
+  };
+
+  struct CCtxDeleter {
+    void operator()(ZSTD_CCtx *ctx) const { ZSTD_freeCCtx(ctx); }
+  };
+
+  std::unique_ptr<ZSTD_DCtx, DCtxDeleter> dctx_;
+  std::unique_ptr<ZSTD_CCtx, CCtxDeleter> cctx_;
+  int level_;
+
+  ZSTD_DCtx *DContext() {
+    if (!dctx_) dctx_.reset(ZSTD_createDCtx());
+    return dctx_.get();
+  }
+
+  ZSTD_CCtx *CContext() {
+    if (!cctx_) cctx_.reset(ZSTD_createCCtx());
+    return cctx_.get();
+  }
+
  public:
-  ZstdCompression();
-  ~ZstdCompression();
-};
+  explicit ZstdCompression(int level = ZSTD_CLEVEL_DEFAULT)
+      : dctx_(nullptr), cctx_(nullptr), level_(level) {}
+
+  ~ZstdCompression() {}
+
+  ZstdCompression(const ZstdCompression &) = delete;
+  ZstdCompression &operator=(const ZstdCompression &) = delete;
+  ZstdCompression(ZstdCompression &&) = default;
+  ZstdCompression &operator=(ZstdCompression &&) = default;
+
+  int Level() const { return level_; }
+
+  void SetLevel(int level) { level_ = level; }
+
+  /**
+   * @brief Inflate `source` straight into `dest`. True only when the frame
+   * decodes to exactly `dest_size` bytes.
+   */
+  bool InflateInto(const uint8_t *source, size_t source_size, uint8_t *dest,
+                   size_t dest_size) {
+    if (!source || !dest || source_size == 0 || dest_size == 0) return false;
+
+    auto ctx = DContext();
+    if (!ctx) return false;
+
+    auto ret = ZSTD_decompressDCtx(ctx, dest, dest_size, source, source_size);
+    return !ZSTD_isError(ret) && ret == dest_size;
+  }
+
+  /**
+   * @brief Inflate into one buffer of exactly `raw_size` bytes. When
+   * `raw_size` is 0 the size recorded in the frame header is used, frames
+   * without one go through the streaming Inflate().
+   */
+  std::shared_ptr<MemoryBuffer> Inflate(const uint8_t *source,
+                                        size_t source_size, size_t raw_size,
+                                        bool &result) {
+    result = false;
+    if (!source || source_size == 0) return nullptr;
+
+    if (raw_size == 0) {
+      auto content_size = ZSTD_getFrameContentSize(source, source_size);
+      if (content_size == ZSTD_CONTENTSIZE_ERROR) return nullptr;
+      if (content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == 0) {
+        return Inflate(source, source_size, result);
+      }
+
+      if (content_size > kMaxInflatedSize) {
+        std::cerr << "Zstd Inflate Exception : frame size " << content_size
+                  << " larger than " << kMaxInflatedSize << " bytes"
+                  << std::endl;
+        return nullptr;
+      }
+
+      raw_size = static_cast<size_t>(content_size);
+    }
+
+    if (raw_size > kMaxInflatedSize) {
+      std::cerr << "Zstd Inflate Exception : raw size " << raw_size
+                << " larger than " << kMaxInflatedSize << " bytes"
+                << std::endl;
+      return nullptr;
+    }
 
+    auto buffer = std::make_shared<MemoryBuffer>(
+        raw_size, memory::MemoryCategory::Inflate);
+    if (InflateInto(source, source_size, buffer->Data(), raw_size)) {
+      result = true;
+      return buffer;
+    }
+
+    buffer->Destroy();
+    std::cerr << "Zstd Inflate Exception : frame does not match raw size "
+              << raw_size << std::endl;
+    return nullptr;
+  }
+
+  std::shared_ptr<MemoryBuffer> Inflate(const uint8_t *source,
+                                        size_t source_size,
+                                        bool &result) override {
+    result = false;
+    if (!source || source_size == 0) return nullptr;
+
+    auto ctx = DContext();
+    if (!ctx) return nullptr;
+    ZSTD_DCtx_reset(ctx, ZSTD_reset_session_only);
+
+    auto chunk = ZSTD_DStreamOutSize();
+    SegmentBuffer buffers(chunk, memory::MemoryCategory::Inflate);
+    MemoryBuffer outbuffer(chunk, memory::MemoryCategory::Inflate);
+
+    ZSTD_inBuffer input = {source, source_size, 0};
+    size_t ret = 0;
+    size_t total = 0;
+
+    // ret is 0 at the end of each frame, input may hold several frames
+    while (true) {
+      ZSTD_outBuffer output = {outbuffer.Data(), chunk, 0};
+      ret = ZSTD_decompressStream(ctx, &output, &input);
+      if (ZSTD_isError(ret)) break;
+
+      total += output.pos;
+      if (total > kMaxInflatedSize) break;
+      if (output.pos > 0) buffers.Add(outbuffer.Data(), output.pos);
+
+      if (input.pos == input.size && (ret == 0 || output.pos < chunk)) break;
+    }
+
+    outbuffer.Destroy();
+
+    if (total > kMaxInflatedSize) {
+      buffers.Destroy();
+      std::cerr << "Zstd Inflate Exception : larger than " << kMaxInflatedSize
+                << " bytes" << std::endl;
+      return nullptr;
+    }
+
+    if (ZSTD_isError(ret) || ret != 0) {
+      buffers.Destroy();
+      std::cerr << "Zstd Inflate Exception : "
+                << (ZSTD_isError(ret) ? ZSTD_getErrorName(ret)
+                                      : "truncated frame")
+                << std::endl;
+      return nullptr;
+    }
+
+    auto flat_buffer = buffers.CopyAsMemoryBuffer();
+    buffers.Destroy();
+
+    if (flat_buffer) result = true;
+    return flat_buffer;
+  }
+
+  std::shared_ptr<MemoryBuffer> Deflate(const uint8_t *source, size_t size,
+                                        bool &result) override {
+    result = false;
+    if (!source || size == 0) return nullptr;
+
+    auto ctx = CContext();
+    if (!ctx) return nullptr;
+
+    auto bound = ZSTD_compressBound(size);
+    MemoryBuffer scratch(bound);
+
+    auto written =
+        ZSTD_compressCCtx(ctx, scratch.Data(), bound, source, size, level_);
+    if (ZSTD_isError(written)) {
+      scratch.Destroy();
+      return nullptr;
+    }
+
+    auto buffer = std::make_shared<MemoryBuffer>(written);
+    buffer->CopyFrom(scratch.Data(), written);
+    scratch.Destroy();
+
+    result = true;
+    return buffer;
+  }
+
+  std::shared_ptr<MemoryBuffer> Deflate(
+      std::shared_ptr<MemoryBuffer> buffer) override {
+    bool result;
+    return Deflate(buffer->Data(), buffer->Size(), result);
+  }
+
+  std::shared_ptr<MemoryBuffer> Inflate(
+      std::shared_ptr<MemoryBuffer> buffer) override {
+    bool result;
+    return Inflate(buffer->Data(), buffer->Size(), result);
+  }
+};
 
 }  // namespace utils
 }  // namespace v1
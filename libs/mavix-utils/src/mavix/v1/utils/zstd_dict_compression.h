@@ -0,0 +1,174 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+#include <zstd.h>
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+
+#include "mavix/v1/core/memory_buffer.h"
+#include "mavix/v1/utils/icompression.h"
+#include "mavix/v1/utils/zstd_dictionary.h"
+
+namespace mavix {
+namespace v1 {
+namespace utils {
+
+using namespace mavix::v1::core;
+
+/**
+ * @brief Zstandard codec bound to one ZstdDictionary, for many small
+ * payloads sharing most of their content (vector tiles of a zoom band).
+ *
+ * Frames carry the dictionary id and are refused by a codec holding another
+ * dictionary. Every frame records its content size, so inflating allocates
+ * exactly once. The dictionary is shared, the contexts are not: keep one
+ * codec per thread.
+ */
+class ZstdDictCompression : public ICompression {
+ private:
+  struct DCtxDeleter {
+    void operator()(ZSTD_DCtx *ctx) const { ZSTD_freeDCtx(ctx); }
+  };
+
+  struct CCtxDeleter {
+    void operator()(ZSTD_CCtx *ctx) const { ZSTD_freeCCtx(ctx); }
+  };
+
+  std::shared_ptr<const ZstdDictionary> dictionary_;
+  std::unique_ptr<ZSTD_DCtx, DCtxDeleter> dctx_;
+  std::unique_ptr<ZSTD_CCtx, CCtxDeleter> cctx_;
+
+  ZSTD_DCtx *DContext() {
+    if (!dctx_) dctx_.reset(ZSTD_createDCtx());
+    return dctx_.get();
+  }
+
+  ZSTD_CCtx *CContext() {
+    if (!cctx_) cctx_.reset(ZSTD_createCCtx());
+    return cctx_.get();
+  }
+
+  bool IsOwnFrame(const uint8_t *source, size_t source_size) const {
+    auto id = ZSTD_getDictID_fromFrame(source, source_size);
+    return id == dictionary_->Id();
+  }
+
+ public:
+  explicit ZstdDictCompression(
+      std::shared_ptr<const ZstdDictionary> dictionary)
+      : dictionary_(std::move(dictionary)), dctx_(nullptr), cctx_(nullptr) {}
+
+  ~ZstdDictCompression() {}
+
+  ZstdDictCompression(const ZstdDictCompression &) = delete;
+  ZstdDictCompression &operator=(const ZstdDictCompression &) = delete;
+  ZstdDictCompression(ZstdDictCompression &&) = default;
+  ZstdDictCompression &operator=(ZstdDictCompression &&) = default;
+
+  const std::shared_ptr<const ZstdDictionary> &Dictionary() const {
+    return dictionary_;
+  }
+
+  /**
+   * @brief Size recorded in the frame header, 0 when it is not a frame of
+   * this codec or larger than kMaxInflatedSize.
+   */
+  size_t InflatedSize(const uint8_t *source, size_t source_size) const {
+    if (!source || source_size == 0 || !IsOwnFrame(source, source_size)) {
+      return 0;
+    }
+
+    auto size = ZSTD_getFrameContentSize(source, source_size);
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN ||
+        size > kMaxInflatedSize) {
+      return 0;
+    }
+
+    return static_cast<size_t>(size);
+  }
+
+  /**
+   * @brief Inflate `source` straight into `dest`. True only when the frame
+   * decodes to exactly `dest_size` bytes.
+   */
+  bool InflateInto(const uint8_t *source, size_t source_size, uint8_t *dest,
+                   size_t dest_size) {
+    if (!dictionary_ || !source || !dest || source_size == 0) return false;
+    if (!IsOwnFrame(source, source_size)) return false;
+
+    auto ctx = DContext();
+    if (!ctx) return false;
+
+    auto ret = ZSTD_decompress_usingDDict(ctx, dest, dest_size, source,
+                                          source_size, dictionary_->DDict());
+    return !ZSTD_isError(ret) && ret == dest_size;
+  }
+
+  std::shared_ptr<MemoryBuffer> Inflate(const uint8_t *source,
+                                        size_t source_size,
+                                        bool &result) override {
+    result = false;
+    if (!dictionary_) return nullptr;
+
+    auto size = InflatedSize(source, source_size);
+    if (size == 0) {
+      std::cerr << "Zstd Dictionary Inflate Exception : not a frame of "
+                << "dictionary " << dictionary_->Id() << std::endl;
+      return nullptr;
+    }
+
+    auto buffer = std::make_shared<MemoryBuffer>(
+        size, memory::MemoryCategory::Inflate);
+    if (!InflateInto(source, source_size, buffer->Data(), size)) {
+      buffer->Destroy();
+      return nullptr;
+    }
+
+    result = true;
+    return buffer;
+  }
+
+  std::shared_ptr<MemoryBuffer> Deflate(const uint8_t *source, size_t size,
+                                        bool &result) override {
+    result = false;
+    if (!dictionary_ || !source || size == 0) return nullptr;
+
+    auto ctx = CContext();
+    if (!ctx) return nullptr;
+
+    auto bound = ZSTD_compressBound(size);
+    MemoryBuffer scratch(bound);
+
+    auto written = ZSTD_compress_usingCDict(ctx, scratch.Data(), bound, source,
+                                            size, dictionary_->CDict());
+    if (ZSTD_isError(written)) {
+      scratch.Destroy();
+      return nullptr;
+    }
+
+    auto buffer = std::make_shared<MemoryBuffer>(written);
+    buffer->CopyFrom(scratch.Data(), written);
+    scratch.Destroy();
+
+    result = true;
+    return buffer;
+  }
+
+  std::shared_ptr<MemoryBuffer> Deflate(
+      std::shared_ptr<MemoryBuffer> buffer) override {
+    bool result;
+    return Deflate(buffer->Data(), buffer->Size(), result);
+  }
+
+  std::shared_ptr<MemoryBuffer> Inflate(
+      std::shared_ptr<MemoryBuffer> buffer) override {
+    bool result;
+    return Inflate(buffer->Data(), buffer->Size(), result);
+  }
+};
+
+}  // namespace utils
+}  // namespace v1
+}  // namespace mavix
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <mavix/v1/core/core.h>
+#include <zdict.h>
+#include <zstd.h>
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mavix {
+namespace v1 {
+namespace utils {
+
+/**
+ * @brief Trained zstd dictionary, immutable once built.
+ *
+ * The digested compression and decompression forms are prepared once and
+ * are read-only, so one dictionary is shared by every ZstdDictCompression
+ * on every thread.
+ */
+class ZstdDictionary {
+ private:
+  struct CDictDeleter {
+    void operator()(ZSTD_CDict *dict) const { ZSTD_freeCDict(dict); }
+  };
+
+  struct DDictDeleter {
+    void operator()(ZSTD_DDict *dict) const { ZSTD_freeDDict(dict); }
+  };
+
+  std::string bytes_;
+  uint32_t id_;
+  int level_;
+  std::unique_ptr<ZSTD_CDict, CDictDeleter> cdict_;
+  std::unique_ptr<ZSTD_DDict, DDictDeleter> ddict_;
+
+  ZstdDictionary(std::string bytes, int level)
+      : bytes_(std::move(bytes)),
+        id_(0),
+        level_(level),
+        cdict_(nullptr),
+        ddict_(nullptr) {}
+
+ public:
+  ~ZstdDictionary() {}
+
+  ZstdDictionary(const ZstdDictionary &) = delete;
+  ZstdDictionary &operator=(const ZstdDictionary &) = delete;
+
+  /**
+   * @brief Dictionary from trained (or saved) bytes, compressing at
+   * `level`. nullptr when zstd cannot digest the bytes.
+   */
+  static std::shared_ptr<ZstdDictionary> Load(
+      std::string bytes, int level = ZSTD_CLEVEL_DEFAULT) {
+    if (bytes.empty()) return nullptr;
+
+    auto dict = std::shared_ptr<ZstdDictionary>(
+        new ZstdDictionary(std::move(bytes), level));
+    auto data = dict->bytes_.data();
+    auto size = dict->bytes_.size();
+
+    dict->cdict_.reset(ZSTD_createCDict(data, size, level));
+    dict->ddict_.reset(ZSTD_createDDict(data, size));
+    if (!dict->cdict_ || !dict->ddict_) return nullptr;
+
+    // raw content dictionaries have no id, frames then carry none either
+    dict->id_ = ZDICT_getDictID(data, size);
+    return dict;
+  }
+
+  uint32_t Id() const { return id_; }
+
+  int Level() const { return level_; }
+
+  const std::string &Bytes() const { return bytes_; }
+
+  size_t Size() const { return bytes_.size(); }
+
+  const ZSTD_CDict *CDict() const { return cdict_.get(); }
+
+  const ZSTD_DDict *DDict() const { return ddict_.get(); }
+};
+
+/**
+ * @brief Collects sample payloads and trains a ZstdDictionary from them.
+ *
+ * Samples should look like what will be compressed later, such as tiles of
+ * one zoom band. zstd wants roughly a hundred times the dictionary size in
+ * samples; past `max_sample_bytes` new samples are refused. Not thread
+ * safe.
+ */
+class ZstdDictionaryTrainer {
+ public:
+  static constexpr size_t kDefaultDictionarySize = 112 * 1024;
+  static constexpr size_t kDefaultMaxSampleBytes = 16 * 1024 * 1024;
+  // fewer samples than this do not train anything useful
+  static constexpr size_t kMinSamples = 8;
+
+ private:
+  std::vector<uint8_t> samples_;
+  std::vector<size_t> sample_sizes_;
+  size_t max_sample_bytes_;
+
+ public:
+  explicit ZstdDictionaryTrainer(
+      size_t max_sample_bytes = kDefaultMaxSampleBytes)
+      : samples_(), sample_sizes_(), max_sample_bytes_(max_sample_bytes) {}
+
+  ~ZstdDictionaryTrainer() {}
+
+  // false once the sample budget is used up, or for an empty sample
+  bool AddSample(const uint8_t *data, size_t size) {
+    if (!data || size == 0) return false;
+    if (samples_.size() + size > max_sample_bytes_) return false;
+
+    samples_.insert(samples_.end(), data, data + size);
+    sample_sizes_.push_back(size);
+    return true;
+  }
+
+  size_t SampleCount() const { return sample_sizes_.size(); }
+
+  size_t SampleBytes() const { return samples_.size(); }
+
+  bool IsFull() const { return samples_.size() >= max_sample_bytes_; }
+
+  void Clear() {
+    samples_.clear();
+    samples_.shrink_to_fit();
+    sample_sizes_.clear();
+    sample_sizes_.shrink_to_fit();
+  }
+
+  /**
+   * @brief Train a dictionary of at most `dictionary_size` bytes from the
+   * samples collected so far. nullptr with too few samples or when zstd
+   * fails; the samples are kept either way.
+   */
+  std::shared_ptr<ZstdDictionary> Train(
+      size_t dictionary_size = kDefaultDictionarySize,
+      int level = ZSTD_CLEVEL_DEFAULT) const {
+    if (sample_sizes_.size() < kMinSamples || dictionary_size == 0) {
+      return nullptr;
+    }
+
+    std::string bytes(dictionary_size, '\0');
+    auto trained = ZDICT_trainFromBuffer(
+        &bytes[0], bytes.size(), samples_.data(), sample_sizes_.data(),
+        static_cast<unsigned>(sample_sizes_.size()));
+
+    if (ZDICT_isError(trained)) {
+      std::cerr << "Zstd Dictionary Training Exception : "
+                << ZDICT_getErrorName(trained) << std::endl;
+      return nullptr;
+    }
+
+    bytes.resize(trained);
+    return ZstdDictionary::Load(std::move(bytes), level);
+  }
+};
+
+}  // namespace utils
+}  // namespace v1
+}  // namespace mavix
@@ -0,0 +1,95 @@
+#include <mavix/v1/core/core.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "mavix/v1/cli/map/pbf_recompress.h"
+#include "nvm/strings/readable_bytes.h"
+
+using namespace mavix::v1;
+
+void PrintUsage() {
+  std::cerr
+      << "Usage: mavix-map-cli <command> [options]\n"
+      << "\n"
+      << "Commands:\n"
+      << "  recompress <input.pbf> <output.pbf> [options]\n"
+      << "      Rewrite every blob with another codec, block order is kept.\n"
+      << "      \"-\" reads stdin or writes stdout.\n"
+      << "\n"
+      << "      --codec <zstd|lz4|zlib|lzma|raw>  codec, default zstd\n"
+      << "      --level <n>                       codec level\n"
+      << "      --threads <n>                     default every core\n"
+      << "      --verbose\n"
+      << std::endl;
+}
+
+int RunRecompress(int argc, char** argv) {
+  if (argc < 4) {
+    PrintUsage();
+    return EXIT_FAILURE;
+  }
+
+  std::string input = argv[2];
+  std::string output = argv[3];
+  cli::map::PbfRecompressOptions options;
+
+  for (int i = 4; i < argc; i++) {
+    std::string arg = argv[i];
+    auto has_value = i + 1 < argc;
+
+    try {
+      if (arg == "--codec" && has_value) {
+        if (!cli::map::PbfRecompress::ParseCodec(argv[++i], options.codec)) {
+          std::cerr << "Unknown codec: " << argv[i] << std::endl;
+          return EXIT_FAILURE;
+        }
+      } else if (arg == "--level" && has_value) {
+        options.level = std::stoi(argv[++i]);
+      } else if (arg == "--threads" && has_value) {
+        options.threads = std::stoul(argv[++i]);
+      } else if (arg == "--verbose") {
+        options.verbose = true;
+      } else {
+        PrintUsage();
+        return EXIT_FAILURE;
+      }
+    } catch (...) {
+      std::cerr << "Invalid value for " << arg << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  cli::map::PbfRecompress recompress(input, output, options);
+  auto state = recompress.Run();
+  auto& stats = recompress.Stats();
+
+  using nvm::strings::ConvertBytesToReadableSizeString;
+  std::cerr << "Recompress " << input << " -> " << output << " ("
+            << options.codec << ") : " << stats.blocks << " blocks, "
+            << ConvertBytesToReadableSizeString(stats.bytes_read) << " -> "
+            << ConvertBytesToReadableSizeString(stats.bytes_written) << " ("
+            << ConvertBytesToReadableSizeString(stats.bytes_raw)
+            << " raw) in " << stats.seconds << " s" << std::endl;
+
+  if (state != core::StreamState::Ok) {
+    std::cerr << "Recompress failed: " << state << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    PrintUsage();
+    return EXIT_FAILURE;
+  }
+
+  std::string command = argv[1];
+  if (command == "recompress") return RunRecompress(argc, argv);
+
+  PrintUsage();
+  return EXIT_FAILURE;
+}
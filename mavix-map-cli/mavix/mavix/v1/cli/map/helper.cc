@@ -1,12 +1,15 @@
-#include "mavix-map/helper.h"
+#include "mavix/v1/cli/map/helper.h"
 
-#include "helper.h"
-
-namespace mavix-map {
+namespace mavix {
 namespace v1 {
+namespace cli {
+namespace map {
+
 Helper::Helper() {}
 
 Helper::~Helper() {}
-}  // namespace v1
 
+}  // namespace map
+}  // namespace cli
+}  // namespace v1
 }  // namespace mavix
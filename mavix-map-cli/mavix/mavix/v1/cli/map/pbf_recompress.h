@@ -0,0 +1,426 @@
+#pragma once
+
+#include <absl/synchronization/mutex.h>
+#include <mavix/v1/core/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mavix/v1/core/stream_read_mode.h"
+#include "mavix/v1/osm/pbf/pbf_blob_writer.h"
+#include "mavix/v1/osm/pbf/pbf_stream_reader.h"
+#include "mavix/v1/utils/compression.h"
+#include "nvm/macro.h"
+
+namespace mavix {
+namespace v1 {
+namespace cli {
+namespace map {
+
+namespace pbf = mavix::v1::osm::pbf;
+
+enum class RecompressCodec { Raw = 0, Zlib = 1, Lz4 = 2, Zstd = 3, Lzma = 4 };
+
+// cppcheck-suppress unknownMacro
+NVM_ENUM_CLASS_DISPLAY_TRAIT(RecompressCodec)
+
+struct PbfRecompressOptions {
+  RecompressCodec codec = RecompressCodec::Zstd;
+  // codec default when not set
+  std::optional<int> level = std::nullopt;
+  // 0 for every core
+  size_t threads = 0;
+  // blocks tokenized but not written yet, 0 for four per thread
+  size_t max_in_flight = 0;
+  bool verbose = false;
+};
+
+struct PbfRecompressStats {
+  size_t blocks = 0;
+  uint64_t bytes_read = 0;
+  uint64_t bytes_raw = 0;
+  uint64_t bytes_written = 0;
+  double seconds = 0;
+};
+
+/**
+ * @brief Rewrite a PBF with every blob recompressed by one codec.
+ *
+ * The input streams once through the forward tokenizer ("-" reads stdin),
+ * blocks are recompressed on a pool of threads and written back in their
+ * original order ("-" writes stdout). At most max_in_flight blocks are held
+ * at any time, the tokenizer waits for the writer beyond that.
+ */
+class PbfRecompress {
+ private:
+  struct Job {
+    uint64_t sequence;
+    std::shared_ptr<pbf::PbfBlobData> data;
+  };
+
+  struct Result {
+    std::string type;
+    OSMPBF::Blob blob;
+    uint64_t raw_size;
+    bool ok;
+  };
+
+  // per thread codec state, reused for every block the thread takes
+  struct Codecs {
+    utils::ZlibCompression zlib;
+    utils::Lz4Compression lz4;
+    utils::ZstdCompression zstd;
+    utils::LzmaCompression lzma;
+    std::unique_ptr<uint8_t[]> scratch;
+    size_t scratch_capacity = 0;
+
+    uint8_t* Scratch(size_t size) {
+      if (size > scratch_capacity) {
+        scratch.reset(new uint8_t[size]);
+        scratch_capacity = size;
+      }
+
+      return scratch.get();
+    }
+  };
+
+  std::string input_;
+  std::string output_;
+  PbfRecompressOptions options_;
+  PbfRecompressStats stats_;
+
+  absl::Mutex mu_;
+  absl::CondVar cv_jobs_;
+  absl::CondVar cv_results_;
+  absl::CondVar cv_written_;
+  std::deque<Job> jobs_;
+  std::map<uint64_t, Result> results_;
+  uint64_t next_sequence_;
+  uint64_t next_write_;
+  bool input_done_;
+  bool failed_;
+
+  void ApplyLevel(Codecs& codecs) const {
+    if (!options_.level) return;
+
+    switch (options_.codec) {
+      case RecompressCodec::Zlib:
+        codecs.zlib.SetLevel(*options_.level);
+        break;
+      case RecompressCodec::Lz4:
+        codecs.lz4.SetLevel(*options_.level);
+        break;
+      case RecompressCodec::Zstd:
+        codecs.zstd.SetLevel(*options_.level);
+        break;
+      case RecompressCodec::Lzma:
+        codecs.lzma.SetLevel(*options_.level);
+        break;
+      default:
+        break;
+    }
+  }
+
+  template <typename TCodec>
+  static core::BufferSlice InflateWith(TCodec& codec, Codecs& codecs,
+                                       const core::BufferSlice& payload,
+                                       size_t raw_size) {
+    if (raw_size > 0) {
+      auto dest = codecs.Scratch(raw_size);
+      if (codec.InflateInto(payload.Data(), payload.Size(), dest, raw_size)) {
+        return core::BufferSlice(dest, raw_size, nullptr);
+      }
+    }
+
+    bool state;
+    auto buffer = codec.Inflate(payload.Data(), payload.Size(), 0, state);
+    return state ? core::BufferSlice::FromMemoryBuffer(buffer)
+                 : core::BufferSlice();
+  }
+
+  // uncompressed block, only valid until the next call on `codecs`
+  static core::BufferSlice Uncompressed(Codecs& codecs,
+                                        pbf::PbfBlobData& data) {
+    auto& blob = data.blob;
+    auto raw_size = static_cast<size_t>(std::max(0, blob.raw_size()));
+
+    switch (blob.data_case()) {
+      case OSMPBF::Blob::kRaw:
+        return data.blob_data;
+      case OSMPBF::Blob::kZlibData:
+        return InflateWith(codecs.zlib, codecs, data.blob_data, raw_size);
+      case OSMPBF::Blob::kLzmaData:
+        return InflateWith(codecs.lzma, codecs, data.blob_data, raw_size);
+      case OSMPBF::Blob::kLz4Data:
+        return InflateWith(codecs.lz4, codecs, data.blob_data, raw_size);
+      case OSMPBF::Blob::kZstdData:
+        return InflateWith(codecs.zstd, codecs, data.blob_data, raw_size);
+      default:
+        return core::BufferSlice();
+    }
+  }
+
+  Result Recompress(Codecs& codecs, pbf::PbfBlobData& data) const {
+    Result result{data.header.type(), OSMPBF::Blob(), 0, false};
+
+    auto raw = Uncompressed(codecs, data);
+    if (!raw && data.blob.data_case() != OSMPBF::Blob::kRaw) return result;
+
+    result.raw_size = raw.Size();
+    if (options_.codec == RecompressCodec::Raw) {
+      result.blob.set_raw(raw.Data(), raw.Size());
+      result.ok = true;
+      return result;
+    }
+
+    bool state = false;
+    std::shared_ptr<core::MemoryBuffer> packed;
+    switch (options_.codec) {
+      case RecompressCodec::Zlib:
+        packed = codecs.zlib.Deflate(raw.Data(), raw.Size(), state);
+        break;
+      case RecompressCodec::Lz4:
+        packed = codecs.lz4.Deflate(raw.Data(), raw.Size(), state);
+        break;
+      case RecompressCodec::Zstd:
+        packed = codecs.zstd.Deflate(raw.Data(), raw.Size(), state);
+        break;
+      case RecompressCodec::Lzma:
+        packed = codecs.lzma.Deflate(raw.Data(), raw.Size(), state);
+        break;
+      default:
+        break;
+    }
+
+    if (!state || !packed) return result;
+
+    auto bytes = reinterpret_cast<const char*>(packed->Data());
+    auto size = static_cast<size_t>(packed->Size());
+    switch (options_.codec) {
+      case RecompressCodec::Zlib:
+        result.blob.set_zlib_data(bytes, size);
+        break;
+      case RecompressCodec::Lz4:
+        result.blob.set_lz4_data(bytes, size);
+        break;
+      case RecompressCodec::Zstd:
+        result.blob.set_zstd_data(bytes, size);
+        break;
+      case RecompressCodec::Lzma:
+        result.blob.set_lzma_data(bytes, size);
+        break;
+      default:
+        break;
+    }
+
+    packed->Destroy();
+    result.blob.set_raw_size(static_cast<int32_t>(raw.Size()));
+    result.ok = true;
+    return result;
+  }
+
+  void Worker() {
+    Codecs codecs;
+    ApplyLevel(codecs);
+
+    while (true) {
+      Job job;
+      {
+        absl::MutexLock lock(&mu_);
+        while (jobs_.empty() && !input_done_ && !failed_) cv_jobs_.Wait(&mu_);
+        if (jobs_.empty() || failed_) return;
+
+        job = std::move(jobs_.front());
+        jobs_.pop_front();
+      }
+
+      auto result = Recompress(codecs, *job.data);
+      job.data.reset();
+
+      absl::MutexLock lock(&mu_);
+      results_.emplace(job.sequence, std::move(result));
+      cv_results_.SignalAll();
+    }
+  }
+
+  void Writer(pbf::PbfBlobWriter& writer) {
+    while (true) {
+      Result result;
+      {
+        absl::MutexLock lock(&mu_);
+        while (!failed_ && results_.count(next_write_) == 0 &&
+               !(input_done_ && next_write_ == next_sequence_)) {
+          cv_results_.Wait(&mu_);
+        }
+
+        if (failed_ || results_.count(next_write_) == 0) return;
+
+        auto entry = results_.find(next_write_);
+        result = std::move(entry->second);
+        results_.erase(entry);
+      }
+
+      auto written = result.ok && writer.Write(result.type, result.blob);
+
+      absl::MutexLock lock(&mu_);
+      if (!written) {
+        std::cerr << "Recompress failed at block " << next_write_ << std::endl;
+        failed_ = true;
+        cv_jobs_.SignalAll();
+        cv_written_.SignalAll();
+        return;
+      }
+
+      stats_.blocks++;
+      stats_.bytes_raw += result.raw_size;
+      next_write_++;
+      cv_written_.SignalAll();
+
+      if (options_.verbose && stats_.blocks % 1000 == 0) {
+        std::cerr << "Recompressed " << stats_.blocks << " blocks" << std::endl;
+      }
+    }
+  }
+
+  void Enqueue(std::shared_ptr<pbf::PbfBlobData> data, size_t max_in_flight) {
+    absl::MutexLock lock(&mu_);
+    while (!failed_ && next_sequence_ - next_write_ >= max_in_flight) {
+      cv_written_.Wait(&mu_);
+    }
+
+    // keep draining the tokenizer, nothing more is written after a failure
+    if (failed_) return;
+
+    stats_.bytes_read += data->blob_data.Size();
+    jobs_.push_back(Job{next_sequence_++, std::move(data)});
+    cv_jobs_.Signal();
+  }
+
+ public:
+  PbfRecompress(const std::string& input, const std::string& output,
+                PbfRecompressOptions options = PbfRecompressOptions())
+      : input_(std::string(input)),
+        output_(std::string(output)),
+        options_(options),
+        stats_(),
+        mu_(),
+        cv_jobs_(),
+        cv_results_(),
+        cv_written_(),
+        jobs_(),
+        results_(),
+        next_sequence_(0),
+        next_write_(0),
+        input_done_(false),
+        failed_(false) {}
+
+  ~PbfRecompress() {}
+
+  /**
+   * @brief Recompress the whole input, blocks until the output is written.
+   * The output is incomplete when the result is not StreamState::Ok.
+   */
+  core::StreamState Run() {
+    auto started = std::chrono::steady_clock::now();
+
+    size_t threads = options_.threads;
+    if (threads == 0) {
+      threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    }
+    auto max_in_flight =
+        options_.max_in_flight > 0 ? options_.max_in_flight : threads * 4;
+
+    pbf::PbfBlobWriter writer(output_);
+    auto state = writer.Open();
+    if (state != core::StreamState::Ok) return state;
+
+    pbf::PbfStreamReader reader(input_, osm::SkipOptions::None,
+                                core::CacheGenerationOptions::None,
+                                1024 * 1024 * 64, false,
+                                core::StreamReadMode::ForwardOnly);
+    reader.OnDataReady([this, max_in_flight](
+                           pbf::PbfTokenizer*,
+                           std::shared_ptr<pbf::PbfBlobData> data) {
+      Enqueue(std::move(data), max_in_flight);
+    });
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < threads; i++) {
+      workers.emplace_back([this]() { Worker(); });
+    }
+
+    std::thread writer_thread([this, &writer]() { Writer(writer); });
+
+    // a truncated or corrupt input ends the tokenizer early
+    auto finished = core::StreamState::Unknown;
+    reader.OnFinished([&finished](pbf::PbfTokenizer*, core::StreamState s) {
+      finished = s;
+    });
+
+    state = reader.Start(options_.verbose);
+    reader.Stop();
+    if (state == core::StreamState::Ok) state = finished;
+
+    {
+      absl::MutexLock lock(&mu_);
+      input_done_ = true;
+      if (state != core::StreamState::Ok) failed_ = true;
+      cv_jobs_.SignalAll();
+      cv_results_.SignalAll();
+    }
+
+    for (auto& worker : workers) worker.join();
+    writer_thread.join();
+
+    stats_.bytes_written = writer.BytesWritten();
+    auto closed = writer.Close();
+
+    stats_.seconds = std::chrono::duration<double>(
+                         std::chrono::steady_clock::now() - started)
+                         .count();
+
+    if (failed_) {
+      return state != core::StreamState::Ok ? state : core::StreamState::Error;
+    }
+
+    return closed;
+  }
+
+  const PbfRecompressStats& Stats() const { return stats_; }
+
+  const PbfRecompressOptions& Options() const { return options_; }
+
+  /**
+   * @brief Codec by name: raw, zlib, lz4, zstd or lzma.
+   */
+  static bool ParseCodec(const std::string& name, RecompressCodec& codec) {
+    if (name == "raw") {
+      codec = RecompressCodec::Raw;
+    } else if (name == "zlib") {
+      codec = RecompressCodec::Zlib;
+    } else if (name == "lz4") {
+      codec = RecompressCodec::Lz4;
+    } else if (name == "zstd") {
+      codec = RecompressCodec::Zstd;
+    } else if (name == "lzma") {
+      codec = RecompressCodec::Lzma;
+    } else {
+      return false;
+    }
+
+    return true;
+  }
+};
+
+}  // namespace map
+}  // namespace cli
+}  // namespace v1
+}  // namespace mavix